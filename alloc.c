@@ -8,6 +8,12 @@
  * we never free an object descriptor anyway), but even more because it ends
  * up with maximal alignment because it doesn't know what the object alignment
  * for the new allocation is.
+ *
+ * Nodes are carved out of blocks of BLOCKING nodes of one type.  The blocks
+ * are remembered (in address order), so that a program that is done with
+ * all the objects it has parsed can hand them back at once with
+ * release_object_nodes(), and so that we can tell whether a node came from
+ * here or from malloc().
  */
 #include "cache.h"
 #include "object.h"
@@ -18,23 +24,76 @@
 
 #define BLOCKING 1024
 
+struct alloc_state {
+	const char *name;
+	size_t size;		/* of one node */
+	unsigned int count;	/* nodes handed out */
+	char **blocks;		/* sorted by address */
+	int nr, alloc;
+	char *next;
+	int left;
+};
+
+static void *alloc_node(struct alloc_state *s)
+{
+	void *ret;
+
+	if (!s->left) {
+		char *block = xmalloc(BLOCKING * s->size);
+		int i;
+
+		ALLOC_GROW(s->blocks, s->nr + 1, s->alloc);
+		for (i = s->nr; i > 0 && s->blocks[i - 1] > block; i--)
+			s->blocks[i] = s->blocks[i - 1];
+		s->blocks[i] = block;
+		s->nr++;
+		s->next = block;
+		s->left = BLOCKING;
+	}
+	s->left--;
+	s->count++;
+	ret = s->next;
+	s->next += s->size;
+	memset(ret, 0, s->size);
+	return ret;
+}
+
+static int alloc_state_owns(const struct alloc_state *s, const void *ptr)
+{
+	const char *p = ptr;
+	int lo = 0, hi = s->nr;
+
+	while (lo < hi) {
+		int mi = (lo + hi) / 2;
+		if (p < s->blocks[mi])
+			hi = mi;
+		else if (p >= s->blocks[mi] + BLOCKING * s->size)
+			lo = mi + 1;
+		else
+			return 1;
+	}
+	return 0;
+}
+
+static void release_alloc_state(struct alloc_state *s)
+{
+	int i;
+
+	for (i = 0; i < s->nr; i++)
+		free(s->blocks[i]);
+	free(s->blocks);
+	s->blocks = NULL;
+	s->nr = s->alloc = 0;
+	s->next = NULL;
+	s->left = 0;
+	s->count = 0;
+}
+
 #define DEFINE_ALLOCATOR(name, type)				\
-static unsigned int name##_allocs;				\
+static struct alloc_state name##_state = { #name, sizeof(type) }; \
 void *alloc_##name##_node(void)					\
 {								\
-	static int nr;						\
-	static type *block;					\
-	void *ret;						\
-								\
-	if (!nr) {						\
-		nr = BLOCKING;					\
-		block = xmalloc(BLOCKING * sizeof(type));	\
-	}							\
-	nr--;							\
-	name##_allocs++;					\
-	ret = block++;						\
-	memset(ret, 0, sizeof(type));				\
-	return ret;						\
+	return alloc_node(&name##_state);			\
 }
 
 union any_object {
@@ -47,30 +106,74 @@ union any_object {
 
 DEFINE_ALLOCATOR(blob, struct blob)
 DEFINE_ALLOCATOR(tree, struct tree)
-DEFINE_ALLOCATOR(commit, struct commit)
 DEFINE_ALLOCATOR(tag, struct tag)
 DEFINE_ALLOCATOR(object, union any_object)
+DEFINE_ALLOCATOR(commit_list, struct commit_list)
 
-#ifdef NO_C99_FORMAT
-#define SZ_FMT "%u"
-#else
-#define SZ_FMT "%zu"
-#endif
+static struct alloc_state commit_state = { "commit", sizeof(struct commit) };
+static unsigned int commit_count;
 
-static void report(const char *name, unsigned int count, size_t size)
+/*
+ * Every commit gets its own index, whichever way it came into being,
+ * and indices are never reused, not even by release_object_nodes().
+ */
+unsigned int alloc_commit_index(void)
 {
-    fprintf(stderr, "%10s: %8u (" SZ_FMT " kB)\n", name, count, size);
+	return commit_count++;
 }
 
-#undef SZ_FMT
+void *alloc_commit_node(void)
+{
+	struct commit *c = alloc_node(&commit_state);
+	c->index = alloc_commit_index();
+	return c;
+}
+
+static struct alloc_state *all_states[] = {
+	&blob_state,
+	&tree_state,
+	&commit_state,
+	&tag_state,
+	&object_state,
+	&commit_list_state,
+};
+
+int is_alloc_commit_list_node(const struct commit_list *list)
+{
+	return alloc_state_owns(&commit_list_state, list);
+}
+
+void release_object_nodes(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(all_states); i++)
+		release_alloc_state(all_states[i]);
+}
 
-#define REPORT(name)	\
-    report(#name, name##_allocs, name##_allocs*sizeof(struct name) >> 10)
+size_t alloc_bytes_reserved(void)
+{
+	size_t total = 0;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(all_states); i++)
+		total += (size_t)all_states[i]->nr * BLOCKING * all_states[i]->size;
+	return total;
+}
+
+static void report(const struct alloc_state *s)
+{
+	unsigned long used = (unsigned long)s->count * s->size;
+	unsigned long reserved = (unsigned long)s->nr * BLOCKING * s->size;
+
+	fprintf(stderr, "%12s: %8u (%lu kB used, %lu kB reserved)\n",
+		s->name, s->count, used >> 10, reserved >> 10);
+}
 
 void alloc_report(void)
 {
-	REPORT(blob);
-	REPORT(tree);
-	REPORT(commit);
-	REPORT(tag);
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(all_states); i++)
+		report(all_states[i]);
 }
@@ -3,6 +3,7 @@
  */
 #include "cache.h"
 #include "archive.h"
+#include "streaming.h"
 
 static int zip_date;
 static int zip_time;
@@ -16,6 +17,9 @@ static unsigned int zip_dir_entries;
 
 #define ZIP_DIRECTORY_MIN_SIZE	(1024 * 1024)
 
+/* general purpose flag: crc and sizes follow the data */
+#define ZIP_STREAM	(1 << 3)
+
 struct zip_local_header {
 	unsigned char magic[4];
 	unsigned char version[2];
@@ -52,6 +56,14 @@ struct zip_dir_header {
 	unsigned char _end[1];
 };
 
+struct zip_data_desc {
+	unsigned char magic[4];
+	unsigned char crc32[4];
+	unsigned char compressed_size[4];
+	unsigned char size[4];
+	unsigned char _end[1];
+};
+
 struct zip_dir_trailer {
 	unsigned char magic[4];
 	unsigned char disk[2];
@@ -71,6 +83,7 @@ struct zip_dir_trailer {
  */
 #define ZIP_LOCAL_HEADER_SIZE	offsetof(struct zip_local_header, _end)
 #define ZIP_DIR_HEADER_SIZE	offsetof(struct zip_dir_header, _end)
+#define ZIP_DATA_DESC_SIZE	offsetof(struct zip_data_desc, _end)
 #define ZIP_DIR_TRAILER_SIZE	offsetof(struct zip_dir_trailer, _end)
 
 static void copy_le16(unsigned char *dest, unsigned int n)
@@ -120,6 +133,79 @@ static void *zlib_deflate(void *data, unsigned long size,
 	return buffer;
 }
 
+/*
+ * Write out the contents of a (large) blob without having all of it in
+ * core, deflating it on the fly if method is 8.  The crc and the sizes
+ * are only known afterwards, and are returned to the caller.
+ */
+static int write_zip_stream(const unsigned char *sha1, int method,
+		int compression_level, unsigned long *crc,
+		unsigned long *compressed_size, unsigned long *size)
+{
+	struct git_istream *st;
+	enum object_type type;
+	unsigned long sz;
+	z_stream stream;
+	unsigned char buf[16384], compressed[16384];
+	ssize_t readlen;
+	int result = Z_OK;
+
+	st = open_istream(sha1, &type, &sz);
+	if (!st)
+		return error("cannot stream blob %s", sha1_to_hex(sha1));
+
+	*crc = crc32(0, NULL, 0);
+	*compressed_size = 0;
+	*size = 0;
+	if (method == 8) {
+		memset(&stream, 0, sizeof(stream));
+		/* raw deflate stream, without the zlib header and trailer */
+		deflateInit2(&stream, compression_level, Z_DEFLATED,
+			     -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+	}
+
+	for (;;) {
+		int flush;
+
+		readlen = read_istream(st, (char *)buf, sizeof(buf));
+		if (readlen < 0)
+			break;
+		*crc = crc32(*crc, buf, readlen);
+		*size += readlen;
+		if (method != 8) {
+			if (!readlen)
+				break;
+			write_or_die(1, buf, readlen);
+			*compressed_size += readlen;
+			continue;
+		}
+
+		flush = readlen ? Z_NO_FLUSH : Z_FINISH;
+		stream.next_in = buf;
+		stream.avail_in = readlen;
+		do {
+			stream.next_out = compressed;
+			stream.avail_out = sizeof(compressed);
+			result = deflate(&stream, flush);
+			write_or_die(1, compressed,
+				     stream.next_out - compressed);
+			*compressed_size += stream.next_out - compressed;
+		} while (!stream.avail_out ||
+			 (flush == Z_FINISH && result == Z_OK));
+		if (!readlen)
+			break;
+	}
+	close_istream(st);
+	if (method == 8)
+		deflateEnd(&stream);
+
+	if (readlen < 0 || (method == 8 && result != Z_STREAM_END))
+		return error("cannot stream blob %s", sha1_to_hex(sha1));
+	if (*size != sz)
+		return error("short read of blob %s", sha1_to_hex(sha1));
+	return 0;
+}
+
 static int write_zip_entry(struct archiver_args *args,
 		const unsigned char *sha1, const char *path, size_t pathlen,
 		unsigned int mode, void *buffer, unsigned long size)
@@ -131,7 +217,9 @@ static int write_zip_entry(struct archiver_args *args,
 	unsigned long uncompressed_size;
 	unsigned long crc;
 	unsigned long direntsize;
+	unsigned long header_offset;
 	int method;
+	int flags = 0;
 	unsigned char *out;
 	void *deflated = NULL;
 
@@ -154,7 +242,10 @@ static int write_zip_entry(struct archiver_args *args,
 			(mode & 0111) ? ((mode) << 16) : 0;
 		if (S_ISREG(mode) && args->compression_level != 0)
 			method = 8;
-		crc = crc32(crc, buffer, size);
+		if (!buffer && S_ISREG(mode))
+			flags |= ZIP_STREAM;
+		else
+			crc = crc32(crc, buffer, size);
 		out = buffer;
 		uncompressed_size = size;
 		compressed_size = size;
@@ -163,7 +254,7 @@ static int write_zip_entry(struct archiver_args *args,
 				sha1_to_hex(sha1));
 	}
 
-	if (method == 8) {
+	if (method == 8 && !(flags & ZIP_STREAM)) {
 		deflated = zlib_deflate(buffer, size, args->compression_level,
 				&compressed_size);
 		if (deflated && compressed_size - 6 < size) {
@@ -177,6 +268,49 @@ static int write_zip_entry(struct archiver_args *args,
 		}
 	}
 
+	header_offset = zip_offset;
+	copy_le32(header.magic, 0x04034b50);
+	copy_le16(header.version, 10);
+	copy_le16(header.flags, flags);
+	copy_le16(header.compression_method, method);
+	copy_le16(header.mtime, zip_time);
+	copy_le16(header.mdate, zip_date);
+	if (flags & ZIP_STREAM) {
+		/* crc and sizes are in the data descriptor */
+		copy_le32(header.crc32, 0);
+		copy_le32(header.compressed_size, 0);
+		copy_le32(header.size, 0);
+	} else {
+		copy_le32(header.crc32, crc);
+		copy_le32(header.compressed_size, compressed_size);
+		copy_le32(header.size, uncompressed_size);
+	}
+	copy_le16(header.filename_length, pathlen);
+	copy_le16(header.extra_length, 0);
+	write_or_die(1, &header, ZIP_LOCAL_HEADER_SIZE);
+	zip_offset += ZIP_LOCAL_HEADER_SIZE;
+	write_or_die(1, path, pathlen);
+	zip_offset += pathlen;
+	if (flags & ZIP_STREAM) {
+		struct zip_data_desc desc;
+
+		if (write_zip_stream(sha1, method, args->compression_level,
+				     &crc, &compressed_size,
+				     &uncompressed_size))
+			return -1;
+		zip_offset += compressed_size;
+
+		copy_le32(desc.magic, 0x08074b50);
+		copy_le32(desc.crc32, crc);
+		copy_le32(desc.compressed_size, compressed_size);
+		copy_le32(desc.size, uncompressed_size);
+		write_or_die(1, &desc, ZIP_DATA_DESC_SIZE);
+		zip_offset += ZIP_DATA_DESC_SIZE;
+	} else if (compressed_size > 0) {
+		write_or_die(1, out, compressed_size);
+		zip_offset += compressed_size;
+	}
+
 	/* make sure we have enough free space in the dictionary */
 	direntsize = ZIP_DIR_HEADER_SIZE + pathlen;
 	while (zip_dir_size < zip_dir_offset + direntsize) {
@@ -188,7 +322,7 @@ static int write_zip_entry(struct archiver_args *args,
 	copy_le16(dirent.creator_version,
 		S_ISLNK(mode) || (S_ISREG(mode) && (mode & 0111)) ? 0x0317 : 0);
 	copy_le16(dirent.version, 10);
-	copy_le16(dirent.flags, 0);
+	copy_le16(dirent.flags, flags);
 	copy_le16(dirent.compression_method, method);
 	copy_le16(dirent.mtime, zip_time);
 	copy_le16(dirent.mdate, zip_date);
@@ -201,33 +335,13 @@ static int write_zip_entry(struct archiver_args *args,
 	copy_le16(dirent.disk, 0);
 	copy_le16(dirent.attr1, 0);
 	copy_le32(dirent.attr2, attr2);
-	copy_le32(dirent.offset, zip_offset);
+	copy_le32(dirent.offset, header_offset);
 	memcpy(zip_dir + zip_dir_offset, &dirent, ZIP_DIR_HEADER_SIZE);
 	zip_dir_offset += ZIP_DIR_HEADER_SIZE;
 	memcpy(zip_dir + zip_dir_offset, path, pathlen);
 	zip_dir_offset += pathlen;
 	zip_dir_entries++;
 
-	copy_le32(header.magic, 0x04034b50);
-	copy_le16(header.version, 10);
-	copy_le16(header.flags, 0);
-	copy_le16(header.compression_method, method);
-	copy_le16(header.mtime, zip_time);
-	copy_le16(header.mdate, zip_date);
-	copy_le32(header.crc32, crc);
-	copy_le32(header.compressed_size, compressed_size);
-	copy_le32(header.size, uncompressed_size);
-	copy_le16(header.filename_length, pathlen);
-	copy_le16(header.extra_length, 0);
-	write_or_die(1, &header, ZIP_LOCAL_HEADER_SIZE);
-	zip_offset += ZIP_LOCAL_HEADER_SIZE;
-	write_or_die(1, path, pathlen);
-	zip_offset += pathlen;
-	if (compressed_size > 0) {
-		write_or_die(1, out, compressed_size);
-		zip_offset += compressed_size;
-	}
-
 	free(deflated);
 
 	return 0;
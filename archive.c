@@ -136,10 +136,21 @@ static int write_archive_entry(const unsigned char *sha1, const char *base,
 		return (S_ISDIR(mode) ? READ_TREE_RECURSIVE : 0);
 	}
 
-	buffer = sha1_file_to_archive(path_without_prefix, sha1, mode,
-			&type, &size, convert ? args->commit : NULL);
-	if (!buffer)
-		return error("cannot read %s", sha1_to_hex(sha1));
+	/*
+	 * Large blobs that need no conversion are handed to the backend
+	 * without a buffer; it streams them out itself.
+	 */
+	if (S_ISREG(mode) && !convert &&
+	    sha1_object_info(sha1, &size) == OBJ_BLOB &&
+	    size > big_file_threshold &&
+	    convert_is_identity(path_without_prefix, 1)) {
+		buffer = NULL;
+	} else {
+		buffer = sha1_file_to_archive(path_without_prefix, sha1, mode,
+				&type, &size, convert ? args->commit : NULL);
+		if (!buffer)
+			return error("cannot read %s", sha1_to_hex(sha1));
+	}
 	if (args->verbose)
 		fprintf(stderr, "%.*s\n", (int)path.len, path.buf);
 	err = write_entry(args, sha1, path.buf, path.len, mode, buffer, size);
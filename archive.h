@@ -16,6 +16,11 @@ struct archiver_args {
 
 typedef int (*write_archive_fn_t)(struct archiver_args *);
 
+/*
+ * For a regular file, buffer is NULL when the blob is larger than
+ * core.bigFileThreshold and needs no conversion; the backend is
+ * expected to stream its "size" bytes with open_istream().
+ */
 typedef int (*write_archive_entry_fn_t)(struct archiver_args *args, const unsigned char *sha1, const char *path, size_t pathlen, unsigned int mode, void *buffer, unsigned long size);
 
 /*
@@ -1,6 +1,8 @@
 #define NO_THE_INDEX_COMPATIBILITY_MACROS
 #include "cache.h"
 #include "attr.h"
+#include "hash.h"
+#include "pattern-bucket.h"
 
 const char git_attr__true[] = "(builtin)true";
 const char git_attr__false[] = "\0(builtin)false";
@@ -258,11 +260,23 @@ static struct attr_stack {
 	unsigned num_matches;
 	unsigned alloc;
 	struct match_attr **attrs;
+
+	unsigned compiled : 1;
+	unsigned cached : 1;
+	struct attr_stack *next_cached;	/* same hash in attr_cache */
+	struct pattern_buckets patterns;
 } *attr_stack;
 
+/*
+ * The stack element of each directory, once read, so that coming back
+ * to a directory does not read and compile its .gitattributes again.
+ */
+static struct hash_table attr_cache;
+
 static void free_attr_elem(struct attr_stack *e)
 {
 	int i;
+	clear_pattern_buckets(&e->patterns);
 	free(e->origin);
 	for (i = 0; i < e->num_matches; i++) {
 		struct match_attr *a = e->attrs[i];
@@ -449,13 +463,53 @@ static void debug_set(const char *what, const char *match, struct git_attr *attr
 #define debug_set(a,b,c,d) do { ; } while (0)
 #endif
 
+static int free_cached_attr_elem(void *ptr)
+{
+	struct attr_stack *elem = ptr;
+
+	while (elem) {
+		struct attr_stack *next = elem->next_cached;
+		free_attr_elem(elem);
+		elem = next;
+	}
+	return 0;
+}
+
 static void drop_attr_stack(void)
 {
 	while (attr_stack) {
 		struct attr_stack *elem = attr_stack;
 		attr_stack = elem->prev;
-		free_attr_elem(elem);
+		if (!elem->cached)
+			free_attr_elem(elem);
+	}
+	for_each_hash(&attr_cache, free_cached_attr_elem);
+	free_hash(&attr_cache);
+}
+
+static struct attr_stack *read_cached_attr(const char *dir, int dirlen)
+{
+	unsigned hash = hash_name(dir, dirlen);
+	struct attr_stack *elem;
+	struct strbuf path = STRBUF_INIT;
+	void **pos;
+
+	for (elem = lookup_hash(hash, &attr_cache); elem; elem = elem->next_cached)
+		if (!strncmp(elem->origin, dir, dirlen) && !elem->origin[dirlen])
+			return elem;
+
+	strbuf_add(&path, dir, dirlen);
+	strbuf_addf(&path, "/%s", GITATTRIBUTES_FILE);
+	elem = read_attr(path.buf, 0);
+	strbuf_release(&path);
+	elem->origin = xmemdupz(dir, dirlen);
+	elem->cached = 1;
+	pos = insert_hash(hash, elem, &attr_cache);
+	if (pos) {
+		elem->next_cached = *pos;
+		*pos = elem;
 	}
+	return elem;
 }
 
 static void bootstrap_attr_stack(void)
@@ -489,9 +543,6 @@ static void prepare_attr_stack(const char *path, int dirlen)
 {
 	struct attr_stack *elem, *info;
 	int len;
-	struct strbuf pathbuf;
-
-	strbuf_init(&pathbuf, dirlen+2+strlen(GITATTRIBUTES_FILE));
 
 	/*
 	 * At the bottom of the attribute stack is the built-in
@@ -529,7 +580,8 @@ static void prepare_attr_stack(const char *path, int dirlen)
 
 		debug_pop(elem);
 		attr_stack = elem->prev;
-		free_attr_elem(elem);
+		if (!elem->cached)
+			free_attr_elem(elem);
 	}
 
 	/*
@@ -537,19 +589,15 @@ static void prepare_attr_stack(const char *path, int dirlen)
 	 */
 	if (!is_bare_repository() || direction == GIT_ATTR_INDEX) {
 		while (1) {
-			char *cp;
+			const char *cp;
 
 			len = strlen(attr_stack->origin);
 			if (dirlen <= len)
 				break;
-			strbuf_reset(&pathbuf);
-			strbuf_add(&pathbuf, path, dirlen);
-			strbuf_addch(&pathbuf, '/');
-			cp = strchr(pathbuf.buf + len + 1, '/');
-			strcpy(cp + 1, GITATTRIBUTES_FILE);
-			elem = read_attr(pathbuf.buf, 0);
-			*cp = '\0';
-			elem->origin = strdup(pathbuf.buf);
+			cp = memchr(path + len + 1, '/', dirlen - len - 1);
+			if (!cp)
+				cp = path + dirlen;
+			elem = read_cached_attr(path, cp - path);
 			elem->prev = attr_stack;
 			attr_stack = elem;
 			debug_push(elem);
@@ -607,17 +655,46 @@ static int fill_one(const char *what, struct match_attr *a, int rem)
 	return rem;
 }
 
-static int fill(const char *path, int pathlen, struct attr_stack *stk, int rem)
+static void compile_attr_stack(struct attr_stack *stk)
 {
 	int i;
-	const char *base = stk->origin ? stk->origin : "";
 
-	for (i = stk->num_matches - 1; 0 < rem && 0 <= i; i--) {
+	for (i = 0; i < stk->num_matches; i++) {
 		struct match_attr *a = stk->attrs[i];
+		const char *pattern = a->u.pattern;
+		const char *dot;
+
 		if (a->is_macro)
 			continue;
-		if (path_matches(path, pathlen,
-				 a->u.pattern, base, strlen(base)))
+		if (strchr(pattern, '/'))
+			; /* matched against the whole path */
+		else if (!strpbrk(pattern, "*?[\\")) {
+			add_basename_pattern(&stk->patterns, pattern, i);
+			continue;
+		} else if (*pattern == '*' && !strpbrk(pattern + 1, "*?[\\") &&
+			   (dot = strrchr(pattern, '.'))) {
+			add_extension_pattern(&stk->patterns, dot + 1, i);
+			continue;
+		}
+		add_glob_pattern(&stk->patterns, i);
+	}
+	stk->compiled = 1;
+}
+
+static int fill(const char *path, int pathlen, const char *basename,
+		struct attr_stack *stk, int rem)
+{
+	const char *base = stk->origin ? stk->origin : "";
+	int baselen = strlen(base), i;
+	struct pattern_candidates c;
+
+	if (!stk->compiled)
+		compile_attr_stack(stk);
+	init_pattern_candidates(&c, &stk->patterns, basename,
+				pathlen - (basename - path));
+	while (0 < rem && 0 <= (i = next_pattern_candidate(&c))) {
+		struct match_attr *a = stk->attrs[i];
+		if (path_matches(path, pathlen, a->u.pattern, base, baselen))
 			rem = fill_one("fill", a, rem);
 	}
 	return rem;
@@ -658,7 +735,7 @@ int git_checkattr(const char *path, int num, struct git_attr_check *check)
 	prepare_attr_stack(path, dirlen);
 	rem = attr_nr;
 	for (stk = attr_stack; 0 < rem && stk; stk = stk->prev)
-		rem = fill(path, pathlen, stk, rem);
+		rem = fill(path, pathlen, cp ? cp + 1 : path, stk, rem);
 
 	for (stk = attr_stack; 0 < rem && stk; stk = stk->prev)
 		rem = macroexpand(stk, rem);
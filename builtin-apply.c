@@ -16,6 +16,11 @@
 #include "dir.h"
 #include "parse-options.h"
 
+#ifdef THREADED_DELTA_SEARCH
+#include "thread-utils.h"
+#include <pthread.h>
+#endif
+
 /*
  *  --check turns on checking that the working tree matches the
  *    files that are being modified, but doesn't apply the patch
@@ -47,6 +52,7 @@ static int no_add;
 static const char *fake_ancestor;
 static int line_termination = '\n';
 static unsigned int p_context = UINT_MAX;
+static int apply_threads = 1;
 static const char * const apply_usage[] = {
 	"git apply [options] [<patch>...]",
 	NULL
@@ -166,6 +172,8 @@ struct patch {
 	struct fragment *fragments;
 	char *result;
 	size_t resultsize;
+	struct strbuf *messages;	/* held back while on a worker thread */
+	int applied_after_fixing_ws;
 	char old_sha1_prefix[41];
 	char new_sha1_prefix[41];
 	struct patch *next;
@@ -193,6 +201,40 @@ struct image {
 	size_t alloc;
 	struct line *line_allocated;
 	struct line *line;
+	struct line_index *index;
+};
+
+/*
+ * Where the lines of an image are, by their hash, so that a hunk
+ * that does not apply where the patch says can be looked for only
+ * at the lines that could start it.  It is built when first needed.
+ * Rather than building it again after each hunk is applied, the
+ * changes are logged, and the line numbers it gives are carried
+ * through them; the lines the changes brought in are looked at
+ * one by one.
+ */
+struct line_edit {
+	int lno, old_nr, new_nr;
+	size_t old_len, new_len;
+};
+
+struct line_run {
+	int lno, nr;
+	size_t offset;
+};
+
+#define LINE_INDEX_MAX_EDITS 32
+
+struct line_index {
+	unsigned int mask;
+	int *head;		/* first line in each bucket, or -1 */
+	int *count;		/* number of lines in each bucket */
+	int *next;		/* next line in the same bucket, or -1 */
+	size_t *offset;		/* where each line started in the buffer */
+	struct line_edit *edit;	/* changes made since, in order */
+	int edit_nr, edit_alloc;
+	struct line_run *fresh;	/* lines those changes brought in */
+	int fresh_nr, fresh_alloc;
 };
 
 /*
@@ -1744,6 +1786,251 @@ static int match_fragment(struct image *img,
 	return 0;
 }
 
+static void build_line_index(struct image *img)
+{
+	struct line_index *index = xcalloc(1, sizeof(*index));
+	unsigned int size = 64;
+	size_t offset = 0;
+	int i;
+
+	while (size < img->nr)
+		size <<= 1;
+	index->mask = size - 1;
+	index->head = xmalloc(size * sizeof(*index->head));
+	index->count = xcalloc(size, sizeof(*index->count));
+	index->next = xmalloc((img->nr + 1) * sizeof(*index->next));
+	index->offset = xmalloc((img->nr + 1) * sizeof(*index->offset));
+	memset(index->head, -1, size * sizeof(*index->head));
+
+	for (i = 0; i < img->nr; i++) {
+		index->offset[i] = offset;
+		offset += img->line[i].len;
+	}
+	index->offset[i] = offset;
+
+	/* Going backwards leaves each bucket in line order */
+	for (i = img->nr - 1; 0 <= i; i--) {
+		unsigned int b = img->line[i].hash & index->mask;
+		index->next[i] = index->head[b];
+		index->head[b] = i;
+		index->count[b]++;
+	}
+	img->index = index;
+}
+
+static void clear_line_index(struct image *img)
+{
+	struct line_index *index = img->index;
+
+	if (!index)
+		return;
+	free(index->head);
+	free(index->count);
+	free(index->next);
+	free(index->offset);
+	free(index->edit);
+	free(index->fresh);
+	free(index);
+	img->index = NULL;
+}
+
+/*
+ * The "old_nr" lines at "lno", "old_len" bytes from "offset", are
+ * being replaced by "new_nr" lines of "new_len" bytes.
+ */
+static void log_line_edit(struct image *img, int lno, int old_nr, int new_nr,
+			  size_t offset, size_t old_len, size_t new_len)
+{
+	struct line_index *index = img->index;
+	struct line_run run;
+	int i, j, end = lno + old_nr;
+
+	if (index->edit_nr == LINE_INDEX_MAX_EDITS) {
+		clear_line_index(img);
+		return;
+	}
+	ALLOC_GROW(index->edit, index->edit_nr + 1, index->edit_alloc);
+	index->edit[index->edit_nr].lno = lno;
+	index->edit[index->edit_nr].old_nr = old_nr;
+	index->edit[index->edit_nr].new_nr = new_nr;
+	index->edit[index->edit_nr].old_len = old_len;
+	index->edit[index->edit_nr].new_len = new_len;
+	index->edit_nr++;
+
+	/*
+	 * Runs of fresh lines after the change move with it; those it
+	 * cuts into are joined with the lines it brings in.
+	 */
+	run.lno = lno;
+	run.nr = new_nr;
+	run.offset = offset;
+	for (i = j = 0; i < index->fresh_nr; i++) {
+		struct line_run *r = &index->fresh[i];
+
+		if (r->lno + r->nr <= lno) {
+			index->fresh[j++] = *r;
+			continue;
+		}
+		if (end <= r->lno) {
+			r->lno += new_nr - old_nr;
+			r->offset = r->offset + new_len - old_len;
+			index->fresh[j++] = *r;
+			continue;
+		}
+		if (r->lno < run.lno) {
+			run.nr += run.lno - r->lno;
+			run.lno = r->lno;
+			run.offset = r->offset;
+		}
+		if (end < r->lno + r->nr)
+			run.nr = r->lno + r->nr + new_nr - old_nr - run.lno;
+	}
+	index->fresh_nr = j;
+	if (run.nr) {
+		ALLOC_GROW(index->fresh, index->fresh_nr + 1, index->fresh_alloc);
+		index->fresh[index->fresh_nr++] = run;
+	}
+}
+
+/*
+ * Carry line "lno" of the image the index was built from through the
+ * changes made since; return where it is now, or -1 if it is gone.
+ */
+static int current_line(struct line_index *index, int lno, size_t *offset)
+{
+	size_t at = index->offset[lno];
+	int i;
+
+	for (i = 0; i < index->edit_nr; i++) {
+		struct line_edit *e = &index->edit[i];
+		if (lno < e->lno)
+			continue;
+		if (lno < e->lno + e->old_nr)
+			return -1;
+		lno += e->new_nr - e->old_nr;
+		at = at + e->new_len - e->old_len;
+	}
+	*offset = at;
+	return lno;
+}
+
+struct pos_candidate {
+	unsigned long order;
+	int lno;
+	size_t offset;
+};
+
+struct pos_search {
+	struct image *img;
+	int preimage_nr;
+	int rarest;		/* the preimage line looked up */
+	int line;		/* where the patch says the hunk goes */
+	struct pos_candidate *cand;
+	int nr, alloc;
+};
+
+/*
+ * Where find_pos() would get to "try_lno" in its walk away from
+ * "line": forwards one line, then backwards one line, and so on.
+ */
+static unsigned long search_order(int try_lno, int line)
+{
+	if (try_lno > line)
+		return 2 * (unsigned long)(try_lno - line) - 1;
+	return 2 * (unsigned long)(line - try_lno);
+}
+
+/*
+ * Note where a match would start if the rarest preimage line is at
+ * "lno", "offset" bytes into the buffer.
+ */
+static void add_pos_candidate(struct pos_search *s, int lno, size_t offset)
+{
+	struct image *img = s->img;
+	int try_lno = lno - s->rarest;
+
+	if (try_lno < 0 || img->nr < try_lno + s->preimage_nr ||
+	    try_lno == s->line)
+		return;
+	while (lno > try_lno)
+		offset -= img->line[--lno].len;
+	ALLOC_GROW(s->cand, s->nr + 1, s->alloc);
+	s->cand[s->nr].order = search_order(try_lno, s->line);
+	s->cand[s->nr].lno = try_lno;
+	s->cand[s->nr].offset = offset;
+	s->nr++;
+}
+
+static int pos_candidate_cmp(const void *a_, const void *b_)
+{
+	const struct pos_candidate *a = a_, *b = b_;
+	return a->order < b->order ? -1 : a->order > b->order;
+}
+
+/*
+ * Look for the preimage away from "line" among the places the line
+ * index allows, and take the one the plain walk of find_pos() would
+ * have found first.  Every line of a match must hash the same as the
+ * preimage line it matches, even when fixing whitespace, so picking
+ * the preimage line whose hash is the rarest in the image leaves only
+ * a few places to try.
+ */
+static int find_pos_indexed(struct image *img,
+			    struct image *preimage,
+			    struct image *postimage,
+			    int line,
+			    unsigned ws_rule)
+{
+	struct line_index *index;
+	struct pos_search search;
+	int i, rarest = 0, found = -1;
+	unsigned int hash;
+
+	if (!img->index)
+		build_line_index(img);
+	index = img->index;
+
+	for (i = 1; i < preimage->nr; i++)
+		if (index->count[preimage->line[i].hash & index->mask] <
+		    index->count[preimage->line[rarest].hash & index->mask])
+			rarest = i;
+	hash = preimage->line[rarest].hash;
+
+	memset(&search, 0, sizeof(search));
+	search.img = img;
+	search.preimage_nr = preimage->nr;
+	search.rarest = rarest;
+	search.line = line;
+	for (i = index->head[hash & index->mask]; 0 <= i; i = index->next[i]) {
+		size_t offset;
+		int lno = current_line(index, i, &offset);
+		if (lno < 0 || img->line[lno].hash != hash)
+			continue;
+		add_pos_candidate(&search, lno, offset);
+	}
+	for (i = 0; i < index->fresh_nr; i++) {
+		struct line_run *r = &index->fresh[i];
+		size_t offset = r->offset;
+		int lno;
+		for (lno = r->lno; lno < r->lno + r->nr; lno++) {
+			if (img->line[lno].hash == hash)
+				add_pos_candidate(&search, lno, offset);
+			offset += img->line[lno].len;
+		}
+	}
+
+	qsort(search.cand, search.nr, sizeof(*search.cand), pos_candidate_cmp);
+	for (i = 0; i < search.nr; i++)
+		if (match_fragment(img, preimage, postimage,
+				   search.cand[i].offset, search.cand[i].lno,
+				   ws_rule, 0, 0)) {
+			found = search.cand[i].lno;
+			break;
+		}
+	free(search.cand);
+	return found;
+}
+
 static int find_pos(struct image *img,
 		    struct image *preimage,
 		    struct image *postimage,
@@ -1752,8 +2039,7 @@ static int find_pos(struct image *img,
 		    int match_beginning, int match_end)
 {
 	int i;
-	unsigned long backwards, forwards, try;
-	int backwards_lno, forwards_lno, try_lno;
+	unsigned long try;
 
 	if (preimage->nr > img->nr)
 		return -1;
@@ -1775,48 +2061,19 @@ static int find_pos(struct image *img,
 	for (i = 0; i < line; i++)
 		try += img->line[i].len;
 
+	if (match_fragment(img, preimage, postimage,
+			   try, line, ws_rule,
+			   match_beginning, match_end))
+		return line;
+
 	/*
-	 * There's probably some smart way to do this, but I'll leave
-	 * that to the smart and beautiful people. I'm simple and stupid.
+	 * Anchored hunks can only match where we just looked, and an
+	 * empty preimage matches anywhere, so it already has.
 	 */
-	backwards = try;
-	backwards_lno = line;
-	forwards = try;
-	forwards_lno = line;
-	try_lno = line;
-
-	for (i = 0; ; i++) {
-		if (match_fragment(img, preimage, postimage,
-				   try, try_lno, ws_rule,
-				   match_beginning, match_end))
-			return try_lno;
-
-	again:
-		if (backwards_lno == 0 && forwards_lno == img->nr)
-			break;
-
-		if (i & 1) {
-			if (backwards_lno == 0) {
-				i++;
-				goto again;
-			}
-			backwards_lno--;
-			backwards -= img->line[backwards_lno].len;
-			try = backwards;
-			try_lno = backwards_lno;
-		} else {
-			if (forwards_lno == img->nr) {
-				i++;
-				goto again;
-			}
-			forwards += img->line[forwards_lno].len;
-			forwards_lno++;
-			try = forwards;
-			try_lno = forwards_lno;
-		}
+	if (match_beginning || match_end || !preimage->nr)
+		return -1;
 
-	}
-	return -1;
+	return find_pos_indexed(img, preimage, postimage, line, ws_rule);
 }
 
 static void remove_first_line(struct image *img)
@@ -1853,6 +2110,10 @@ static void update_image(struct image *img,
 		remove_count += img->line[applied_pos + i].len;
 	insert_count = postimage->len;
 
+	if (img->index)
+		log_line_edit(img, applied_pos, preimage->nr, postimage->nr,
+			      applied_at, remove_count, insert_count);
+
 	/* Adjust the contents */
 	result = xmalloc(img->len + insert_count - remove_count + 1);
 	memcpy(result, img->buf, applied_at);
@@ -1886,9 +2147,30 @@ static void update_image(struct image *img,
 	img->nr = nr;
 }
 
+/*
+ * Complain about a patch that is being applied.  On a worker thread
+ * the message is held back, to be shown in the order of the patches.
+ */
+static int report(struct patch *p, const char *prefix, const char *fmt, ...)
+{
+	char msg[1024];
+	va_list params;
+
+	va_start(params, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, params);
+	va_end(params);
+	if (p->messages)
+		strbuf_addf(p->messages, "%s%s\n", prefix, msg);
+	else
+		fprintf(stderr, "%s%s\n", prefix, msg);
+	return -1;
+}
+
 static int apply_one_fragment(struct image *img, struct fragment *frag,
-			      int inaccurate_eof, unsigned ws_rule)
+			      struct patch *p)
 {
+	int inaccurate_eof = p->inaccurate_eof;
+	unsigned ws_rule = p->ws_rule;
 	int match_beginning, match_end;
 	const char *patch = frag->patch;
 	int size = frag->size;
@@ -1965,7 +2247,7 @@ static int apply_one_fragment(struct image *img, struct fragment *frag,
 				added = plen;
 			}
 			else {
-				added = ws_fix_copy(new, patch + 1, plen, ws_rule, &applied_after_fixing_ws);
+				added = ws_fix_copy(new, patch + 1, plen, ws_rule, &p->applied_after_fixing_ws);
 			}
 			add_line_info(&postimage, new, added,
 				      (first == '+' ? 0 : LINE_COMMON));
@@ -1979,7 +2261,8 @@ static int apply_one_fragment(struct image *img, struct fragment *frag,
 			break;
 		default:
 			if (apply_verbosely)
-				error("invalid start of line: '%c'", first);
+				report(p, "error: ",
+				       "invalid start of line: '%c'", first);
 			return -1;
 		}
 		if (added_blank_line)
@@ -2084,14 +2367,14 @@ static int apply_one_fragment(struct image *img, struct fragment *frag,
 		 */
 		if ((leading != frag->leading) ||
 		    (trailing != frag->trailing))
-			fprintf(stderr, "Context reduced to (%ld/%ld)"
-				" to apply fragment at %d\n",
-				leading, trailing, applied_pos+1);
+			report(p, "", "Context reduced to (%ld/%ld)"
+			       " to apply fragment at %d",
+			       leading, trailing, applied_pos+1);
 		update_image(img, applied_pos, &preimage, &postimage);
 	} else {
 		if (apply_verbosely)
-			error("while searching for:\n%.*s",
-			      (int)(old - oldlines), oldlines);
+			report(p, "error: ", "while searching for:\n%.*s",
+			       (int)(old - oldlines), oldlines);
 	}
 
 	free(oldlines);
@@ -2217,22 +2500,25 @@ static int apply_fragments(struct image *img, struct patch *patch)
 {
 	struct fragment *frag = patch->fragments;
 	const char *name = patch->old_name ? patch->old_name : patch->new_name;
-	unsigned ws_rule = patch->ws_rule;
-	unsigned inaccurate_eof = patch->inaccurate_eof;
+	int status = 0;
 
 	if (patch->is_binary)
 		return apply_binary(img, patch);
 
 	while (frag) {
-		if (apply_one_fragment(img, frag, inaccurate_eof, ws_rule)) {
-			error("patch failed: %s:%ld", name, frag->oldpos);
-			if (!apply_with_reject)
-				return -1;
+		if (apply_one_fragment(img, frag, patch)) {
+			report(patch, "error: ", "patch failed: %s:%ld",
+			       name, frag->oldpos);
+			if (!apply_with_reject) {
+				status = -1;
+				break;
+			}
 			frag->rejected = 1;
 		}
 		frag = frag->next;
 	}
-	return 0;
+	clear_line_index(img);
+	return status;
 }
 
 static int read_file_or_gitlink(struct cache_entry *ce, struct strbuf *buf)
@@ -2329,10 +2615,10 @@ static void prepare_fn_table(struct patch *patch)
 	}
 }
 
-static int apply_data(struct patch *patch, struct stat *st, struct cache_entry *ce)
+static int read_preimage(struct patch *patch, struct stat *st,
+			 struct cache_entry *ce, struct image *image)
 {
 	struct strbuf buf = STRBUF_INIT;
-	struct image image;
 	size_t len;
 	char *img;
 	struct patch *tpatch;
@@ -2366,14 +2652,20 @@ static int apply_data(struct patch *patch, struct stat *st, struct cache_entry *
 	}
 
 	img = strbuf_detach(&buf, &len);
-	prepare_image(&image, img, len, !patch->is_binary);
+	prepare_image(image, img, len, !patch->is_binary);
+	return 0;
+}
 
-	if (apply_fragments(&image, patch) < 0)
+/* Take the result of apply_fragments() on the preimage. */
+static int apply_data(struct patch *patch, struct image *image, int status)
+{
+	applied_after_fixing_ws += patch->applied_after_fixing_ws;
+	if (status < 0)
 		return -1; /* note with --reject this succeeds. */
-	patch->result = image.buf;
-	patch->resultsize = image.len;
+	patch->result = image->buf;
+	patch->resultsize = image->len;
 	add_to_fn_table(patch);
-	free(image.line_allocated);
+	free(image->line_allocated);
 
 	if (0 < patch->is_delete && patch->resultsize)
 		return error("removal patch leaves file contents");
@@ -2500,7 +2792,11 @@ static int check_preimage(struct patch *patch, struct cache_entry **ce, struct s
 	return 0;
 }
 
-static int check_patch(struct patch *patch)
+/*
+ * See if the patch can be applied, and read the preimage it is to be
+ * applied to into "image".
+ */
+static int check_patch(struct patch *patch, struct image *image)
 {
 	struct stat st;
 	const char *old_name = patch->old_name;
@@ -2511,8 +2807,6 @@ static int check_patch(struct patch *patch)
 	int ok_if_exists;
 	int status;
 
-	patch->rejected = 1; /* we will drop this after we succeed */
-
 	status = check_preimage(patch, &ce, &st);
 	if (status)
 		return status;
@@ -2561,24 +2855,165 @@ static int check_patch(struct patch *patch)
 				same ? "" : " of ", same ? "" : old_name);
 	}
 
-	if (apply_data(patch, &st, ce) < 0)
+	if (read_preimage(patch, &st, ce, image) < 0)
+		return error("%s: patch does not apply", name);
+	return 0;
+}
+
+static int finish_patch(struct patch *patch, struct image *image, int status)
+{
+	const char *name = patch->old_name ? patch->old_name : patch->new_name;
+
+	if (apply_data(patch, image, status) < 0)
 		return error("%s: patch does not apply", name);
 	patch->rejected = 0;
 	return 0;
 }
 
+/*
+ * Patches to text files are checked and their preimages read one by
+ * one, but the fragments can be applied on several threads at once,
+ * as long as no two patches in flight touch the same path.
+ */
+struct apply_job {
+	struct patch *patch;
+	struct image image;
+	struct strbuf messages;
+	int status;
+};
+
+#define APPLY_JOBS_MAX 256
+
+static struct apply_job *apply_jobs;
+static int apply_jobs_nr, apply_jobs_alloc;
+static struct string_list apply_jobs_paths;
+
+#ifdef THREADED_DELTA_SEARCH
+
+static pthread_mutex_t apply_jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int apply_jobs_next;
+
+static void *run_apply_jobs_thread(void *unused)
+{
+	for (;;) {
+		struct apply_job *job = NULL;
+
+		pthread_mutex_lock(&apply_jobs_mutex);
+		if (apply_jobs_next < apply_jobs_nr)
+			job = &apply_jobs[apply_jobs_next++];
+		pthread_mutex_unlock(&apply_jobs_mutex);
+		if (!job)
+			return NULL;
+		job->status = apply_fragments(&job->image, job->patch);
+	}
+}
+
+static void start_apply_jobs(void)
+{
+	pthread_t *threads;
+	int i, nr = apply_threads;
+
+	if (nr > apply_jobs_nr)
+		nr = apply_jobs_nr;
+	apply_jobs_next = 0;
+	threads = xcalloc(nr, sizeof(*threads));
+	for (i = 0; i < nr; i++) {
+		int ret = pthread_create(&threads[i], NULL,
+					 run_apply_jobs_thread, NULL);
+		if (ret)
+			die("unable to create thread: %s", strerror(ret));
+	}
+	for (i = 0; i < nr; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+}
+
+#else
+
+static void start_apply_jobs(void)
+{
+	int i;
+
+	for (i = 0; i < apply_jobs_nr; i++)
+		apply_jobs[i].status = apply_fragments(&apply_jobs[i].image,
+						       apply_jobs[i].patch);
+}
+
+#endif
+
+static int run_apply_jobs(void)
+{
+	int i, err = 0;
+
+	for (i = 0; i < apply_jobs_nr; i++)
+		apply_jobs[i].patch->messages = &apply_jobs[i].messages;
+	start_apply_jobs();
+
+	for (i = 0; i < apply_jobs_nr; i++) {
+		struct apply_job *job = &apply_jobs[i];
+
+		job->patch->messages = NULL;
+		fputs(job->messages.buf, stderr);
+		strbuf_release(&job->messages);
+		err |= finish_patch(job->patch, &job->image, job->status);
+	}
+	apply_jobs_nr = 0;
+	string_list_clear(&apply_jobs_paths, 0);
+	return err;
+}
+
+static int touches_apply_jobs(struct patch *patch)
+{
+	return (patch->old_name &&
+		string_list_has_string(&apply_jobs_paths, patch->old_name)) ||
+	       (patch->new_name &&
+		string_list_has_string(&apply_jobs_paths, patch->new_name));
+}
+
+static void add_apply_job(struct patch *patch, struct image *image)
+{
+	struct apply_job *job;
+
+	ALLOC_GROW(apply_jobs, apply_jobs_nr + 1, apply_jobs_alloc);
+	job = &apply_jobs[apply_jobs_nr++];
+	job->patch = patch;
+	job->image = *image;
+	strbuf_init(&job->messages, 0);
+	if (patch->old_name)
+		string_list_insert(patch->old_name, &apply_jobs_paths);
+	if (patch->new_name)
+		string_list_insert(patch->new_name, &apply_jobs_paths);
+}
+
 static int check_patch_list(struct patch *patch)
 {
 	int err = 0;
 
 	prepare_fn_table(patch);
 	while (patch) {
+		struct image image;
+		int status;
+
 		if (apply_verbosely)
 			say_patch_name(stderr,
 				       "Checking patch ", patch, "...\n");
-		err |= check_patch(patch);
+		if (apply_jobs_nr &&
+		    (apply_jobs_nr == APPLY_JOBS_MAX || touches_apply_jobs(patch)))
+			err |= run_apply_jobs();
+
+		patch->rejected = 1; /* we will drop this after we succeed */
+		status = check_patch(patch, &image);
+		if (status)
+			err |= status;
+		else if (apply_threads > 1 && !patch->is_binary)
+			add_apply_job(patch, &image);
+		else
+			err |= finish_patch(patch, &image,
+					    apply_fragments(&image, patch));
 		patch = patch->next;
 	}
+	if (apply_jobs_nr)
+		err |= run_apply_jobs();
 	return err;
 }
 
@@ -3178,6 +3613,10 @@ static int git_apply_config(const char *var, const char *value, void *cb)
 {
 	if (!strcmp(var, "apply.whitespace"))
 		return git_config_string(&apply_default_whitespace, var, value);
+	if (!strcmp(var, "apply.threads")) {
+		apply_threads = git_config_int(var, value);
+		return 0;
+	}
 	return git_default_config(var, value, cb);
 }
 
@@ -3301,6 +3740,8 @@ int cmd_apply(int argc, const char **argv, const char *unused_prefix)
 		OPT_BIT(0, "recount", &options,
 			"do not trust the line counts in the hunk headers",
 			RECOUNT),
+		OPT_INTEGER(0, "threads", &apply_threads,
+			"apply the patches to <n> files at once"),
 		{ OPTION_CALLBACK, 0, "directory", NULL, "root",
 			"prepend <root> to all filenames",
 			0, option_parse_directory },
@@ -3315,6 +3756,16 @@ int cmd_apply(int argc, const char **argv, const char *unused_prefix)
 
 	argc = parse_options(argc, argv, builtin_apply_options,
 			apply_usage, 0);
+	if (apply_threads < 0)
+		die("invalid number of threads specified (%d)", apply_threads);
+#ifdef THREADED_DELTA_SEARCH
+	if (!apply_threads)
+		apply_threads = online_cpus();
+#else
+	if (apply_threads != 1)
+		warning("no threads support, ignoring --threads");
+	apply_threads = 1;
+#endif
 	if (apply_with_reject)
 		apply = apply_verbosely = 1;
 	if (!force_apply && (diffstat || numstat || summary || check || fake_ancestor))
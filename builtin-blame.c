@@ -1989,6 +1989,7 @@ static struct commit *fake_working_tree_commit(const char *path, const char *con
 	commit->object.parsed = 1;
 	commit->date = now;
 	commit->object.type = OBJ_COMMIT;
+	commit->index = alloc_commit_index();
 
 	origin = make_origin(commit, path);
 
@@ -6,9 +6,11 @@
 #include "cache.h"
 #include "exec_cmd.h"
 #include "tag.h"
+#include "blob.h"
 #include "tree.h"
 #include "builtin.h"
 #include "parse-options.h"
+#include "streaming.h"
 
 #define BATCH 1
 #define BATCH_CHECK 2
@@ -80,6 +82,23 @@ static void pprint_tag(const unsigned char *sha1, const char *buf, unsigned long
 		write_or_die(1, cp, endp - cp);
 }
 
+/*
+ * Write out a blob that is too large to be held in core as a whole.
+ * Returns 1 without writing anything if "sha1" does not name such a
+ * blob.
+ */
+static int stream_large_blob(const unsigned char *sha1)
+{
+	unsigned long size;
+
+	if (sha1_object_info(sha1, &size) != OBJ_BLOB ||
+	    size <= big_file_threshold)
+		return 1;
+	if (stream_blob_to_fd(1, sha1))
+		die("unable to stream %s to stdout", sha1_to_hex(sha1));
+	return 0;
+}
+
 static int cat_one_file(int opt, const char *exp_type, const char *obj_name)
 {
 	unsigned char sha1[20];
@@ -121,6 +140,8 @@ static int cat_one_file(int opt, const char *exp_type, const char *obj_name)
 			const char *ls_args[3] = {"ls-tree", obj_name, NULL};
 			return cmd_ls_tree(2, ls_args, NULL);
 		}
+		if (type == OBJ_BLOB && !stream_large_blob(sha1))
+			return 0;
 
 		buf = read_sha1_file(sha1, &type, &size);
 		if (!buf)
@@ -133,6 +154,8 @@ static int cat_one_file(int opt, const char *exp_type, const char *obj_name)
 		/* otherwise just spit out the data */
 		break;
 	case 0:
+		if (!strcmp(exp_type, blob_type) && !stream_large_blob(sha1))
+			return 0;
 		buf = read_object_with_reference(sha1, exp_type, &size, NULL);
 		break;
 
@@ -163,10 +186,14 @@ static int batch_one_object(const char *obj_name, int print_contents)
 		return 0;
 	}
 
-	if (print_contents == BATCH)
+	type = sha1_object_info(sha1, &size);
+	if (print_contents == BATCH && type > 0 &&
+	    (type != OBJ_BLOB || size <= big_file_threshold)) {
 		contents = read_sha1_file(sha1, &type, &size);
-	else
-		type = sha1_object_info(sha1, &size);
+		if (!contents)
+			type = OBJ_BAD;
+	} else
+		contents = NULL;
 
 	if (type <= 0) {
 		printf("%s missing\n", obj_name);
@@ -178,7 +205,10 @@ static int batch_one_object(const char *obj_name, int print_contents)
 	fflush(stdout);
 
 	if (print_contents == BATCH) {
-		write_or_die(1, contents, size);
+		if (contents)
+			write_or_die(1, contents, size);
+		else
+			stream_large_blob(sha1);
 		printf("\n");
 		fflush(stdout);
 		free(contents);
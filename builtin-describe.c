@@ -1,5 +1,6 @@
 #include "cache.h"
 #include "commit.h"
+#include "commit-slab.h"
 #include "tag.h"
 #include "refs.h"
 #include "builtin.h"
@@ -29,16 +30,26 @@ struct commit_name {
 	unsigned char sha1[20];
 	char path[FLEX_ARRAY]; /* more */
 };
+define_commit_slab(commit_names, struct commit_name *);
+static struct commit_names commit_names;
+
 static const char *prio_names[] = {
 	"head", "lightweight", "annotated",
 };
 
+static struct commit_name *find_commit_name(const struct commit *commit)
+{
+	struct commit_name **slot = commit_names_peek(&commit_names, commit);
+	return slot ? *slot : NULL;
+}
+
 static void add_to_known_names(const char *path,
 			       struct commit *commit,
 			       int prio,
 			       const unsigned char *sha1)
 {
-	struct commit_name *e = commit->util;
+	struct commit_name **slot = commit_names_at(&commit_names, commit);
+	struct commit_name *e = *slot;
 	if (!e || e->prio < prio) {
 		size_t len = strlen(path)+1;
 		free(e);
@@ -47,7 +58,7 @@ static void add_to_known_names(const char *path,
 		e->prio = prio;
 		hashcpy(e->sha1, sha1);
 		memcpy(e->path, path, len);
-		commit->util = e;
+		*slot = e;
 	}
 }
 
@@ -120,23 +131,22 @@ static int compare_pt(const void *a_, const void *b_)
 }
 
 static unsigned long finish_depth_computation(
-	struct commit_list **list,
+	struct prio_queue *queue,
 	struct possible_tag *best)
 {
 	unsigned long seen_commits = 0;
-	while (*list) {
-		struct commit *c = pop_commit(list);
+	while (queue->nr) {
+		struct commit *c = prio_queue_get(queue);
 		struct commit_list *parents = c->parents;
 		seen_commits++;
 		if (c->object.flags & best->flag_within) {
-			struct commit_list *a = *list;
-			while (a) {
-				struct commit *i = a->item;
-				if (!(i->object.flags & best->flag_within))
+			int i;
+			for (i = 0; i < queue->nr; i++) {
+				struct commit *a = queue->array[i].data;
+				if (!(a->object.flags & best->flag_within))
 					break;
-				a = a->next;
 			}
-			if (!a)
+			if (i == queue->nr)
 				break;
 		} else
 			best->depth++;
@@ -144,7 +154,7 @@ static unsigned long finish_depth_computation(
 			struct commit *p = parents->item;
 			parse_commit(p);
 			if (!(p->object.flags & SEEN))
-				insert_by_date(p, list);
+				prio_queue_put(queue, p);
 			p->object.flags |= c->object.flags;
 			parents = parents->next;
 		}
@@ -177,7 +187,7 @@ static void describe(const char *arg, int last_one)
 {
 	unsigned char sha1[20];
 	struct commit *cmit, *gave_up_on = NULL;
-	struct commit_list *list;
+	struct prio_queue queue = { compare_commits_by_commit_date };
 	static int initialized = 0;
 	struct commit_name *n;
 	struct possible_tag all_matches[MAX_TAGS];
@@ -195,7 +205,7 @@ static void describe(const char *arg, int last_one)
 		for_each_ref(get_name, NULL);
 	}
 
-	n = cmit->util;
+	n = find_commit_name(cmit);
 	if (n) {
 		/*
 		 * Exact match to an existing ref.
@@ -212,14 +222,13 @@ static void describe(const char *arg, int last_one)
 	if (debug)
 		fprintf(stderr, "searching to describe %s\n", arg);
 
-	list = NULL;
 	cmit->object.flags = SEEN;
-	commit_list_insert(cmit, &list);
-	while (list) {
-		struct commit *c = pop_commit(&list);
+	prio_queue_put(&queue, cmit);
+	while (queue.nr) {
+		struct commit *c = prio_queue_get(&queue);
 		struct commit_list *parents = c->parents;
 		seen_commits++;
-		n = c->util;
+		n = find_commit_name(c);
 		if (n) {
 			if (match_cnt < max_candidates) {
 				struct possible_tag *t = &all_matches[match_cnt++];
@@ -241,7 +250,7 @@ static void describe(const char *arg, int last_one)
 			if (!(c->object.flags & t->flag_within))
 				t->depth++;
 		}
-		if (annotated_cnt && !list) {
+		if (annotated_cnt && !queue.nr) {
 			if (debug)
 				fprintf(stderr, "finished search at %s\n",
 					sha1_to_hex(c->object.sha1));
@@ -251,7 +260,7 @@ static void describe(const char *arg, int last_one)
 			struct commit *p = parents->item;
 			parse_commit(p);
 			if (!(p->object.flags & SEEN))
-				insert_by_date(p, &list);
+				prio_queue_put(&queue, p);
 			p->object.flags |= c->object.flags;
 			parents = parents->next;
 		}
@@ -259,6 +268,7 @@ static void describe(const char *arg, int last_one)
 
 	if (!match_cnt) {
 		const unsigned char *sha1 = cmit->object.sha1;
+		clear_prio_queue(&queue);
 		if (always) {
 			printf("%s\n", find_unique_abbrev(sha1, abbrev));
 			return;
@@ -269,11 +279,11 @@ static void describe(const char *arg, int last_one)
 	qsort(all_matches, match_cnt, sizeof(all_matches[0]), compare_pt);
 
 	if (gave_up_on) {
-		insert_by_date(gave_up_on, &list);
+		prio_queue_put(&queue, gave_up_on);
 		seen_commits--;
 	}
-	seen_commits += finish_depth_computation(&list, &all_matches[0]);
-	free_commit_list(list);
+	seen_commits += finish_depth_computation(&queue, &all_matches[0]);
+	clear_prio_queue(&queue);
 
 	if (debug) {
 		for (cur_match = 0; cur_match < match_cnt; cur_match++) {
@@ -249,6 +249,7 @@ static void shortlog(const char *name, unsigned char *sha1,
 	clear_commit_marks(head, flags);
 	free_commit_list(rev->commits);
 	rev->commits = NULL;
+	clear_prio_queue(&rev->queue);
 	rev->pending.nr = 0;
 
 	free_list(&subjects);
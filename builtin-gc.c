@@ -26,12 +26,13 @@ static int pack_refs = 1;
 static int aggressive_window = 250;
 static int gc_auto_threshold = 6700;
 static int gc_auto_pack_limit = 50;
+static int gc_geometric_factor;
 static const char *prune_expire = "2.weeks.ago";
 
-#define MAX_ADD 10
 static const char *argv_pack_refs[] = {"pack-refs", "--all", "--prune", NULL};
 static const char *argv_reflog[] = {"reflog", "expire", "--all", NULL};
-static const char *argv_repack[MAX_ADD] = {"repack", "-d", "-l", NULL};
+static const char **argv_repack;
+static int argv_repack_nr, argv_repack_alloc;
 static const char *argv_prune[] = {"prune", "--expire", NULL, NULL};
 static const char *argv_rerere[] = {"rerere", "gc", NULL};
 
@@ -56,6 +57,10 @@ static int gc_config(const char *var, const char *value, void *cb)
 		gc_auto_pack_limit = git_config_int(var, value);
 		return 0;
 	}
+	if (!strcmp(var, "gc.geometricfactor")) {
+		gc_geometric_factor = git_config_int(var, value);
+		return 0;
+	}
 	if (!strcmp(var, "gc.pruneexpire")) {
 		if (value && strcmp(value, "now")) {
 			unsigned long now = approxidate("now");
@@ -67,17 +72,11 @@ static int gc_config(const char *var, const char *value, void *cb)
 	return git_default_config(var, value, cb);
 }
 
-static void append_option(const char **cmd, const char *opt, int max_length)
+static void append_repack_option(const char *opt)
 {
-	int i;
-
-	for (i = 0; cmd[i]; i++)
-		;
-
-	if (i + 2 >= max_length)
-		die("Too many options specified");
-	cmd[i++] = opt;
-	cmd[i] = NULL;
+	ALLOC_GROW(argv_repack, argv_repack_nr + 2, argv_repack_alloc);
+	argv_repack[argv_repack_nr++] = opt;
+	argv_repack[argv_repack_nr] = NULL;
 }
 
 static int too_many_loose_objects(void)
@@ -144,6 +143,70 @@ static int too_many_packs(void)
 	return gc_auto_pack_limit <= cnt;
 }
 
+static int pack_size_cmp(const void *a_, const void *b_)
+{
+	struct packed_git *a = *(struct packed_git **)a_;
+	struct packed_git *b = *(struct packed_git **)b_;
+
+	if (a->pack_size < b->pack_size)
+		return -1;
+	if (a->pack_size > b->pack_size)
+		return 1;
+	return 0;
+}
+
+/*
+ * Keep the packs that, ordered by size, already form a geometric
+ * progression with gc.geometricFactor as the ratio, and roll all the
+ * smaller ones (and loose objects) up into a new pack.  If the new
+ * pack would not be small enough to fit under the packs that are
+ * kept, roll those up as well until it does.  The cost of such a
+ * repack is proportional to the amount of new data rather than to
+ * the size of the repository.
+ *
+ * Returns the number of packs that will be rolled up.
+ */
+static int add_geometric_repack_options(void)
+{
+	struct packed_git *p, **pack = NULL;
+	int nr = 0, alloc = 0, split, i;
+	off_t rolled_up = 0;
+
+	prepare_packed_git();
+	for (p = packed_git; p; p = p->next) {
+		if (!p->pack_local || p->pack_keep)
+			continue;
+		ALLOC_GROW(pack, nr + 1, alloc);
+		pack[nr++] = p;
+	}
+	qsort(pack, nr, sizeof(*pack), pack_size_cmp);
+
+	for (split = nr - 1; split > 0; split--)
+		if (pack[split]->pack_size <
+		    gc_geometric_factor * pack[split - 1]->pack_size)
+			break;
+	if (split)
+		split++;
+
+	for (i = 0; i < split; i++)
+		rolled_up += pack[i]->pack_size;
+	while (split < nr &&
+	       pack[split]->pack_size < gc_geometric_factor * rolled_up)
+		rolled_up += pack[split++]->pack_size;
+
+	append_repack_option("--incremental-deltas");
+	for (i = split; i < nr; i++) {
+		const char *name = strrchr(pack[i]->pack_name, '/');
+		struct strbuf opt = STRBUF_INIT;
+
+		name = name ? name + 1 : pack[i]->pack_name;
+		strbuf_addf(&opt, "--keep-pack=%s", name);
+		append_repack_option(strbuf_detach(&opt, NULL));
+	}
+	free(pack);
+	return split;
+}
+
 static int need_to_gc(void)
 {
 	/*
@@ -158,12 +221,23 @@ static int need_to_gc(void)
 	 * packs, we run "repack -d -l".  If there are too many packs,
 	 * we run "repack -A -d -l".  Otherwise we tell the caller
 	 * there is no need.
+	 *
+	 * With gc.geometricFactor, packs that are too small for the
+	 * progression are rolled up with "repack -A -d -l" keeping the
+	 * others, if there are at least two of them or too many loose
+	 * objects.
 	 */
-	if (too_many_packs())
-		append_option(argv_repack,
-			      prune_expire && !strcmp(prune_expire, "now") ?
-			      "-a" : "-A",
-			      MAX_ADD);
+	if (gc_geometric_factor > 1) {
+		if (add_geometric_repack_options() < 2 &&
+		    !too_many_loose_objects())
+			return 0;
+		append_repack_option(prune_expire &&
+				     !strcmp(prune_expire, "now") ?
+				     "-a" : "-A");
+	} else if (too_many_packs())
+		append_repack_option(prune_expire &&
+				     !strcmp(prune_expire, "now") ?
+				     "-a" : "-A");
 	else if (!too_many_loose_objects())
 		return 0;
 
@@ -191,6 +265,10 @@ int cmd_gc(int argc, const char **argv, const char *prefix)
 
 	git_config(gc_config, NULL);
 
+	append_repack_option("repack");
+	append_repack_option("-d");
+	append_repack_option("-l");
+
 	if (pack_refs < 0)
 		pack_refs = !is_bare_repository();
 
@@ -199,15 +277,15 @@ int cmd_gc(int argc, const char **argv, const char *prefix)
 		usage_with_options(builtin_gc_usage, builtin_gc_options);
 
 	if (aggressive) {
-		append_option(argv_repack, "-f", MAX_ADD);
-		append_option(argv_repack, "--depth=250", MAX_ADD);
+		append_repack_option("-f");
+		append_repack_option("--depth=250");
 		if (aggressive_window > 0) {
 			sprintf(buf, "--window=%d", aggressive_window);
-			append_option(argv_repack, buf, MAX_ADD);
+			append_repack_option(buf);
 		}
 	}
 	if (quiet)
-		append_option(argv_repack, "-q", MAX_ADD);
+		append_repack_option("-q");
 
 	if (auto_gc) {
 		/*
@@ -219,11 +297,17 @@ int cmd_gc(int argc, const char **argv, const char *prefix)
 			"performance. You may also\n"
 			"run \"git gc\" manually. See "
 			"\"git help gc\" for more information.\n");
-	} else
-		append_option(argv_repack,
-			      prune_expire && !strcmp(prune_expire, "now")
-			      ? "-a" : "-A",
-			      MAX_ADD);
+	} else {
+		/*
+		 * An explicit --aggressive run repacks everything, even
+		 * with gc.geometricFactor.
+		 */
+		if (gc_geometric_factor > 1 && !aggressive)
+			add_geometric_repack_options();
+		append_repack_option(prune_expire &&
+				     !strcmp(prune_expire, "now")
+				     ? "-a" : "-A");
+	}
 
 	if (pack_refs && run_command_v_opt(argv_pack_refs, RUN_GIT_CMD))
 		return error(FAILED_RUN, argv_pack_refs[0]);
@@ -635,6 +635,7 @@ static void make_cover_letter(struct rev_info *rev, int use_stdout,
 		 * desired.
 		 */
 		commit = xcalloc(1, sizeof(*commit));
+		commit->index = alloc_commit_index();
 		commit->buffer = xmalloc(400);
 		snprintf(commit->buffer, 400,
 			"tree 0000000000000000000000000000000000000000\n"
@@ -0,0 +1,119 @@
+/*
+ * Trial merges that leave the index and the work tree alone.
+ */
+#include "builtin.h"
+#include "cache.h"
+#include "commit.h"
+#include "merge-recursive.h"
+#include "parse-options.h"
+#include "quote.h"
+
+static const char * const merge_check_usage[] = {
+	"git merge-check <branch1> <branch2>",
+	"git merge-check --stdin",
+	NULL
+};
+
+static struct commit *get_commit_reference(const char *arg)
+{
+	unsigned char sha1[20];
+
+	if (get_sha1(arg, sha1))
+		return NULL;
+	return lookup_commit_reference_gently(sha1, 1);
+}
+
+/*
+ * Show the tree the merge would leave in the work tree and the
+ * paths it could not resolve; return whether it was clean.  In a
+ * batch, the record starts with "clean" or "conflict" and ends with
+ * an empty line.
+ */
+static int check_merge(struct merge_options *o,
+		       struct commit *h1, struct commit *h2, int batch)
+{
+	struct commit *result;
+	int clean, i;
+
+	clean = merge_recursive(o, h1, h2, NULL, &result);
+	if (!result || !result->tree)
+		die("unable to merge %s and %s", o->branch1, o->branch2);
+	if (batch)
+		printf("%s ", clean ? "clean" : "conflict");
+	printf("%s\n", sha1_to_hex(result->tree->object.sha1));
+	for (i = 0; i < o->conflicts.nr; i++)
+		write_name_quoted(o->conflicts.items[i].string, stdout, '\n');
+	if (batch)
+		putchar('\n');
+	return clean;
+}
+
+/*
+ * Answer each "<branch1> SP <branch2>" line with a record as above,
+ * or with "error <line>" if either is not a commit.  The objects read
+ * stay parsed from one merge to the next; only what the merges made
+ * in memory is dropped.
+ */
+static void check_merges_from_stdin(struct merge_options *o)
+{
+	struct strbuf line = STRBUF_INIT;
+
+	while (strbuf_getline(&line, stdin, '\n') != EOF) {
+		char *sp = strchr(line.buf, ' ');
+		struct commit *h1 = NULL, *h2 = NULL;
+
+		if (sp) {
+			*sp = '\0';
+			h1 = get_commit_reference(line.buf);
+			h2 = get_commit_reference(sp + 1);
+		}
+		if (h1 && h2) {
+			o->branch1 = line.buf;
+			o->branch2 = sp + 1;
+			check_merge(o, h1, h2, 1);
+		} else {
+			if (sp)
+				*sp = ' ';
+			printf("error %s\n\n", line.buf);
+		}
+		fflush(stdout);
+		discard_pretend_objects();
+	}
+	strbuf_release(&line);
+}
+
+int cmd_merge_check(int argc, const char **argv, const char *prefix)
+{
+	struct merge_options o;
+	struct commit *h1, *h2;
+	int from_stdin = 0;
+	struct option options[] = {
+		OPT_BOOLEAN(0, "stdin", &from_stdin, "read the pairs to merge from stdin"),
+		OPT_END()
+	};
+
+	init_merge_options(&o);
+	argc = parse_options(argc, argv, options, merge_check_usage, 0);
+	if (argc != (from_stdin ? 0 : 2))
+		usage_with_options(merge_check_usage, options);
+
+	o.in_memory = 1;
+	o.verbosity = -1;
+	o.buffer_output = 1;
+
+	if (from_stdin) {
+		check_merges_from_stdin(&o);
+		return 0;
+	}
+
+	o.branch1 = argv[0];
+	o.branch2 = argv[1];
+	h1 = get_commit_reference(o.branch1);
+	if (!h1)
+		die("Not a valid commit name %s", o.branch1);
+	h2 = get_commit_reference(o.branch2);
+	if (!h2)
+		die("Not a valid commit name %s", o.branch2);
+
+	return !check_merge(&o, h1, h2, 0);
+}
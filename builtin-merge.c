@@ -106,8 +106,8 @@ static struct strategy *get_strategy(const char *name)
 					found = 1;
 			if (!found)
 				add_cmdname(&not_strategies, ent->name, ent->len);
-			exclude_cmds(&main_cmds, &not_strategies);
 		}
+		exclude_cmds(&main_cmds, &not_strategies);
 	}
 	if (!is_in_cmdlist(&main_cmds, name) && !is_in_cmdlist(&other_cmds, name)) {
 		fprintf(stderr, "Could not find merge strategy '%s'.\n", name);
@@ -507,7 +507,7 @@ static int read_tree_trivial(unsigned char *common, unsigned char *head,
 	cache_tree_free(&active_cache_tree);
 	for (i = 0; i < nr_trees; i++) {
 		parse_tree(trees[i]);
-		init_tree_desc(t+i, trees[i]->buffer, trees[i]->size);
+		init_tree_desc_from_tree(t+i, trees[i]);
 	}
 	if (unpack_trees(nr_trees, t, &opts))
 		return -1;
@@ -655,7 +655,7 @@ static int checkout_fast_forward(unsigned char *head, unsigned char *remote)
 		return -1;
 	for (i = 0; i < nr_trees; i++) {
 		parse_tree(trees[i]);
-		init_tree_desc(t+i, trees[i]->buffer, trees[i]->size);
+		init_tree_desc_from_tree(t+i, trees[i]);
 	}
 	if (unpack_trees(nr_trees, t, &opts))
 		return -1;
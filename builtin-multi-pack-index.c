@@ -0,0 +1,18 @@
+#include "builtin.h"
+#include "cache.h"
+#include "midx.h"
+
+static const char multi_pack_index_usage[] =
+"git multi-pack-index (write | verify)";
+
+int cmd_multi_pack_index(int argc, const char **argv, const char *prefix)
+{
+	if (argc != 2)
+		usage(multi_pack_index_usage);
+
+	if (!strcmp(argv[1], "write"))
+		return !!write_multi_pack_index();
+	if (!strcmp(argv[1], "verify"))
+		return !!verify_multi_pack_index();
+	usage(multi_pack_index_usage);
+}
@@ -1,6 +1,7 @@
 #include "builtin.h"
 #include "cache.h"
 #include "commit.h"
+#include "commit-slab.h"
 #include "tag.h"
 #include "refs.h"
 #include "parse-options.h"
@@ -13,6 +14,9 @@ typedef struct rev_name {
 	int distance;
 } rev_name;
 
+define_commit_slab(rev_names, struct rev_name);
+static struct rev_names rev_names;
+
 static long cutoff = LONG_MAX;
 
 /* How many generations are maximally preferred over _one_ merge traversal? */
@@ -22,7 +26,7 @@ static void name_rev(struct commit *commit,
 		const char *tip_name, int generation, int distance,
 		int deref)
 {
-	struct rev_name *name = (struct rev_name *)commit->util;
+	struct rev_name *name = rev_names_at(&rev_names, commit);
 	struct commit_list *parents;
 	int parent_number = 1;
 
@@ -42,12 +46,7 @@ static void name_rev(struct commit *commit,
 			die("generation: %d, but deref?", generation);
 	}
 
-	if (name == NULL) {
-		name = xmalloc(sizeof(rev_name));
-		commit->util = name;
-		goto copy_data;
-	} else if (name->distance > distance) {
-copy_data:
+	if (!name->tip_name || name->distance > distance) {
 		name->tip_name = tip_name;
 		name->generation = generation;
 		name->distance = distance;
@@ -134,8 +133,8 @@ static const char *get_rev_name(const struct object *o)
 	if (o->type != OBJ_COMMIT)
 		return NULL;
 	c = (struct commit *) o;
-	n = c->util;
-	if (!n)
+	n = rev_names_peek(&rev_names, c);
+	if (!n || !n->tip_name)
 		return NULL;
 
 	if (!n->generation)
@@ -16,6 +16,7 @@
 #include "list-objects.h"
 #include "progress.h"
 #include "refs.h"
+#include "streaming.h"
 
 #ifdef THREADED_DELTA_SEARCH
 #include "thread-utils.h"
@@ -28,7 +29,8 @@ git pack-objects [{ -q | --progress | --all-progress }] \n\
 	[--window=N] [--window-memory=N] [--depth=N] \n\
 	[--no-reuse-delta] [--no-reuse-object] [--delta-base-offset] \n\
 	[--threads=N] [--non-empty] [--revs [--unpacked | --all]*] [--reflog] \n\
-	[--stdout | base-name] [--include-tag] \n\
+	[--stdout | base-name] [--include-tag] [--incremental-deltas] \n\
+	[--honor-pack-keep] [--keep-pack=<pack-name>...] \n\
 	[--keep-unreachable | --unpack-unreachable] \n\
 	[<ref-list | <object-list]";
 
@@ -54,6 +56,7 @@ struct object_entry {
 				       * objects against.
 				       */
 	unsigned char no_try_delta;
+	unsigned char base_only; /* only offered as a delta base */
 };
 
 /*
@@ -72,6 +75,9 @@ static int keep_unreachable, unpack_unreachable, include_tag;
 static int local;
 static int incremental;
 static int ignore_packed_keep;
+static const char **keep_pack_list;
+static int keep_pack_nr, keep_pack_alloc;
+static int incremental_deltas;
 static int allow_ofs_delta;
 static const char *base_name;
 static int progress = 1;
@@ -91,6 +97,15 @@ static unsigned long cache_max_small_delta_size = 1000;
 
 static unsigned long window_memory_limit = 0;
 
+/*
+ * pack.maxMemory is a single budget shared by all delta search
+ * threads; it covers the object data and delta indexes held in
+ * their windows (window_memory_usage) as well as the delta cache.
+ * Both counters are protected by cache_lock().
+ */
+static unsigned long max_memory = 0;
+static unsigned long window_memory_usage = 0;
+
 /*
  * The object names in objects array are hashed with this hashtable,
  * to help looking up the entry by object name.
@@ -153,6 +168,71 @@ static unsigned long do_compress(void **pptr, unsigned long size)
 	return stream.total_out;
 }
 
+/*
+ * Blobs above core.bigFileThreshold are typically media that do not
+ * compress well; spend as little CPU on them as we can.
+ */
+static int big_file_compression_level(void)
+{
+	if (pack_compression_level == Z_NO_COMPRESSION)
+		return Z_NO_COMPRESSION;
+	return Z_BEST_SPEED;
+}
+
+static unsigned long big_file_deflate_bound(unsigned long size)
+{
+	z_stream stream;
+	unsigned long bound;
+
+	memset(&stream, 0, sizeof(stream));
+	deflateInit(&stream, big_file_compression_level());
+	bound = deflateBound(&stream, size);
+	deflateEnd(&stream);
+	return bound;
+}
+
+static unsigned long write_large_blob_data(struct git_istream *st,
+					   struct sha1file *f,
+					   const unsigned char *sha1)
+{
+	z_stream stream;
+	unsigned char ibuf[1024 * 16];
+	unsigned char obuf[1024 * 16];
+	unsigned long olen = 0;
+
+	memset(&stream, 0, sizeof(stream));
+	deflateInit(&stream, big_file_compression_level());
+
+	for (;;) {
+		ssize_t readlen;
+		int zret = Z_OK;
+
+		readlen = read_istream(st, (char *)ibuf, sizeof(ibuf));
+		if (readlen < 0)
+			die("unable to read %s", sha1_to_hex(sha1));
+
+		stream.next_in = ibuf;
+		stream.avail_in = readlen;
+		while ((stream.avail_in || !readlen) &&
+		       (zret == Z_OK || zret == Z_BUF_ERROR)) {
+			stream.next_out = obuf;
+			stream.avail_out = sizeof(obuf);
+			zret = deflate(&stream, readlen ? 0 : Z_FINISH);
+			sha1write(f, obuf, stream.next_out - obuf);
+			olen += stream.next_out - obuf;
+		}
+		if (stream.avail_in)
+			die("deflate error (%d)", zret);
+		if (!readlen) {
+			if (zret != Z_STREAM_END)
+				die("deflate error (%d)", zret);
+			break;
+		}
+	}
+	deflateEnd(&stream);
+	return olen;
+}
+
 /*
  * The per-object header is a pretty dense thing, which is
  *  - first byte: low four bits are "size", then three bits of "type",
@@ -235,6 +315,7 @@ static unsigned long write_object(struct sha1file *f,
 {
 	unsigned long size, limit, datalen;
 	void *buf;
+	struct git_istream *st = NULL;
 	unsigned char header[10], dheader[10];
 	unsigned hdrlen;
 	enum object_type type;
@@ -288,9 +369,15 @@ static unsigned long write_object(struct sha1file *f,
 	if (!to_reuse) {
 		no_reuse:
 		if (!usable_delta) {
-			buf = read_sha1_file(entry->idx.sha1, &type, &size);
-			if (!buf)
-				die("unable to read %s", sha1_to_hex(entry->idx.sha1));
+			if (entry->type == OBJ_BLOB &&
+			    entry->size > big_file_threshold &&
+			    (st = open_istream(entry->idx.sha1, &type, &size)) != NULL)
+				buf = NULL;
+			else {
+				buf = read_sha1_file(entry->idx.sha1, &type, &size);
+				if (!buf)
+					die("unable to read %s", sha1_to_hex(entry->idx.sha1));
+			}
 			/*
 			 * make sure no cached delta data remains from a
 			 * previous attempt before a pack split occurred.
@@ -311,7 +398,10 @@ static unsigned long write_object(struct sha1file *f,
 				OBJ_OFS_DELTA : OBJ_REF_DELTA;
 		}
 
-		if (entry->z_delta_size)
+		if (st)
+			/* deflated on the fly below; assume the worst */
+			datalen = big_file_deflate_bound(size);
+		else if (entry->z_delta_size)
 			datalen = entry->z_delta_size;
 		else
 			datalen = do_compress(&buf, size);
@@ -354,12 +444,18 @@ static unsigned long write_object(struct sha1file *f,
 			hdrlen += 20;
 		} else {
 			if (limit && hdrlen + datalen + 20 >= limit) {
+				if (st)
+					close_istream(st);
 				free(buf);
 				return 0;
 			}
 			sha1write(f, header, hdrlen);
 		}
-		sha1write(f, buf, datalen);
+		if (st) {
+			datalen = write_large_blob_data(st, f, entry->idx.sha1);
+			close_istream(st);
+		} else
+			sha1write(f, buf, datalen);
 		free(buf);
 	}
 	else {
@@ -1169,8 +1265,12 @@ static void get_object_details(void)
 		sorted_by_offset[i] = objects + i;
 	qsort(sorted_by_offset, nr_objects, sizeof(*sorted_by_offset), pack_offset_sort);
 
-	for (i = 0; i < nr_objects; i++)
-		check_object(sorted_by_offset[i]);
+	for (i = 0; i < nr_objects; i++) {
+		struct object_entry *entry = sorted_by_offset[i];
+		check_object(entry);
+		if (entry->type == OBJ_BLOB && big_file_threshold < entry->size)
+			entry->no_try_delta = 1;
+	}
 
 	free(sorted_by_offset);
 }
@@ -1201,6 +1301,10 @@ static int type_size_sort(const void *_a, const void *_b)
 		return -1;
 	if (a->preferred_base < b->preferred_base)
 		return 1;
+	if (a->base_only > b->base_only)
+		return -1;
+	if (a->base_only < b->base_only)
+		return 1;
 	if (a->size > b->size)
 		return -1;
 	if (a->size < b->size)
@@ -1221,6 +1325,10 @@ static int delta_cacheable(unsigned long src_size, unsigned long trg_size,
 	if (max_delta_cache_size && delta_cache_size + delta_size > max_delta_cache_size)
 		return 0;
 
+	if (max_memory &&
+	    window_memory_usage + delta_cache_size + delta_size > max_memory)
+		return 0;
+
 	if (delta_size < cache_max_small_delta_size)
 		return 1;
 
@@ -1256,6 +1364,45 @@ static pthread_mutex_t progress_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 #endif
 
+static void use_window_memory(unsigned long *mem_usage, unsigned long sz)
+{
+	*mem_usage += sz;
+	if (max_memory) {
+		cache_lock();
+		window_memory_usage += sz;
+		cache_unlock();
+	}
+}
+
+static void release_window_memory(unsigned long *mem_usage, unsigned long sz)
+{
+	*mem_usage -= sz;
+	if (max_memory) {
+		cache_lock();
+		window_memory_usage -= sz;
+		cache_unlock();
+	}
+}
+
+/*
+ * Should the calling thread shrink its window?  Either its own
+ * window is over pack.windowMemory, or all the threads together
+ * are over pack.maxMemory.
+ */
+static int window_over_budget(unsigned long mem_usage)
+{
+	int over;
+
+	if (window_memory_limit && mem_usage > window_memory_limit)
+		return 1;
+	if (!max_memory)
+		return 0;
+	cache_lock();
+	over = window_memory_usage + delta_cache_size > max_memory;
+	cache_unlock();
+	return over;
+}
+
 static int try_delta(struct unpacked *trg, struct unpacked *src,
 		     unsigned max_depth, unsigned long *mem_usage)
 {
@@ -1315,7 +1462,7 @@ static int try_delta(struct unpacked *trg, struct unpacked *src,
 		if (sz != trg_size)
 			die("object %s inconsistent object length (%lu vs %lu)",
 			    sha1_to_hex(trg_entry->idx.sha1), sz, trg_size);
-		*mem_usage += sz;
+		use_window_memory(mem_usage, sz);
 	}
 	if (!src->data) {
 		read_lock();
@@ -1327,7 +1474,7 @@ static int try_delta(struct unpacked *trg, struct unpacked *src,
 		if (sz != src_size)
 			die("object %s inconsistent object length (%lu vs %lu)",
 			    sha1_to_hex(src_entry->idx.sha1), sz, src_size);
-		*mem_usage += sz;
+		use_window_memory(mem_usage, sz);
 	}
 	if (!src->index) {
 		src->index = create_delta_index(src->data, src_size);
@@ -1337,7 +1484,7 @@ static int try_delta(struct unpacked *trg, struct unpacked *src,
 				warning("suboptimal pack - out of memory");
 			return 0;
 		}
-		*mem_usage += sizeof_delta_index(src->index);
+		use_window_memory(mem_usage, sizeof_delta_index(src->index));
 	}
 
 	delta_buf = create_delta(src->index, trg->data, trg_size, &delta_size, max_size);
@@ -1408,8 +1555,23 @@ static unsigned long free_unpacked(struct unpacked *n)
 	return freed_mem;
 }
 
-static void find_deltas(struct object_entry **list, unsigned *list_size,
-			int window, int depth, unsigned *processed)
+struct thread_params;
+
+#ifdef THREADED_DELTA_SEARCH
+static int next_chunk(struct thread_params *me,
+		      struct object_entry ***list, unsigned *list_size);
+#else
+#define next_chunk(me, list, list_size)	0
+#endif
+
+/*
+ * Deltify list[0..list_size-1].  When called from a delta search
+ * thread ("me"), keep going with the chunks that follow in the
+ * thread's own range, reusing the window across chunk boundaries.
+ */
+static void find_deltas(struct object_entry **list, unsigned list_size,
+			int window, int depth, unsigned *processed,
+			struct thread_params *me)
 {
 	uint32_t i, idx = 0, count = 0;
 	struct unpacked *array;
@@ -1422,34 +1584,31 @@ static void find_deltas(struct object_entry **list, unsigned *list_size,
 		struct unpacked *n = array + idx;
 		int j, max_depth, best_base = -1;
 
-		progress_lock();
-		if (!*list_size) {
-			progress_unlock();
+		if (!list_size && !(me && next_chunk(me, &list, &list_size)))
 			break;
-		}
 		entry = *list++;
-		(*list_size)--;
-		if (!entry->preferred_base) {
+		list_size--;
+		if (!entry->preferred_base && !entry->base_only) {
+			progress_lock();
 			(*processed)++;
 			display_progress(progress_state, *processed);
+			progress_unlock();
 		}
-		progress_unlock();
 
-		mem_usage -= free_unpacked(n);
+		release_window_memory(&mem_usage, free_unpacked(n));
 		n->entry = entry;
 
-		while (window_memory_limit &&
-		       mem_usage > window_memory_limit &&
-		       count > 1) {
+		while (count > 1 && window_over_budget(mem_usage)) {
 			uint32_t tail = (idx + window - count) % window;
-			mem_usage -= free_unpacked(array + tail);
+			release_window_memory(&mem_usage,
+					      free_unpacked(array + tail));
 			count--;
 		}
 
 		/* We do not compute delta to *create* objects we are not
-		 * going to pack.
+		 * going to pack, or that we are going to reuse as they are.
 		 */
-		if (entry->preferred_base)
+		if (entry->preferred_base || entry->base_only)
 			goto next;
 
 		/*
@@ -1536,198 +1695,221 @@ static void find_deltas(struct object_entry **list, unsigned *list_size,
 			idx = 0;
 	}
 
-	for (i = 0; i < window; ++i) {
-		free_delta_index(array[i].index);
-		free(array[i].data);
-	}
+	for (i = 0; i < window; ++i)
+		release_window_memory(&mem_usage, free_unpacked(array + i));
 	free(array);
 }
 
 #ifdef THREADED_DELTA_SEARCH
 
 /*
- * The main thread waits on the condition that (at least) one of the workers
- * has stopped working (which is indicated in the .working member of
- * struct thread_params).
- * When a work thread has completed its work, it sets .working to 0 and
- * signals the main thread and waits on the condition that .data_ready
- * becomes 1.
+ * The delta list is cut into small chunks that end on name hash
+ * ("path") boundaries, so that objects likely to delta against each
+ * other stay in the same chunk.  Each thread starts with a contiguous
+ * range of chunks, which it consumes from the front, keeping its
+ * window from one chunk to the next.  A thread that runs out of work
+ * steals the back half of the largest range left and starts over
+ * there with a fresh window.
  */
 
 struct thread_params {
 	pthread_t thread;
+	int id;
 	struct object_entry **list;
-	unsigned list_size;
-	unsigned remaining;
+	unsigned *chunk;	/* chunk i is list[chunk[i]..chunk[i+1]-1] */
+	unsigned first, last;	/* chunks not yet started; under mutex */
+	pthread_mutex_t mutex;
 	int window;
 	int depth;
-	int working;
-	int data_ready;
-	pthread_mutex_t mutex;
-	pthread_cond_t cond;
 	unsigned *processed;
+	unsigned nr_chunks, nr_stolen, nr_objects;
 };
 
-static pthread_cond_t progress_cond = PTHREAD_COND_INITIALIZER;
+static struct thread_params *delta_workers;
 
-static void *threaded_find_deltas(void *arg)
+static int next_chunk(struct thread_params *me,
+		      struct object_entry ***list, unsigned *list_size)
 {
-	struct thread_params *me = arg;
+	int c = -1;
 
-	while (me->remaining) {
-		find_deltas(me->list, &me->remaining,
-			    me->window, me->depth, me->processed);
+	pthread_mutex_lock(&me->mutex);
+	if (me->first < me->last)
+		c = me->first++;
+	pthread_mutex_unlock(&me->mutex);
+	if (c < 0)
+		return 0;
 
-		progress_lock();
-		me->working = 0;
-		pthread_cond_signal(&progress_cond);
-		progress_unlock();
+	*list = me->list + me->chunk[c];
+	*list_size = me->chunk[c + 1] - me->chunk[c];
+	me->nr_chunks++;
+	me->nr_objects += *list_size;
+	return 1;
+}
+
+static unsigned chunks_left(struct thread_params *p)
+{
+	unsigned left;
+
+	pthread_mutex_lock(&p->mutex);
+	left = p->last - p->first;
+	pthread_mutex_unlock(&p->mutex);
+	return left;
+}
+
+static int steal_chunks(struct thread_params *me)
+{
+	for (;;) {
+		struct thread_params *victim = NULL;
+		unsigned most = 0, first, n;
+		int i;
+
+		for (i = 0; i < delta_search_threads; i++) {
+			struct thread_params *p = &delta_workers[i];
+			unsigned left = (p == me) ? 0 : chunks_left(p);
+			if (most < left) {
+				most = left;
+				victim = p;
+			}
+		}
+		if (!victim)
+			return 0;
+
+		pthread_mutex_lock(&victim->mutex);
+		n = (victim->last - victim->first + 1) / 2;
+		victim->last -= n;
+		first = victim->last;
+		pthread_mutex_unlock(&victim->mutex);
+		if (!n)
+			continue; /* somebody else got there first */
 
-		/*
-		 * We must not set ->data_ready before we wait on the
-		 * condition because the main thread may have set it to 1
-		 * before we get here. In order to be sure that new
-		 * work is available if we see 1 in ->data_ready, it
-		 * was initialized to 0 before this thread was spawned
-		 * and we reset it to 0 right away.
-		 */
 		pthread_mutex_lock(&me->mutex);
-		while (!me->data_ready)
-			pthread_cond_wait(&me->cond, &me->mutex);
-		me->data_ready = 0;
+		me->first = first;
+		me->last = first + n;
 		pthread_mutex_unlock(&me->mutex);
+		me->nr_stolen += n;
+		return 1;
+	}
+}
+
+static void *threaded_find_deltas(void *arg)
+{
+	struct thread_params *me = arg;
+	struct object_entry **list;
+	unsigned list_size;
+	struct timeval start, end;
+	unsigned long ms;
+
+	gettimeofday(&start, NULL);
+	for (;;) {
+		if (!next_chunk(me, &list, &list_size)) {
+			if (!steal_chunks(me))
+				break;
+			continue;
+		}
+		find_deltas(list, list_size, me->window, me->depth,
+			    me->processed, me);
 	}
-	/* leave ->working 1 so that this doesn't get more work assigned */
+	gettimeofday(&end, NULL);
+
+	ms = (end.tv_sec - start.tv_sec) * 1000 +
+		(end.tv_usec - start.tv_usec) / 1000;
+	trace_printf("trace: delta search thread %d: %u objects in %u chunks"
+		     " (%u stolen), %lu.%03lu s\n",
+		     me->id, me->nr_objects, me->nr_chunks, me->nr_stolen,
+		     ms / 1000, ms % 1000);
 	return NULL;
 }
 
 static void ll_find_deltas(struct object_entry **list, unsigned list_size,
 			   int window, int depth, unsigned *processed)
 {
-	struct thread_params p[delta_search_threads];
-	int i, ret, active_threads = 0;
+	struct thread_params *p;
+	unsigned *chunk = NULL, nr_chunks = 0, alloc_chunks = 0;
+	unsigned start, end, chunk_size, max_chunk_size;
+	int i, ret;
 
 	if (delta_search_threads <= 1) {
-		find_deltas(list, &list_size, window, depth, processed);
+		find_deltas(list, list_size, window, depth, processed, NULL);
 		return;
 	}
 	if (progress > pack_to_stdout)
 		fprintf(stderr, "Delta compression using up to %d threads.\n",
 				delta_search_threads);
 
-	/* Partition the work amongst work threads. */
-	for (i = 0; i < delta_search_threads; i++) {
-		unsigned sub_size = list_size / (delta_search_threads - i);
-
-		/* don't use too small segments or no deltas will be found */
-		if (sub_size < 2*window && i+1 < delta_search_threads)
-			sub_size = 0;
+	/*
+	 * Cut the list into chunks.  Don't use too small chunks or no
+	 * deltas will be found; a "path" with very many objects is
+	 * split anyway, so that it cannot hog a single thread.
+	 */
+	chunk_size = 2 * window;
+	max_chunk_size = list_size / (4 * delta_search_threads);
+	if (max_chunk_size < chunk_size)
+		max_chunk_size = chunk_size;
+	for (start = 0; start < list_size; start = end) {
+		end = start + chunk_size;
+		if (end > list_size)
+			end = list_size;
+		while (end < list_size && end - start < max_chunk_size &&
+		       list[end]->hash &&
+		       list[end]->hash == list[end-1]->hash)
+			end++;
+		ALLOC_GROW(chunk, nr_chunks + 2, alloc_chunks);
+		chunk[nr_chunks++] = start;
+	}
+	ALLOC_GROW(chunk, nr_chunks + 1, alloc_chunks);
+	chunk[nr_chunks] = list_size;
 
+	p = xcalloc(delta_search_threads, sizeof(*p));
+	delta_workers = p;
+	for (i = 0; i < delta_search_threads; i++) {
+		p[i].id = i;
+		p[i].list = list;
+		p[i].chunk = chunk;
+		p[i].first = (uint64_t)nr_chunks * i / delta_search_threads;
+		p[i].last = (uint64_t)nr_chunks * (i + 1) / delta_search_threads;
 		p[i].window = window;
 		p[i].depth = depth;
 		p[i].processed = processed;
-		p[i].working = 1;
-		p[i].data_ready = 0;
-
-		/* try to split chunks on "path" boundaries */
-		while (sub_size && sub_size < list_size &&
-		       list[sub_size]->hash &&
-		       list[sub_size]->hash == list[sub_size-1]->hash)
-			sub_size++;
-
-		p[i].list = list;
-		p[i].list_size = sub_size;
-		p[i].remaining = sub_size;
-
-		list += sub_size;
-		list_size -= sub_size;
+		pthread_mutex_init(&p[i].mutex, NULL);
 	}
 
-	/* Start work threads. */
 	for (i = 0; i < delta_search_threads; i++) {
-		if (!p[i].list_size)
-			continue;
-		pthread_mutex_init(&p[i].mutex, NULL);
-		pthread_cond_init(&p[i].cond, NULL);
 		ret = pthread_create(&p[i].thread, NULL,
 				     threaded_find_deltas, &p[i]);
 		if (ret)
 			die("unable to create thread: %s", strerror(ret));
-		active_threads++;
 	}
-
-	/*
-	 * Now let's wait for work completion.  Each time a thread is done
-	 * with its work, we steal half of the remaining work from the
-	 * thread with the largest number of unprocessed objects and give
-	 * it to that newly idle thread.  This ensure good load balancing
-	 * until the remaining object list segments are simply too short
-	 * to be worth splitting anymore.
-	 */
-	while (active_threads) {
-		struct thread_params *target = NULL;
-		struct thread_params *victim = NULL;
-		unsigned sub_size = 0;
-
-		progress_lock();
-		for (;;) {
-			for (i = 0; !target && i < delta_search_threads; i++)
-				if (!p[i].working)
-					target = &p[i];
-			if (target)
-				break;
-			pthread_cond_wait(&progress_cond, &progress_mutex);
-		}
-
-		for (i = 0; i < delta_search_threads; i++)
-			if (p[i].remaining > 2*window &&
-			    (!victim || victim->remaining < p[i].remaining))
-				victim = &p[i];
-		if (victim) {
-			sub_size = victim->remaining / 2;
-			list = victim->list + victim->list_size - sub_size;
-			while (sub_size && list[0]->hash &&
-			       list[0]->hash == list[-1]->hash) {
-				list++;
-				sub_size--;
-			}
-			if (!sub_size) {
-				/*
-				 * It is possible for some "paths" to have
-				 * so many objects that no hash boundary
-				 * might be found.  Let's just steal the
-				 * exact half in that case.
-				 */
-				sub_size = victim->remaining / 2;
-				list -= sub_size;
-			}
-			target->list = list;
-			victim->list_size -= sub_size;
-			victim->remaining -= sub_size;
-		}
-		target->list_size = sub_size;
-		target->remaining = sub_size;
-		target->working = 1;
-		progress_unlock();
-
-		pthread_mutex_lock(&target->mutex);
-		target->data_ready = 1;
-		pthread_cond_signal(&target->cond);
-		pthread_mutex_unlock(&target->mutex);
-
-		if (!sub_size) {
-			pthread_join(target->thread, NULL);
-			pthread_cond_destroy(&target->cond);
-			pthread_mutex_destroy(&target->mutex);
-			active_threads--;
-		}
+	for (i = 0; i < delta_search_threads; i++) {
+		pthread_join(p[i].thread, NULL);
+		pthread_mutex_destroy(&p[i].mutex);
 	}
+
+	delta_workers = NULL;
+	free(p);
+	free(chunk);
 }
 
 #else
-#define ll_find_deltas(l, s, w, d, p)	find_deltas(l, &s, w, d, p)
+#define ll_find_deltas(l, s, w, d, p)	find_deltas(l, s, w, d, p, NULL)
 #endif
 
+/*
+ * Treat the packs named with --keep-pack as if they had a .keep file.
+ */
+static void mark_keep_packs(void)
+{
+	struct packed_git *p;
+	int i;
+
+	for (p = packed_git; p; p = p->next) {
+		const char *name = strrchr(p->pack_name, '/');
+		name = name ? name + 1 : p->pack_name;
+		for (i = 0; i < keep_pack_nr; i++)
+			if (!strcmp(name, keep_pack_list[i]))
+				p->pack_keep = 1;
+	}
+}
+
 static int add_ref_tag(const char *path, const unsigned char *sha1, int flag, void *cb_data)
 {
 	unsigned char peeled[20];
@@ -1779,7 +1961,16 @@ static void prepare_pack(int window, int depth)
 		if (entry->no_try_delta)
 			continue;
 
-		if (!entry->preferred_base) {
+		/*
+		 * With --incremental-deltas, an object we are about to
+		 * copy whole from an existing pack keeps that form; it
+		 * is only there for new objects to delta against.
+		 */
+		if (incremental_deltas && reuse_delta && entry->in_pack &&
+		    entry->type == entry->in_pack_type)
+			entry->base_only = 1;
+
+		if (!entry->preferred_base && !entry->base_only) {
 			nr_deltas++;
 			if (entry->type < 0)
 				die("unable to get type of object %s",
@@ -1821,6 +2012,10 @@ static int git_pack_config(const char *k, const char *v, void *cb)
 		window_memory_limit = git_config_ulong(k, v);
 		return 0;
 	}
+	if (!strcmp(k, "pack.maxmemory")) {
+		max_memory = git_config_ulong(k, v);
+		return 0;
+	}
 	if (!strcmp(k, "pack.depth")) {
 		depth = git_config_int(k, v);
 		return 0;
@@ -2136,6 +2331,17 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 			ignore_packed_keep = 1;
 			continue;
 		}
+		if (!prefixcmp(arg, "--keep-pack=")) {
+			ALLOC_GROW(keep_pack_list, keep_pack_nr + 1,
+				   keep_pack_alloc);
+			keep_pack_list[keep_pack_nr++] = arg + 12;
+			ignore_packed_keep = 1;
+			continue;
+		}
+		if (!strcmp("--incremental-deltas", arg)) {
+			incremental_deltas = 1;
+			continue;
+		}
 		if (!prefixcmp(arg, "--compression=")) {
 			char *end;
 			int level = strtoul(arg+14, &end, 0);
@@ -2300,6 +2506,8 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 #endif
 
 	prepare_packed_git();
+	if (keep_pack_nr)
+		mark_keep_packs();
 
 	if (progress)
 		progress_state = start_progress("Counting objects", 0);
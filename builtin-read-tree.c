@@ -189,7 +189,7 @@ int cmd_read_tree(int argc, const char **argv, const char *unused_prefix)
 	for (i = 0; i < nr_trees; i++) {
 		struct tree *tree = trees[i];
 		parse_tree(tree);
-		init_tree_desc(t+i, tree->buffer, tree->size);
+		init_tree_desc_from_tree(t+i, tree);
 	}
 	if (unpack_trees(nr_trees, t, &opts))
 		return 128;
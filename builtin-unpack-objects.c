@@ -297,10 +297,216 @@ static void added_object(unsigned nr, enum object_type type,
 	}
 }
 
+/*
+ * Blobs larger than core.bigFileThreshold are neither inflated in
+ * core nor written out as loose objects.  Their deflated data is
+ * copied as-is into a pack of their own, which is installed at the
+ * end, or earlier when a delta needs one of them as its base.
+ */
+static struct pack_idx_entry **big_objects;
+static int nr_big_objects, alloc_big_objects;
+static int big_pack_fd = -1;
+static char big_pack_name[PATH_MAX];
+static off_t big_pack_size;
+
+static void start_big_pack(void)
+{
+	struct pack_header hdr;
+
+	big_pack_fd = odb_mkstemp(big_pack_name, sizeof(big_pack_name),
+				  "pack/tmp_pack_XXXXXX");
+	hdr.hdr_signature = htonl(PACK_SIGNATURE);
+	hdr.hdr_version = htonl(2);
+	hdr.hdr_entries = 0;
+	write_or_die(big_pack_fd, &hdr, sizeof(hdr));
+	big_pack_size = sizeof(hdr);
+}
+
+static int in_big_pack(const unsigned char *sha1)
+{
+	int i;
+
+	for (i = 0; i < nr_big_objects; i++)
+		if (!hashcmp(big_objects[i]->sha1, sha1))
+			return 1;
+	return 0;
+}
+
+static void finish_big_pack(void)
+{
+	unsigned char sha1[20];
+	char name[PATH_MAX];
+	char *idx_tmp_name;
+	struct packed_git *p;
+	int i;
+
+	if (big_pack_fd < 0)
+		return;
+	if (!nr_big_objects) {
+		close(big_pack_fd);
+		unlink(big_pack_name);
+		big_pack_fd = -1;
+		return;
+	}
+
+	fixup_pack_header_footer(big_pack_fd, sha1, big_pack_name,
+				 nr_big_objects, NULL, 0);
+	close(big_pack_fd);
+	big_pack_fd = -1;
+	idx_tmp_name = write_idx_file(NULL, big_objects, nr_big_objects, sha1);
+
+	snprintf(name, sizeof(name), "%s/pack/pack-%s.pack",
+		 get_object_directory(), sha1_to_hex(sha1));
+	if (move_temp_to_file(big_pack_name, name))
+		die("cannot store pack file");
+	snprintf(name, sizeof(name), "%s/pack/pack-%s.idx",
+		 get_object_directory(), sha1_to_hex(sha1));
+	if (move_temp_to_file(idx_tmp_name, name))
+		die("cannot store index file");
+	free(idx_tmp_name);
+
+	p = add_packed_git(name, strlen(name), 1);
+	if (!p)
+		die("core git rejected index %s", name);
+	install_packed_git(p);
+
+	for (i = 0; i < nr_big_objects; i++)
+		free(big_objects[i]);
+	nr_big_objects = 0;
+}
+
+/*
+ * Make sure the object can be read with read_sha1_file(), if it is
+ * sitting in the big pack we are still writing.
+ */
+static void flush_big_pack_for(const unsigned char *sha1)
+{
+	if (in_big_pack(sha1))
+		finish_big_pack();
+}
+
+static void stream_blob_to_pack(unsigned long size, unsigned nr)
+{
+	git_SHA_CTX c;
+	z_stream stream;
+	struct pack_idx_entry *entry;
+	struct delta_info *info;
+	unsigned char header[10], obuf[8192], sha1[20];
+	char hdr[32];
+	unsigned long sz = size;
+	int hdrlen, status;
+	uint32_t crc;
+
+	if (big_pack_fd < 0)
+		start_big_pack();
+	entry = xcalloc(1, sizeof(*entry));
+	entry->offset = big_pack_size;
+
+	/* in-pack header, see encode_header() in builtin-pack-objects.c */
+	hdrlen = 0;
+	header[0] = (OBJ_BLOB << 4) | (sz & 15);
+	for (sz >>= 4; sz; sz >>= 7) {
+		header[hdrlen++] |= 0x80;
+		header[hdrlen] = sz & 0x7f;
+	}
+	hdrlen++;
+	write_or_die(big_pack_fd, header, hdrlen);
+	crc = crc32(0, header, hdrlen);
+	big_pack_size += hdrlen;
+
+	git_SHA1_Init(&c);
+	git_SHA1_Update(&c, hdr, sprintf(hdr, "blob %lu", size) + 1);
+
+	memset(&stream, 0, sizeof(stream));
+	stream.next_in = fill(1);
+	stream.avail_in = len;
+	git_inflate_init(&stream);
+
+	for (;;) {
+		unsigned int used;
+
+		stream.next_out = obuf;
+		stream.avail_out = sizeof(obuf);
+		status = git_inflate(&stream, 0);
+		git_SHA1_Update(&c, obuf, stream.next_out - obuf);
+		used = len - stream.avail_in;
+		write_or_die(big_pack_fd, buffer + offset, used);
+		crc = crc32(crc, buffer + offset, used);
+		big_pack_size += used;
+		use(used);
+		if (stream.total_out == size && status == Z_STREAM_END)
+			break;
+		if (status != Z_OK || stream.total_out > size)
+			break;
+		stream.next_in = fill(1);
+		stream.avail_in = len;
+	}
+	git_inflate_end(&stream);
+	git_SHA1_Final(sha1, &c);
+
+	if (status != Z_STREAM_END || stream.total_out != size) {
+		error("inflate returned %d\n", status);
+		if (!recover)
+			exit(1);
+		has_errors = 1;
+	} else
+		hashcpy(obj_list[nr].sha1, sha1);
+
+	if (is_null_sha1(obj_list[nr].sha1) ||
+	    has_sha1_file(sha1) || in_big_pack(sha1)) {
+		/* nothing (new) to keep; take the copy back out */
+		if (ftruncate(big_pack_fd, entry->offset) ||
+		    lseek(big_pack_fd, entry->offset, SEEK_SET) != entry->offset)
+			die("cannot truncate %s: %s", big_pack_name,
+			    strerror(errno));
+		big_pack_size = entry->offset;
+		free(entry);
+		if (is_null_sha1(obj_list[nr].sha1))
+			return;
+	} else {
+		hashcpy(entry->sha1, sha1);
+		entry->crc32 = crc;
+		ALLOC_GROW(big_objects, nr_big_objects + 1, alloc_big_objects);
+		big_objects[nr_big_objects++] = entry;
+	}
+
+	if (strict) {
+		struct blob *blob = lookup_blob(sha1);
+		if (blob)
+			blob->object.flags |= FLAG_WRITTEN;
+		else
+			die("invalid blob object");
+	}
+
+	/* deltas waiting for this blob need it in core after all */
+	for (info = delta_list; info; info = info->next)
+		if (!hashcmp(info->base_sha1, sha1) ||
+		    info->base_offset == obj_list[nr].offset)
+			break;
+	if (info) {
+		enum object_type type;
+		void *data;
+
+		flush_big_pack_for(sha1);
+		data = read_sha1_file(sha1, &type, &sz);
+		if (!data)
+			die("unable to read %s", sha1_to_hex(sha1));
+		added_object(nr, type, data, sz);
+		free(data);
+	}
+}
+
 static void unpack_non_delta_entry(enum object_type type, unsigned long size,
 				   unsigned nr)
 {
-	void *buf = get_data(size);
+	void *buf;
+
+	if (!dry_run && type == OBJ_BLOB && size > big_file_threshold) {
+		stream_blob_to_pack(size, nr);
+		return;
+	}
+
+	buf = get_data(size);
 
 	if (!dry_run && buf)
 		write_object(nr, type, buf, size);
@@ -339,6 +545,7 @@ static void unpack_delta_entry(enum object_type type, unsigned long delta_size,
 			free(delta_data);
 			return;
 		}
+		flush_big_pack_for(base_sha1);
 		if (has_sha1_file(base_sha1))
 			; /* Ok we have this one */
 		else if (resolve_against_held(nr, base_sha1,
@@ -406,6 +613,7 @@ static void unpack_delta_entry(enum object_type type, unsigned long delta_size,
 	if (resolve_against_held(nr, base_sha1, delta_data, delta_size))
 		return;
 
+	flush_big_pack_for(base_sha1);
 	base = read_sha1_file(base_sha1, &type, &base_size);
 	if (!base) {
 		error("failed to read delta-pack base object %s",
@@ -485,6 +693,7 @@ static void unpack_all(void)
 		display_progress(progress, i + 1);
 	}
 	stop_progress(&progress);
+	finish_big_pack();
 
 	if (delta_list)
 		die("unresolved deltas left after unpacking");
@@ -27,9 +27,17 @@ struct cache_tree_sub *cache_tree_sub(struct cache_tree *, const char *);
 void cache_tree_write(struct strbuf *, struct cache_tree *root);
 struct cache_tree *cache_tree_read(const char *buffer, unsigned long size);
 
+/* The node for the directory "path" ("a/b"), if there is one. */
+struct cache_tree *cache_tree_find(struct cache_tree *, const char *path);
+
 int cache_tree_fully_valid(struct cache_tree *);
 int cache_tree_update(struct cache_tree *, struct cache_entry **, int, int, int);
 
+/* values for the last argument of cache_tree_update() */
+#define CACHE_TREE_WRITE	0
+#define CACHE_TREE_DRY_RUN	1	/* only compute the names */
+#define CACHE_TREE_PRETEND	2	/* keep the trees in memory only */
+
 #define WRITE_TREE_UNREADABLE_INDEX (-1)
 #define WRITE_TREE_UNMERGED_INDEX (-2)
 #define WRITE_TREE_PREFIX_ERROR (-3)
@@ -0,0 +1,77 @@
+#ifndef COMMIT_SLAB_H
+#define COMMIT_SLAB_H
+
+/*
+ * A commit slab keeps one "elemtype" for every commit, found by the
+ * commit's index instead of through commit->util or a decoration hash.
+ * Each walk can have its own slab, so walks that would fight over
+ * commit->util can run side by side.
+ *
+ *	define_commit_slab(indegree, int);
+ *
+ * gives "struct indegree" and these functions:
+ *
+ *	init_indegree(&s)		start with every element zeroed
+ *	indegree_at(&s, commit)		pointer to the element, allocating
+ *					it if need be
+ *	indegree_peek(&s, commit)	pointer to the element, or NULL if
+ *					nothing was ever stored near it
+ *	clear_indegree(&s)		free the slab
+ *
+ * Elements live in chunks of COMMIT_SLAB_SIZE that never move, so a
+ * pointer from _at() stays good until the slab is cleared.
+ */
+
+#define COMMIT_SLAB_SIZE 1024
+
+#define define_commit_slab(slabname, elemtype)				\
+									\
+struct slabname {							\
+	unsigned int slab_count;					\
+	elemtype **slab;						\
+};									\
+									\
+static inline void init_ ##slabname(struct slabname *s)		\
+{									\
+	s->slab_count = 0;						\
+	s->slab = NULL;							\
+}									\
+									\
+static inline void clear_ ##slabname(struct slabname *s)		\
+{									\
+	unsigned int i;							\
+	for (i = 0; i < s->slab_count; i++)				\
+		free(s->slab[i]);					\
+	free(s->slab);							\
+	init_ ##slabname(s);						\
+}									\
+									\
+static inline elemtype *slabname## _at(struct slabname *s,		\
+				       const struct commit *c)		\
+{									\
+	unsigned int nth = c->index / COMMIT_SLAB_SIZE;			\
+									\
+	if (s->slab_count <= nth) {					\
+		unsigned int i;						\
+		s->slab = xrealloc(s->slab, (nth + 1) * sizeof(*s->slab)); \
+		for (i = s->slab_count; i <= nth; i++)			\
+			s->slab[i] = NULL;				\
+		s->slab_count = nth + 1;				\
+	}								\
+	if (!s->slab[nth])						\
+		s->slab[nth] = xcalloc(COMMIT_SLAB_SIZE,		\
+				       sizeof(**s->slab));		\
+	return &s->slab[nth][c->index % COMMIT_SLAB_SIZE];		\
+}									\
+									\
+static inline elemtype *slabname## _peek(struct slabname *s,		\
+					 const struct commit *c)	\
+{									\
+	unsigned int nth = c->index / COMMIT_SLAB_SIZE;			\
+									\
+	if (s->slab_count <= nth || !s->slab[nth])			\
+		return NULL;						\
+	return &s->slab[nth][c->index % COMMIT_SLAB_SIZE];		\
+}
+
+#endif
@@ -43,8 +43,10 @@ struct commit *lookup_commit(const unsigned char *sha1)
 	struct object *obj = lookup_object(sha1);
 	if (!obj)
 		return create_object(sha1, OBJ_COMMIT, alloc_commit_node());
-	if (!obj->type)
+	if (!obj->type) {
 		obj->type = OBJ_COMMIT;
+		((struct commit *)obj)->index = alloc_commit_index();
+	}
 	return check_commit(obj, sha1, 0);
 }
 
@@ -236,6 +238,20 @@ int unregister_shallow(const unsigned char *sha1)
 	return 0;
 }
 
+/*
+ * Parent lists are allocated in bulk next to the commits themselves;
+ * free_commit_list() knows to leave such nodes alone.
+ */
+static struct commit_list **append_parent(struct commit *parent,
+					  struct commit_list **pptr)
+{
+	struct commit_list *new_list = alloc_commit_list_node();
+	new_list->item = parent;
+	new_list->next = *pptr;
+	*pptr = new_list;
+	return &new_list->next;
+}
+
 int parse_commit_buffer(struct commit *item, void *buffer, unsigned long size)
 {
 	char *tail = buffer;
@@ -270,7 +286,7 @@ int parse_commit_buffer(struct commit *item, void *buffer, unsigned long size)
 			continue;
 		new_parent = lookup_commit(parent);
 		if (new_parent)
-			pptr = &commit_list_insert(new_parent, pptr)->next;
+			pptr = append_parent(new_parent, pptr);
 	}
 	if (graft) {
 		int i;
@@ -279,7 +295,7 @@ int parse_commit_buffer(struct commit *item, void *buffer, unsigned long size)
 			new_parent = lookup_commit(graft->parent[i]);
 			if (!new_parent)
 				continue;
-			pptr = &commit_list_insert(new_parent, pptr)->next;
+			pptr = append_parent(new_parent, pptr);
 		}
 	}
 	item->date = parse_commit_date(bufptr, tail);
@@ -338,7 +354,8 @@ void free_commit_list(struct commit_list *list)
 	while (list) {
 		struct commit_list *temp = list;
 		list = temp->next;
-		free(temp);
+		if (!is_alloc_commit_list_node(temp))
+			free(temp);
 	}
 }
 
@@ -366,21 +383,29 @@ void sort_by_date(struct commit_list **list)
 	*list = ret;
 }
 
-struct commit *pop_most_recent_commit(struct commit_list **list,
+int compare_commits_by_commit_date(const void *a_, const void *b_, void *unused)
+{
+	const struct commit *a = a_, *b = b_;
+
+	/* newer commits come first */
+	if (a->date < b->date)
+		return 1;
+	else if (a->date > b->date)
+		return -1;
+	return 0;
+}
+
+struct commit *pop_most_recent_commit(struct prio_queue *queue,
 				      unsigned int mark)
 {
-	struct commit *ret = (*list)->item;
+	struct commit *ret = prio_queue_get(queue);
 	struct commit_list *parents = ret->parents;
-	struct commit_list *old = *list;
-
-	*list = (*list)->next;
-	free(old);
 
 	while (parents) {
 		struct commit *commit = parents->item;
 		if (!parse_commit(commit) && !(commit->object.flags & mark)) {
 			commit->object.flags |= mark;
-			insert_by_date(commit, list);
+			prio_queue_put(queue, commit);
 		}
 		parents = parents->next;
 	}
@@ -520,21 +545,22 @@ void sort_in_topological_order(struct commit_list ** list, int lifo)
 
 static const unsigned all_flags = (PARENT1 | PARENT2 | STALE | RESULT);
 
-static struct commit *interesting(struct commit_list *list)
+static int queue_has_nonstale(struct prio_queue *queue)
 {
-	while (list) {
-		struct commit *commit = list->item;
-		list = list->next;
-		if (commit->object.flags & STALE)
-			continue;
-		return commit;
+	int i;
+
+	for (i = 0; i < queue->nr; i++) {
+		struct commit *commit = queue->array[i].data;
+		if (!(commit->object.flags & STALE))
+			return 1;
 	}
-	return NULL;
+	return 0;
 }
 
 static struct commit_list *merge_bases_many(struct commit *one, int n, struct commit **twos)
 {
-	struct commit_list *list = NULL;
+	struct prio_queue queue = { compare_commits_by_commit_date };
+	struct commit_list *list;
 	struct commit_list *result = NULL;
 	int i;
 
@@ -555,23 +581,17 @@ static struct commit_list *merge_bases_many(struct commit *one, int n, struct co
 	}
 
 	one->object.flags |= PARENT1;
-	insert_by_date(one, &list);
+	prio_queue_put(&queue, one);
 	for (i = 0; i < n; i++) {
 		twos[i]->object.flags |= PARENT2;
-		insert_by_date(twos[i], &list);
+		prio_queue_put(&queue, twos[i]);
 	}
 
-	while (interesting(list)) {
-		struct commit *commit;
+	while (queue_has_nonstale(&queue)) {
+		struct commit *commit = prio_queue_get(&queue);
 		struct commit_list *parents;
-		struct commit_list *n;
 		int flags;
 
-		commit = list->item;
-		n = list->next;
-		free(list);
-		list = n;
-
 		flags = commit->object.flags & (PARENT1 | PARENT2 | STALE);
 		if (flags == (PARENT1 | PARENT2)) {
 			if (!(commit->object.flags & RESULT)) {
@@ -587,15 +607,17 @@ static struct commit_list *merge_bases_many(struct commit *one, int n, struct co
 			parents = parents->next;
 			if ((p->object.flags & flags) == flags)
 				continue;
-			if (parse_commit(p))
+			if (parse_commit(p)) {
+				clear_prio_queue(&queue);
 				return NULL;
+			}
 			p->object.flags |= flags;
-			insert_by_date(p, &list);
+			prio_queue_put(&queue, p);
 		}
 	}
 
 	/* Clean up the result to remove stale ones */
-	free_commit_list(list);
+	clear_prio_queue(&queue);
 	list = result; result = NULL;
 	while (list) {
 		struct commit_list *n = list->next;
@@ -5,6 +5,7 @@
 #include "tree.h"
 #include "strbuf.h"
 #include "decorate.h"
+#include "prio-queue.h"
 
 struct commit_list {
 	struct commit *item;
@@ -14,6 +15,7 @@ struct commit_list {
 struct commit {
 	struct object object;
 	void *util;
+	unsigned int index;	/* dense, for commit slabs */
 	unsigned int indegree;
 	unsigned long date;
 	struct commit_list *parents;
@@ -45,9 +47,14 @@ unsigned commit_list_count(const struct commit_list *l);
 struct commit_list * insert_by_date(struct commit *item, struct commit_list **list);
 
 void free_commit_list(struct commit_list *list);
+/* Was this node allocated along with the commits (see alloc.c)? */
+int is_alloc_commit_list_node(const struct commit_list *list);
 
 void sort_by_date(struct commit_list **list);
 
+/* For a prio_queue of commits, most recent first. */
+int compare_commits_by_commit_date(const void *a, const void *b, void *unused);
+
 /* Commit formats */
 enum cmit_fmt {
 	CMIT_FMT_RAW,
@@ -92,10 +99,11 @@ void pp_remainder(enum cmit_fmt fmt,
 		  int indent);
 
 
-/** Removes the first commit from a list sorted by date, and adds all
- * of its parents.
+/** Removes the most recent commit from a queue ordered by
+ * compare_commits_by_commit_date(), and adds those of its parents
+ * that are not yet marked with "mark", marking them.
  **/
-struct commit *pop_most_recent_commit(struct commit_list **list,
+struct commit *pop_most_recent_commit(struct prio_queue *queue,
 				      unsigned int mark);
 
 struct commit *pop_commit(struct commit_list **stack);
@@ -0,0 +1,45 @@
+#ifndef CONVERT_KERNELS_H
+#define CONVERT_KERNELS_H
+
+struct text_stat {
+	/* NUL, CR, LF and CRLF counts */
+	unsigned nul, cr, lf, crlf;
+
+	/* These are just approximations! */
+	unsigned printable, nonprintable;
+};
+
+/*
+ * The statistics, and taking CRs out or putting them in, can also be
+ * done a vector at a time.  Each kernel does what it can of the start
+ * of the buffer and says how far it got; the word-at-a-time and byte
+ * loops of convert.c do the rest, and are all there is when no kernels
+ * are built for the platform.
+ *
+ *  - stats(buf, size, stats) adds to the counts of buf[0..n) and
+ *    returns n.  It may look at buf[n], to see if a CR ends a CRLF.
+ *  - drop_cr(dst, src, len, all, &out) copies src[0..n) to dst less
+ *    its CRs (if "all") or the CRs of its CRLFs, sets out to what it
+ *    wrote and returns n.  dst may be src itself.
+ *  - add_cr(dst, src, len, &out) copies src[0..n) to dst with a CR
+ *    before each LF that has none, sets out to what it wrote and
+ *    returns n.  It may write up to TEXT_KERNEL_SLACK bytes past out.
+ */
+#define TEXT_KERNEL_SLACK 16
+
+struct text_kernels {
+	const char *name;
+	unsigned long (*stats)(const char *buf, unsigned long size,
+			       struct text_stat *stats);
+	size_t (*drop_cr)(char *dst, const char *src, size_t len, int all,
+			  size_t *out);
+	size_t (*add_cr)(char *dst, const char *src, size_t len, size_t *out);
+};
+
+/*
+ * x86/convert-crlf.c: the kernels for this CPU, or NULL if the compiler
+ * could not build them.
+ */
+extern const struct text_kernels *x86_text_kernels(void);
+
+#endif /* CONVERT_KERNELS_H */
@@ -1,6 +1,10 @@
 #include "cache.h"
 #include "attr.h"
 #include "run-command.h"
+#include "pkt-line.h"
+#include "sideband.h"
+#include "sigchain.h"
+#include "convert-kernels.h"
 
 /*
  * convert.c - convert a file when checking it out and checking it in.
@@ -16,21 +20,38 @@
 #define CRLF_TEXT	1
 #define CRLF_INPUT	2
 
-struct text_stat {
-	/* NUL, CR, LF and CRLF counts */
-	unsigned nul, cr, lf, crlf;
+/*
+ * gather_stats() looks at a word of the buffer at a time.  These give
+ * the top bit of each byte of the word that is of interest.  A byte
+ * does not carry into the next one in any of them.
+ */
+#define REPEAT_BYTE(c)	(~0UL / 255 * (c))
+#define LOW_BITS	REPEAT_BYTE(0x7f)
+#define HIGH_BITS	REPEAT_BYTE(0x80)
 
-	/* These are just approximations! */
-	unsigned printable, nonprintable;
-};
+static inline unsigned long bytes_equal(unsigned long w, int c)
+{
+	unsigned long t = w ^ REPEAT_BYTE(c);
+	return ~(((t & LOW_BITS) + LOW_BITS) | t | LOW_BITS);
+}
 
-static void gather_stats(const char *buf, unsigned long size, struct text_stat *stats)
+/* Bytes below 32, and DEL; those with the top bit set are printable */
+static inline unsigned long control_bytes(unsigned long w)
 {
-	unsigned long i;
+	unsigned long ge32 = ((w & LOW_BITS) + REPEAT_BYTE(0x60)) | w;
+	return (~ge32 & HIGH_BITS) | bytes_equal(w, 127);
+}
 
-	memset(stats, 0, sizeof(*stats));
+static inline unsigned count_bytes(unsigned long mask)
+{
+	return (mask >> 7) * REPEAT_BYTE(1) >> (sizeof(mask) - 1) * 8;
+}
 
-	for (i = 0; i < size; i++) {
+static void gather_stats_bytewise(const char *buf, unsigned long i,
+				  unsigned long end, unsigned long size,
+				  struct text_stat *stats)
+{
+	for (; i < end; i++) {
 		unsigned char c = buf[i];
 		if (c == '\r') {
 			stats->cr++;
@@ -61,6 +82,79 @@ static void gather_stats(const char *buf, unsigned long size, struct text_stat *
 		else
 			stats->printable++;
 	}
+}
+
+/*
+ * Words of text, where the only control characters are LF, CR and HT,
+ * are counted as a whole.  One byte past the word is kept in the
+ * buffer, to see if a CR at its end starts a CRLF.
+ */
+static unsigned long gather_stats_words(const char *buf, unsigned long i,
+					unsigned long size,
+					struct text_stat *stats)
+{
+	for (; i + sizeof(unsigned long) < size; i += sizeof(unsigned long)) {
+		unsigned long w, next, ctl, lf, cr;
+
+		memcpy(&w, buf + i, sizeof(w));
+		ctl = control_bytes(w);
+		if (!ctl) {
+			stats->printable += sizeof(w);
+			continue;
+		}
+		lf = bytes_equal(w, '\n');
+		cr = bytes_equal(w, '\r');
+		if (ctl & ~(lf | cr | bytes_equal(w, '\t'))) {
+			gather_stats_bytewise(buf, i, i + sizeof(w), size, stats);
+			continue;
+		}
+		stats->lf += count_bytes(lf);
+		if (cr) {
+			memcpy(&next, buf + i + 1, sizeof(next));
+			stats->cr += count_bytes(cr);
+			stats->crlf += count_bytes(cr & bytes_equal(next, '\n'));
+		}
+		stats->printable += sizeof(w) - count_bytes(lf | cr);
+	}
+	return i;
+}
+
+/* Without vector kernels for the CPU, the loops above do all the work */
+static const struct text_kernels *choose_text_kernels(void)
+{
+	static const struct text_kernels generic = { "generic" };
+	const struct text_kernels *k = NULL;
+
+#ifdef X86_CPU
+	k = x86_text_kernels();
+#endif
+	return k ? k : &generic;
+}
+
+static const struct text_kernels *kernels;
+
+static inline const struct text_kernels *text_kernels_in_use(void)
+{
+	if (!kernels)
+		kernels = choose_text_kernels();
+	return kernels;
+}
+
+const char *convert_text_backend(void)
+{
+	return text_kernels_in_use()->name;
+}
+
+static void gather_stats(const char *buf, unsigned long size, struct text_stat *stats)
+{
+	const struct text_kernels *k = text_kernels_in_use();
+	unsigned long i = 0;
+
+	memset(stats, 0, sizeof(*stats));
+	if (k->stats)
+		i = k->stats(buf, size, stats);
+	i = gather_stats_words(buf, i, size, stats);
+	gather_stats_bytewise(buf, i, size, size, stats);
 
 	/* If file ends with EOF then don't count this EOF as non-printable. */
 	if (size >= 1 && buf[size-1] == '\032')
@@ -123,12 +217,17 @@ static void check_safe_crlf(const char *path, int action,
 static int crlf_to_git(const char *path, const char *src, size_t len,
                        struct strbuf *buf, int action, enum safe_crlf checksafe)
 {
+	const struct text_kernels *k = text_kernels_in_use();
 	struct text_stat stats;
 	char *dst;
 
 	if ((action == CRLF_BINARY) || !auto_crlf || !len)
 		return 0;
 
+	/* A NUL makes a guess binary; memchr() finds one faster */
+	if (action == CRLF_GUESS && memchr(src, '\0', len))
+		return 0;
+
 	gather_stats(src, len, &stats);
 
 	if (action == CRLF_GUESS) {
@@ -157,23 +256,31 @@ static int crlf_to_git(const char *path, const char *src, size_t len,
 	if (strbuf_avail(buf) + buf->len < len)
 		strbuf_grow(buf, len - buf->len);
 	dst = buf->buf;
-	if (action == CRLF_GUESS) {
+	if (k->drop_cr) {
+		size_t out, done = k->drop_cr(dst, src, len,
+					      action == CRLF_GUESS, &out);
+		dst += out;
+		src += done;
+		len -= done;
+	}
+	for (;;) {
+		const char *cr = memchr(src, '\r', len);
+		size_t n = cr ? cr - src : len;
+
+		/* dst may be src itself, running behind it */
+		memmove(dst, src, n);
+		dst += n;
+		if (!cr)
+			break;
 		/*
 		 * If we guessed, we already know we rejected a file with
 		 * lone CR, and we can strip a CR without looking at what
 		 * follow it.
 		 */
-		do {
-			unsigned char c = *src++;
-			if (c != '\r')
-				*dst++ = c;
-		} while (--len);
-	} else {
-		do {
-			unsigned char c = *src++;
-			if (! (c == '\r' && (1 < len && *src == '\n')))
-				*dst++ = c;
-		} while (--len);
+		if (action != CRLF_GUESS && (n + 1 == len || cr[1] != '\n'))
+			*dst++ = '\r';
+		len -= n + 1;
+		src = cr + 1;
 	}
 	strbuf_setlen(buf, dst - buf->buf);
 	return 1;
@@ -182,6 +289,8 @@ static int crlf_to_git(const char *path, const char *src, size_t len,
 static int crlf_to_worktree(const char *path, const char *src, size_t len,
                             struct strbuf *buf, int action)
 {
+	const struct text_kernels *k = text_kernels_in_use();
+	const char *start = src;
 	char *to_free = NULL;
 	struct text_stat stats;
 
@@ -192,6 +301,9 @@ static int crlf_to_worktree(const char *path, const char *src, size_t len,
 	if (!len)
 		return 0;
 
+	if (action == CRLF_GUESS && memchr(src, '\0', len))
+		return 0;
+
 	gather_stats(src, len, &stats);
 
 	/* No LF? Nothing to convert, regardless. */
@@ -215,12 +327,18 @@ static int crlf_to_worktree(const char *path, const char *src, size_t len,
 	if (src == buf->buf)
 		to_free = strbuf_detach(buf, NULL);
 
-	strbuf_grow(buf, len + stats.lf - stats.crlf);
+	strbuf_grow(buf, len + stats.lf - stats.crlf + TEXT_KERNEL_SLACK);
+	if (k->add_cr) {
+		size_t out, done = k->add_cr(buf->buf + buf->len, src, len, &out);
+		strbuf_setlen(buf, buf->len + out);
+		src += done;
+		len -= done;
+	}
 	for (;;) {
 		const char *nl = memchr(src, '\n', len);
 		if (!nl)
 			break;
-		if (nl > src && nl[-1] == '\r') {
+		if (nl > start && nl[-1] == '\r') {
 			strbuf_add(buf, src, nl + 1 - src);
 		} else {
 			strbuf_add(buf, src, nl - src);
@@ -319,13 +437,256 @@ static int apply_filter(const char *path, const char *src, size_t len,
 	return ret;
 }
 
+/*
+ * A filter driver with a "process" command is started once and kept
+ * running, and is handed one file after another over its stdin and
+ * stdout in pkt-line packets, instead of running a command per file.
+ * See "Long Running Filter Process" in gitattributes(5).
+ */
+#define CAP_CLEAN	(1u<<0)
+#define CAP_SMUDGE	(1u<<1)
+
+static struct filter_process {
+	struct filter_process *next;
+	const char *cmd;
+	const char *argv[4];
+	struct child_process process;
+	unsigned capabilities;
+} *filter_processes;
+
+static int write_filter_line(int fd, const char *key, const char *value)
+{
+	struct strbuf line = STRBUF_INIT;
+	int ret;
+
+	if (value)
+		strbuf_addf(&line, "%s=%s\n", key, value);
+	else
+		strbuf_addf(&line, "%s\n", key);
+	ret = packet_write_gently(fd, line.buf, line.len);
+	strbuf_release(&line);
+	return ret;
+}
+
+/*
+ * Read a text packet without its LF; return 0 at a flush packet and
+ * -1 if the filter went away.
+ */
+static int read_filter_line(int fd, char *buf, unsigned size)
+{
+	int len = packet_read_gently(fd, buf, size);
+	if (0 < len && buf[len - 1] == '\n')
+		buf[--len] = '\0';
+	return len;
+}
+
+/*
+ * Read a list of "key=value" lines up to a flush packet; the last
+ * "status=" line, if any, is copied to "status".
+ */
+static int read_filter_status(int fd, char *status, unsigned size)
+{
+	char line[1000];
+	int len;
+
+	while ((len = read_filter_line(fd, line, sizeof(line))) > 0)
+		if (!prefixcmp(line, "status="))
+			strlcpy(status, line + 7, size);
+	return len;
+}
+
+static void stop_filter_process(struct filter_process *fp)
+{
+	struct filter_process **pp;
+
+	for (pp = &filter_processes; *pp; pp = &(*pp)->next)
+		if (*pp == fp) {
+			*pp = fp->next;
+			break;
+		}
+	close(fp->process.in);
+	close(fp->process.out);
+	finish_command(&fp->process);
+	free(fp);
+}
+
+static void stop_filter_processes(void)
+{
+	while (filter_processes)
+		stop_filter_process(filter_processes);
+}
+
+static int filter_handshake(struct filter_process *fp)
+{
+	int in = fp->process.out, out = fp->process.in;
+	char line[1000];
+	int len, version = 0;
+
+	if (write_filter_line(out, "git-filter-client", NULL) ||
+	    write_filter_line(out, "version", "2") ||
+	    packet_flush_gently(out))
+		return -1;
+
+	if (read_filter_line(in, line, sizeof(line)) <= 0 ||
+	    strcmp(line, "git-filter-server"))
+		return -1;
+	while ((len = read_filter_line(in, line, sizeof(line))) > 0)
+		if (!strcmp(line, "version=2"))
+			version = 2;
+	if (len < 0 || version != 2)
+		return -1;
+
+	if (write_filter_line(out, "capability", "clean") ||
+	    write_filter_line(out, "capability", "smudge") ||
+	    packet_flush_gently(out))
+		return -1;
+	while ((len = read_filter_line(in, line, sizeof(line))) > 0) {
+		if (!strcmp(line, "capability=clean"))
+			fp->capabilities |= CAP_CLEAN;
+		else if (!strcmp(line, "capability=smudge"))
+			fp->capabilities |= CAP_SMUDGE;
+	}
+	return len;
+}
+
+static void set_close_on_exec(int fd)
+{
+	int flags = fcntl(fd, F_GETFD, 0);
+	if (flags != -1)
+		fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+}
+
+static struct filter_process *start_filter_process(const char *cmd)
+{
+	static int registered;
+	struct filter_process *fp;
+
+	for (fp = filter_processes; fp; fp = fp->next)
+		if (!strcmp(fp->cmd, cmd))
+			return fp;
+
+	fp = xcalloc(1, sizeof(*fp));
+	fp->cmd = cmd;
+	fp->argv[0] = "sh";
+	fp->argv[1] = "-c";
+	fp->argv[2] = cmd;
+	fp->process.argv = fp->argv;
+	fp->process.in = -1;
+	fp->process.out = -1;
+
+	fflush(NULL);
+	if (start_command(&fp->process)) {
+		error("cannot fork to run external filter %s", cmd);
+		free(fp);
+		return NULL;
+	}
+	/* Other children must not keep it from seeing us go away */
+	set_close_on_exec(fp->process.in);
+	set_close_on_exec(fp->process.out);
+	fp->next = filter_processes;
+	filter_processes = fp;
+	if (!registered) {
+		atexit(stop_filter_processes);
+		registered = 1;
+	}
+
+	sigchain_push(SIGPIPE, SIG_IGN);
+	if (filter_handshake(fp)) {
+		sigchain_pop(SIGPIPE);
+		error("initialization for external filter %s failed", cmd);
+		stop_filter_process(fp);
+		return NULL;
+	}
+	sigchain_pop(SIGPIPE);
+	return fp;
+}
+
+/*
+ * Have the filter process run by "cmd" convert the buffer.  The
+ * filter answers "status=error" for a file it could not convert, and
+ * "status=abort" if it does not want any more files of this kind;
+ * either way the contents are left alone.  If it goes away or breaks
+ * the protocol, it is stopped, and started again for the next file.
+ */
+static int apply_process_filter(const char *path, const char *src, size_t len,
+				struct strbuf *dst, const char *cmd,
+				unsigned wanted)
+{
+	struct filter_process *fp;
+	struct strbuf nbuf = STRBUF_INIT;
+	char status[100], *buf;
+	int in, out, n, ret = 0;
+
+	fp = start_filter_process(cmd);
+	if (!fp || !(fp->capabilities & wanted))
+		return 0;
+	in = fp->process.out;
+	out = fp->process.in;
+	buf = xmalloc(LARGE_PACKET_MAX);
+	*status = '\0';
+
+	sigchain_push(SIGPIPE, SIG_IGN);
+	if (write_filter_line(out, "command",
+			      wanted == CAP_CLEAN ? "clean" : "smudge") ||
+	    write_filter_line(out, "pathname", path) ||
+	    packet_flush_gently(out) ||
+	    packet_write_gently(out, src, len) ||
+	    packet_flush_gently(out) ||
+	    read_filter_status(in, status, sizeof(status)))
+		goto broken;
+	if (!strcmp(status, "success")) {
+		strbuf_grow(&nbuf, len);
+		while ((n = packet_read_gently(in, buf, LARGE_PACKET_MAX)) > 0)
+			strbuf_add(&nbuf, buf, n);
+		if (n || read_filter_status(in, status, sizeof(status)))
+			goto broken;
+	}
+
+	if (!strcmp(status, "success")) {
+		strbuf_swap(dst, &nbuf);
+		ret = 1;
+	} else if (!strcmp(status, "abort")) {
+		fp->capabilities &= ~wanted;
+	} else if (strcmp(status, "error")) {
+		goto broken;
+	}
+	goto done;
+
+broken:
+	error("external filter %s failed", cmd);
+	stop_filter_process(fp);
+done:
+	sigchain_pop(SIGPIPE);
+	strbuf_release(&nbuf);
+	free(buf);
+	return ret;
+}
+
 static struct convert_driver {
 	const char *name;
 	struct convert_driver *next;
 	const char *smudge;
 	const char *clean;
+	const char *process;
 } *user_convert, **user_convert_tail;
 
+/*
+ * Run the clean (CAP_CLEAN) or smudge (CAP_SMUDGE) side of the
+ * driver, if it has one.
+ */
+static int apply_convert_driver(const char *path, const char *src, size_t len,
+				struct strbuf *dst, struct convert_driver *drv,
+				unsigned wanted)
+{
+	if (!drv)
+		return 0;
+	if (drv->process)
+		return apply_process_filter(path, src, len, dst,
+					    drv->process, wanted);
+	return apply_filter(path, src, len, dst,
+			    wanted == CAP_CLEAN ? drv->clean : drv->smudge);
+}
+
 static int read_convert_config(const char *var, const char *value, void *cb)
 {
 	const char *ep, *name;
@@ -359,6 +720,8 @@ static int read_convert_config(const char *var, const char *value, void *cb)
 	 *	command-line
 	 *
 	 * The command-line will not be interpolated in any way.
+	 * filter.<name>.process is the command line of a filter
+	 * process that does both, and wins over them.
 	 */
 
 	if (!strcmp("smudge", ep))
@@ -367,6 +730,9 @@ static int read_convert_config(const char *var, const char *value, void *cb)
 	if (!strcmp("clean", ep))
 		return git_config_string(&drv->clean, var, value);
 
+	if (!strcmp("process", ep))
+		return git_config_string(&drv->process, var, value);
+
 	return 0;
 }
 
@@ -572,19 +938,16 @@ int convert_to_git(const char *path, const char *src, size_t len,
 	struct git_attr_check check[3];
 	int crlf = CRLF_GUESS;
 	int ident = 0, ret = 0;
-	const char *filter = NULL;
+	struct convert_driver *drv = NULL;
 
 	setup_convert_check(check);
 	if (!git_checkattr(path, ARRAY_SIZE(check), check)) {
-		struct convert_driver *drv;
 		crlf = git_path_check_crlf(path, check + 0);
 		ident = git_path_check_ident(path, check + 1);
 		drv = git_path_check_convert(path, check + 2);
-		if (drv && drv->clean)
-			filter = drv->clean;
 	}
 
-	ret |= apply_filter(path, src, len, dst, filter);
+	ret |= apply_convert_driver(path, src, len, dst, drv, CAP_CLEAN);
 	if (ret) {
 		src = dst->buf;
 		len = dst->len;
@@ -602,16 +965,13 @@ int convert_to_working_tree(const char *path, const char *src, size_t len, struc
 	struct git_attr_check check[3];
 	int crlf = CRLF_GUESS;
 	int ident = 0, ret = 0;
-	const char *filter = NULL;
+	struct convert_driver *drv = NULL;
 
 	setup_convert_check(check);
 	if (!git_checkattr(path, ARRAY_SIZE(check), check)) {
-		struct convert_driver *drv;
 		crlf = git_path_check_crlf(path, check + 0);
 		ident = git_path_check_ident(path, check + 1);
 		drv = git_path_check_convert(path, check + 2);
-		if (drv && drv->smudge)
-			filter = drv->smudge;
 	}
 
 	ret |= ident_to_worktree(path, src, len, dst, ident);
@@ -624,5 +984,38 @@ int convert_to_working_tree(const char *path, const char *src, size_t len, struc
 		src = dst->buf;
 		len = dst->len;
 	}
-	return ret | apply_filter(path, src, len, dst, filter);
+	return ret | apply_convert_driver(path, src, len, dst, drv, CAP_SMUDGE);
+}
+
+/*
+ * Would convert_to_git() (to_worktree == 0) or convert_to_working_tree()
+ * (to_worktree != 0) leave the contents of "path" alone, whatever they
+ * are?  Callers that want to stream a blob without looking at it as a
+ * whole use this to decide whether they can.
+ */
+int convert_is_identity(const char *path, int to_worktree)
+{
+	struct git_attr_check check[3];
+	int crlf = CRLF_GUESS;
+	int ident = 0;
+	const char *filter = NULL;
+
+	setup_convert_check(check);
+	if (!git_checkattr(path, ARRAY_SIZE(check), check)) {
+		struct convert_driver *drv;
+		crlf = git_path_check_crlf(path, check + 0);
+		ident = git_path_check_ident(path, check + 1);
+		drv = git_path_check_convert(path, check + 2);
+		if (drv && drv->process)
+			filter = drv->process;
+		else if (drv)
+			filter = to_worktree ? drv->smudge : drv->clean;
+	}
+	if (filter || ident)
+		return 0;
+	if (crlf == CRLF_BINARY)
+		return 1;
+	if (to_worktree)
+		return crlf == CRLF_INPUT || auto_crlf <= 0;
+	return !auto_crlf;
 }
@@ -171,6 +171,7 @@ void add_exclude(const char *string, const char *base,
 	x->base = base;
 	x->baselen = baselen;
 	x->flags = flags;
+	x->bucket = NULL;
 	if (!strchr(string, '/'))
 		x->flags |= EXC_FLAG_NODIR;
 	if (no_wildcard(string))
@@ -236,6 +237,45 @@ void add_excludes_from_file(struct dir_struct *dir, const char *fname)
 		die("cannot use %s as an exclude file", fname);
 }
 
+static void compile_excludes(struct exclude_list *el)
+{
+	for (; el->compiled < el->nr; el->compiled++) {
+		struct exclude *x = el->excludes[el->compiled];
+		const char *dot;
+
+		if (!(x->flags & EXC_FLAG_NODIR))
+			; /* matched against the whole path */
+		else if (x->flags & EXC_FLAG_NOWILDCARD) {
+			x->bucket = add_basename_pattern(&el->patterns,
+							 x->pattern,
+							 el->compiled);
+			continue;
+		} else if ((x->flags & EXC_FLAG_ENDSWITH) &&
+			   (dot = strrchr(x->pattern, '.'))) {
+			x->bucket = add_extension_pattern(&el->patterns,
+							  dot + 1,
+							  el->compiled);
+			continue;
+		}
+		add_glob_pattern(&el->patterns, el->compiled);
+	}
+}
+
+/*
+ * Drop the last pattern of the list.  Being the last, it is also the
+ * last of its bucket or of the globs, if it has been compiled.
+ */
+static void pop_exclude(struct exclude_list *el)
+{
+	struct exclude *x = el->excludes[--el->nr];
+
+	if (el->nr < el->compiled) {
+		el->compiled = el->nr;
+		drop_last_pattern(&el->patterns, x->bucket);
+	}
+	free(x);
+}
+
 static void prep_exclude(struct dir_struct *dir, const char *base, int baselen)
 {
 	struct exclude_list *el;
@@ -254,7 +294,7 @@ static void prep_exclude(struct dir_struct *dir, const char *base, int baselen)
 			break;
 		dir->exclude_stack = stk->prev;
 		while (stk->exclude_ix < el->nr)
-			free(el->excludes[--el->nr]);
+			pop_exclude(el);
 		free(stk->filebuf);
 		free(stk);
 	}
@@ -290,6 +330,50 @@ static void prep_exclude(struct dir_struct *dir, const char *base, int baselen)
 	dir->basebuf[baselen] = '\0';
 }
 
+static int match_exclude(struct exclude *x, const char *pathname,
+			 int pathlen, const char *basename, int *dtype)
+{
+	const char *exclude = x->pattern;
+
+	if (x->flags & EXC_FLAG_MUSTBEDIR) {
+		if (*dtype == DT_UNKNOWN)
+			*dtype = get_dtype(NULL, pathname);
+		if (*dtype != DT_DIR)
+			return 0;
+	}
+
+	if (x->flags & EXC_FLAG_NODIR) {
+		/* match basename */
+		if (x->flags & EXC_FLAG_NOWILDCARD)
+			return !strcmp(exclude, basename);
+		else if (x->flags & EXC_FLAG_ENDSWITH)
+			return x->patternlen - 1 <= pathlen &&
+				!strcmp(exclude + 1, pathname + pathlen - x->patternlen + 1);
+		else
+			return fnmatch(exclude, basename, 0) == 0;
+	}
+	else {
+		/* match with FNM_PATHNAME:
+		 * exclude has base (baselen long) implicitly
+		 * in front of it.
+		 */
+		int baselen = x->baselen;
+		if (*exclude == '/')
+			exclude++;
+
+		if (pathlen < baselen ||
+		    (baselen && pathname[baselen-1] != '/') ||
+		    strncmp(pathname, x->base, baselen))
+			return 0;
+
+		if (x->flags & EXC_FLAG_NOWILDCARD)
+			return !strcmp(exclude, pathname + baselen);
+		else
+			return fnmatch(exclude, pathname+baselen,
+				       FNM_PATHNAME) == 0;
+	}
+}
+
 /* Scan the list and let the last match determines the fate.
  * Return 1 for exclude, 0 for include and -1 for undecided.
  */
@@ -297,59 +381,18 @@ static int excluded_1(const char *pathname,
 		      int pathlen, const char *basename, int *dtype,
 		      struct exclude_list *el)
 {
+	struct pattern_candidates c;
 	int i;
 
-	if (el->nr) {
-		for (i = el->nr - 1; 0 <= i; i--) {
-			struct exclude *x = el->excludes[i];
-			const char *exclude = x->pattern;
-			int to_exclude = x->to_exclude;
-
-			if (x->flags & EXC_FLAG_MUSTBEDIR) {
-				if (*dtype == DT_UNKNOWN)
-					*dtype = get_dtype(NULL, pathname);
-				if (*dtype != DT_DIR)
-					continue;
-			}
-
-			if (x->flags & EXC_FLAG_NODIR) {
-				/* match basename */
-				if (x->flags & EXC_FLAG_NOWILDCARD) {
-					if (!strcmp(exclude, basename))
-						return to_exclude;
-				} else if (x->flags & EXC_FLAG_ENDSWITH) {
-					if (x->patternlen - 1 <= pathlen &&
-					    !strcmp(exclude + 1, pathname + pathlen - x->patternlen + 1))
-						return to_exclude;
-				} else {
-					if (fnmatch(exclude, basename, 0) == 0)
-						return to_exclude;
-				}
-			}
-			else {
-				/* match with FNM_PATHNAME:
-				 * exclude has base (baselen long) implicitly
-				 * in front of it.
-				 */
-				int baselen = x->baselen;
-				if (*exclude == '/')
-					exclude++;
-
-				if (pathlen < baselen ||
-				    (baselen && pathname[baselen-1] != '/') ||
-				    strncmp(pathname, x->base, baselen))
-				    continue;
-
-				if (x->flags & EXC_FLAG_NOWILDCARD) {
-					if (!strcmp(exclude, pathname + baselen))
-						return to_exclude;
-				} else {
-					if (fnmatch(exclude, pathname+baselen,
-						    FNM_PATHNAME) == 0)
-					    return to_exclude;
-				}
-			}
-		}
+	if (!el->nr)
+		return -1; /* undecided */
+	compile_excludes(el);
+	init_pattern_candidates(&c, &el->patterns, basename,
+				pathlen - (basename - pathname));
+	while (0 <= (i = next_pattern_candidate(&c))) {
+		struct exclude *x = el->excludes[i];
+		if (match_exclude(x, pathname, pathlen, basename, dtype))
+			return x->to_exclude;
 	}
 	return -1; /* undecided */
 }
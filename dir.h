@@ -1,6 +1,8 @@
 #ifndef DIR_H
 #define DIR_H
 
+#include "pattern-bucket.h"
+
 struct dir_entry {
 	unsigned int len;
 	char name[FLEX_ARRAY]; /* more */
@@ -21,7 +23,16 @@ struct exclude_list {
 		int baselen;
 		int to_exclude;
 		int flags;
+		struct pattern_bucket *bucket;	/* NULL if among globs */
 	} **excludes;
+
+	/*
+	 * excludes[] up to "compiled" are also filed by basename and
+	 * by extension, or kept as globs, so that excluded() need not
+	 * try every pattern.
+	 */
+	int compiled;
+	struct pattern_buckets patterns;
 };
 
 struct exclude_stack {
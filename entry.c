@@ -1,5 +1,6 @@
 #include "cache.h"
 #include "blob.h"
+#include "streaming.h"
 #include "dir.h"
 
 static void create_directories(const char *path, int path_len,
@@ -91,6 +92,56 @@ static void *read_blob_entry(struct cache_entry *ce, unsigned long *size)
 	return NULL;
 }
 
+static int open_output_fd(char *path, struct cache_entry *ce, int to_tempfile)
+{
+	int symlink = (ce->ce_mode & S_IFMT) != S_IFREG;
+	if (to_tempfile) {
+		strcpy(path, symlink
+		       ? ".merge_link_XXXXXX" : ".merge_file_XXXXXX");
+		return mkstemp(path);
+	} else {
+		return create_file(path, !symlink ? ce->ce_mode : 0666);
+	}
+}
+
+/*
+ * Write out a large blob that needs no conversion without reading
+ * it into core as a whole.  Returns 1 with nothing written if the
+ * blob is not a candidate for streaming, so that the caller can use
+ * the usual code path instead.
+ */
+static int streaming_write_entry(struct cache_entry *ce, char *path,
+				 const struct checkout *state, int to_tempfile,
+				 int *fstat_done, struct stat *statbuf)
+{
+	unsigned long size;
+	int result, fd;
+
+	if (sha1_object_info(ce->sha1, &size) != OBJ_BLOB ||
+	    size <= big_file_threshold ||
+	    !convert_is_identity(ce->name, 1))
+		return 1;
+
+	fd = open_output_fd(path, ce, to_tempfile);
+	if (fd < 0)
+		return error("git checkout-index: unable to create file %s (%s)",
+			     path, strerror(errno));
+
+	result = stream_blob_to_fd(fd, ce->sha1);
+	if (!result && fstat_is_reliable() &&
+	    state->refresh_cache && !to_tempfile && !state->base_dir_len) {
+		fstat(fd, statbuf);
+		*fstat_done = 1;
+	}
+	if (close(fd))
+		result = -1;
+	if (result) {
+		unlink(path);
+		return error("git checkout-index: unable to write file %s", path);
+	}
+	return 0;
+}
+
 static int write_entry(struct cache_entry *ce, char *path, const struct checkout *state, int to_tempfile)
 {
 	unsigned int ce_mode_s_ifmt = ce->ce_mode & S_IFMT;
@@ -103,6 +154,13 @@ static int write_entry(struct cache_entry *ce, char *path, const struct checkout
 
 	switch (ce_mode_s_ifmt) {
 	case S_IFREG:
+		ret = streaming_write_entry(ce, path, state, to_tempfile,
+					    &fstat_done, &st);
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			break;
+		/* not streamed; fallthrough */
 	case S_IFLNK:
 		new = read_blob_entry(ce, &size);
 		if (!new)
@@ -128,17 +186,7 @@ static int write_entry(struct cache_entry *ce, char *path, const struct checkout
 			size = newsize;
 		}
 
-		if (to_tempfile) {
-			if (ce_mode_s_ifmt == S_IFREG)
-				strcpy(path, ".merge_file_XXXXXX");
-			else
-				strcpy(path, ".merge_link_XXXXXX");
-			fd = mkstemp(path);
-		} else if (ce_mode_s_ifmt == S_IFREG) {
-			fd = create_file(path, ce->ce_mode);
-		} else {
-			fd = create_file(path, 0666);
-		}
+		fd = open_output_fd(path, ce, to_tempfile);
 		if (fd < 0) {
 			free(new);
 			return error("git checkout-index: unable to create file %s (%s)",
@@ -153,6 +153,11 @@ Format of STDIN stream:
 #include "quote.h"
 #include "exec_cmd.h"
 
+#ifdef THREADED_DELTA_SEARCH
+#include "thread-utils.h"
+#include <pthread.h>
+#endif
+
 #define PACK_ID_BITS 16
 #define MAX_PACK_ID ((1<<PACK_ID_BITS)-1)
 #define DEPTH_BITS 13
@@ -165,6 +170,7 @@ struct object_entry
 	uint32_t type : TYPE_BITS,
 		pack_id : PACK_ID_BITS,
 		depth : DEPTH_BITS;
+	unsigned pending : 1; /* queued, offset not known yet */
 	unsigned char sha1[20];
 };
 
@@ -185,12 +191,77 @@ struct mark_set
 	unsigned int shift;
 };
 
+/*
+ * A mark database is a header and a table of mark records sorted by
+ * mark, which find_mark() searches in place.  Marks set after the
+ * table was written are appended to "<file>.log" at each checkpoint
+ * and folded into the table at the end of an import, once the log
+ * has grown large enough.  All fields are in network byte order.
+ */
+#define MARK_DB_SIGNATURE 0x46494d4b	/* "FIMK" */
+#define MARK_DB_VERSION 1
+
+struct mark_db_header
+{
+	uint32_t signature;
+	uint32_t version;
+};
+
+struct mark_record
+{
+	uint32_t mark[2]; /* high word first */
+	unsigned char sha1[20];
+	uint32_t type;
+};
+
 struct last_object
 {
 	struct strbuf data;
-	uint32_t offset;
+	struct object_entry *e;
 	unsigned int depth;
-	unsigned no_swap : 1;
+};
+
+/*
+ * Object contents shared between the compression queue and the
+ * window of recent blobs; whichever lets go last frees it.
+ */
+struct object_data
+{
+	struct strbuf buf;
+	unsigned int refs;
+};
+
+struct delta_base
+{
+	struct object_entry *e;
+	struct object_data *data;
+};
+
+struct pending_object
+{
+	struct pending_object *next;
+	struct object_entry *e;
+	struct object_data *data;
+	unsigned long max_size;
+
+	/* Filled in by compress_object(), possibly on another thread. */
+	void *out;
+	unsigned long out_len;
+	unsigned long delta_len;
+	int base;
+	unsigned done : 1;
+	unsigned same_path : 1; /* bases[0] is an earlier version */
+
+	unsigned int nr_bases;
+	struct delta_base bases[FLEX_ARRAY]; /* more */
+};
+
+struct blob_slot
+{
+	struct object_data *data;
+	struct object_entry *e;
+	char *path;
+	unsigned long age;
 };
 
 struct mem_pool
@@ -314,9 +385,23 @@ static struct object_entry_pool *blocks;
 static struct object_entry *object_table[1 << 16];
 static struct mark_set *marks;
 static const char *mark_file;
-
-/* Our last blob */
-static struct last_object last_blob = { STRBUF_INIT, 0, 0, 0 };
+static const char *mark_db_file;
+static char *mark_db_log_file;
+static struct mark_record *mark_db;
+static size_t mark_db_nr;
+static size_t mark_db_log_nr;
+static struct strbuf mark_db_log = STRBUF_INIT;
+
+/* Our last blobs */
+static unsigned int delta_window = 1;
+static struct blob_slot *blob_window;
+static unsigned long blob_window_age;
+
+/* Objects waiting to be compressed or written, in stream order */
+static int compression_threads = 1;
+static struct pending_object *queue_head, *queue_tail, *queue_next;
+static unsigned int queue_nr;
+static unsigned long queue_max_size;
 
 /* Tree management */
 static unsigned int tree_entry_alloc = 1000;
@@ -452,6 +537,8 @@ static void write_crash_report(const char *err)
 	fputs("-----\n", rpt);
 	if (mark_file)
 		fprintf(rpt, "  exported to %s\n", mark_file);
+	else if (mark_db_file)
+		fprintf(rpt, "  kept in %s\n", mark_db_file);
 	else
 		dump_marks_helper(rpt, 0, marks);
 
@@ -462,6 +549,8 @@ static void write_crash_report(const char *err)
 }
 
 static void end_packfile(void);
+static void flush_pending_objects(void);
+static void clear_blob_window(void);
 static void unkeep_all_packs(void);
 static void dump_marks(void);
 
@@ -536,6 +625,7 @@ static struct object_entry *insert_object(unsigned char *sha1)
 	e = new_object(sha1);
 	e->next = NULL;
 	e->offset = 0;
+	e->pending = 0;
 	if (p)
 		p->next = e;
 	else
@@ -620,6 +710,63 @@ static void insert_mark(uintmax_t idnum, struct object_entry *oe)
 	s->data.marked[idnum] = oe;
 }
 
+static uintmax_t mark_record_mark(const struct mark_record *r)
+{
+	return ((uintmax_t)ntohl(r->mark[0]) << 32) | ntohl(r->mark[1]);
+}
+
+static struct object_entry *mark_record_object(struct mark_record *r)
+{
+	struct object_entry *e = find_object(r->sha1);
+	uint32_t type = ntohl(r->type);
+
+	if (e)
+		return e;
+	if (type < OBJ_COMMIT || type > OBJ_TAG)
+		die("corrupt mark database %s", mark_db_file);
+	e = insert_object(r->sha1);
+	e->type = type;
+	e->pack_id = MAX_PACK_ID;
+	e->offset = 1; /* just not zero! */
+	return e;
+}
+
+static struct object_entry *find_mark_in_db(uintmax_t idnum)
+{
+	size_t lo = 0, hi = mark_db_nr;
+
+	while (lo < hi) {
+		size_t mi = lo + (hi - lo) / 2;
+		uintmax_t mark = mark_record_mark(&mark_db[mi]);
+		if (mark == idnum) {
+			struct object_entry *e = mark_record_object(&mark_db[mi]);
+			insert_mark(idnum, e);
+			return e;
+		}
+		if (mark < idnum)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+	return NULL;
+}
+
+/* Remember a newly set mark for the next checkpoint. */
+static void log_mark(uintmax_t idnum,
+	const unsigned char *sha1,
+	enum object_type type)
+{
+	struct mark_record r;
+
+	if (!mark_db_file)
+		return;
+	r.mark[0] = htonl((uint32_t)(idnum >> 32));
+	r.mark[1] = htonl((uint32_t)idnum);
+	hashcpy(r.sha1, sha1);
+	r.type = htonl(type);
+	strbuf_add(&mark_db_log, &r, sizeof(r));
+}
+
 static struct object_entry *find_mark(uintmax_t idnum)
 {
 	uintmax_t orig_idnum = idnum;
@@ -634,6 +781,8 @@ static struct object_entry *find_mark(uintmax_t idnum)
 		if (s)
 			oe = s->data.marked[idnum];
 	}
+	if (!oe && mark_db)
+		oe = find_mark_in_db(orig_idnum);
 	if (!oe)
 		die("mark :%" PRIuMAX " not declared", orig_idnum);
 	return oe;
@@ -939,6 +1088,7 @@ static void end_packfile(void)
 {
 	struct packed_git *old_p = pack_data, *new_p;
 
+	flush_pending_objects();
 	clear_delta_base_cache();
 	if (object_count) {
 		char *idx_name;
@@ -986,9 +1136,7 @@ static void end_packfile(void)
 	free(old_p);
 
 	/* We can't carry a delta across packfiles. */
-	strbuf_release(&last_blob.data);
-	last_blob.offset = 0;
-	last_blob.depth = 0;
+	clear_blob_window();
 }
 
 static void cycle_packfile(void)
@@ -1020,20 +1168,293 @@ static size_t encode_header(
 	return n;
 }
 
-static int store_object(
+static struct object_data *new_object_data(void)
+{
+	struct object_data *d = xmalloc(sizeof(*d));
+	strbuf_init(&d->buf, 0);
+	d->refs = 1;
+	return d;
+}
+
+static void put_object_data(struct object_data *d)
+{
+	if (d && !--d->refs) {
+		strbuf_release(&d->buf);
+		free(d);
+	}
+}
+
+static void clear_blob_window(void)
+{
+	unsigned int i;
+
+	if (!blob_window)
+		return;
+	for (i = 0; i < delta_window; i++) {
+		struct blob_slot *slot = &blob_window[i];
+		put_object_data(slot->data);
+		free(slot->path);
+		memset(slot, 0, sizeof(*slot));
+	}
+}
+
+static void *deflate_buffer(void *in, unsigned long len, unsigned long *out_len)
+{
+	z_stream s;
+	void *out;
+
+	memset(&s, 0, sizeof(s));
+	deflateInit(&s, pack_compression_level);
+	s.next_in = in;
+	s.avail_in = len;
+	s.avail_out = deflateBound(&s, s.avail_in);
+	s.next_out = out = xmalloc(s.avail_out);
+	while (deflate(&s, Z_FINISH) == Z_OK)
+		/* nothing */;
+	deflateEnd(&s);
+	*out_len = s.total_out;
+	return out;
+}
+
+/*
+ * Deltify against the base giving the smallest delta, if any is
+ * smaller than the object itself, and deflate the result.  A delta
+ * against an earlier version of the same path is taken without
+ * looking further.  Only the object and its bases are looked at, so
+ * this can run on a thread of its own.
+ */
+static void compress_object(struct pending_object *po)
+{
+	struct strbuf *dat = &po->data->buf;
+	void *delta = NULL;
+	unsigned int i;
+
+	po->base = -1;
+	for (i = 0; i < po->nr_bases; i++) {
+		struct strbuf *src = &po->bases[i].data->buf;
+		unsigned long size, max = delta ? po->delta_len : dat->len;
+		void *d = diff_delta(src->buf, src->len,
+			dat->buf, dat->len,
+			&size, max - 1);
+		if (!d)
+			continue;
+		if (size >= max) {
+			free(d);
+			continue;
+		}
+		free(delta);
+		delta = d;
+		po->delta_len = size;
+		po->base = i;
+		if (po->same_path && !i)
+			break;
+	}
+
+	if (delta) {
+		po->out = deflate_buffer(delta, po->delta_len, &po->out_len);
+		free(delta);
+	} else
+		po->out = deflate_buffer(dat->buf, dat->len, &po->out_len);
+}
+
+static void write_object(struct pending_object *po)
+{
+	struct object_entry *e = po->e;
+	unsigned char hdr[96];
+	unsigned long hdrlen;
+	unsigned int i;
+
+	e->offset = pack_size;
+	e->pending = 0;
+	object_count++;
+	object_count_by_type[e->type]++;
+
+	if (po->base >= 0) {
+		struct object_entry *base = po->bases[po->base].e;
+		unsigned long ofs = e->offset - base->offset;
+		unsigned pos = sizeof(hdr) - 1;
+
+		delta_count_by_type[e->type]++;
+		e->depth = base->depth + 1;
+
+		hdrlen = encode_header(OBJ_OFS_DELTA, po->delta_len, hdr);
+		write_or_die(pack_data->pack_fd, hdr, hdrlen);
+		pack_size += hdrlen;
+
+		hdr[pos] = ofs & 127;
+		while (ofs >>= 7)
+			hdr[--pos] = 128 | (--ofs & 127);
+		write_or_die(pack_data->pack_fd, hdr + pos, sizeof(hdr) - pos);
+		pack_size += sizeof(hdr) - pos;
+	} else {
+		e->depth = 0;
+		hdrlen = encode_header(e->type, po->data->buf.len, hdr);
+		write_or_die(pack_data->pack_fd, hdr, hdrlen);
+		pack_size += hdrlen;
+	}
+
+	write_or_die(pack_data->pack_fd, po->out, po->out_len);
+	pack_size += po->out_len;
+
+	free(po->out);
+	put_object_data(po->data);
+	for (i = 0; i < po->nr_bases; i++)
+		put_object_data(po->bases[i].data);
+	free(po);
+}
+
+#ifdef THREADED_DELTA_SEARCH
+
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_done = PTHREAD_COND_INITIALIZER;
+static pthread_t *compressors;
+static int compressors_stop;
+
+#define queue_lock()		pthread_mutex_lock(&queue_mutex)
+#define queue_unlock()		pthread_mutex_unlock(&queue_mutex)
+
+static void *run_compressor(void *unused)
+{
+	queue_lock();
+	for (;;) {
+		struct pending_object *po = queue_next;
+
+		if (!po) {
+			if (compressors_stop)
+				break;
+			pthread_cond_wait(&queue_work, &queue_mutex);
+			continue;
+		}
+		queue_next = po->next;
+		queue_unlock();
+		compress_object(po);
+		queue_lock();
+		po->done = 1;
+		pthread_cond_signal(&queue_done);
+	}
+	queue_unlock();
+	return NULL;
+}
+
+static void start_compressors(void)
+{
+	int i;
+
+	if (compression_threads <= 1)
+		return;
+	compressors = xcalloc(compression_threads, sizeof(*compressors));
+	for (i = 0; i < compression_threads; i++) {
+		int ret = pthread_create(&compressors[i], NULL,
+					 run_compressor, NULL);
+		if (ret)
+			die("unable to create thread: %s", strerror(ret));
+	}
+}
+
+static void stop_compressors(void)
+{
+	int i;
+
+	if (!compressors)
+		return;
+	queue_lock();
+	compressors_stop = 1;
+	pthread_cond_broadcast(&queue_work);
+	queue_unlock();
+	for (i = 0; i < compression_threads; i++)
+		pthread_join(compressors[i], NULL);
+	free(compressors);
+	compressors = NULL;
+}
+
+#else
+
+#define queue_lock()		(void)0
+#define queue_unlock()		(void)0
+#define start_compressors()	(void)0
+#define stop_compressors()	(void)0
+
+#endif
+
+/*
+ * Write out the objects at the front of the queue that have been
+ * compressed.  Unless all of them must go, only wait for the
+ * compressors while the queue is too long.
+ */
+static void write_pending_objects(int all)
+{
+	unsigned int limit = all ? 0 : 4 * compression_threads;
+
+	queue_lock();
+	while (queue_head) {
+		struct pending_object *po = queue_head;
+
+		if (!po->done) {
+			if (queue_nr <= limit)
+				break;
+#ifdef THREADED_DELTA_SEARCH
+			pthread_cond_wait(&queue_done, &queue_mutex);
+#endif
+			continue;
+		}
+		queue_head = po->next;
+		if (!queue_head)
+			queue_tail = NULL;
+		queue_nr--;
+		queue_max_size -= po->max_size;
+		queue_unlock();
+		write_object(po);
+		queue_lock();
+	}
+	queue_unlock();
+}
+
+static void flush_pending_objects(void)
+{
+	write_pending_objects(1);
+}
+
+static void queue_object(struct pending_object *po)
+{
+	queue_lock();
+	if (queue_tail)
+		queue_tail->next = po;
+	else
+		queue_head = po;
+	queue_tail = po;
+	queue_nr++;
+	queue_max_size += po->max_size;
+	if (compression_threads > 1) {
+		if (!queue_next)
+			queue_next = po;
+#ifdef THREADED_DELTA_SEARCH
+		pthread_cond_signal(&queue_work);
+#endif
+		queue_unlock();
+	} else {
+		queue_unlock();
+		compress_object(po);
+		po->done = 1;
+	}
+	write_pending_objects(0);
+}
+
+/*
+ * Hash the object and enter it in the table.  Returns NULL if it
+ * is already in a pack, or on its way into this one.
+ */
+static struct object_entry *record_object(
 	enum object_type type,
 	struct strbuf *dat,
-	struct last_object *last,
 	unsigned char *sha1out,
 	uintmax_t mark)
 {
-	void *out, *delta;
 	struct object_entry *e;
 	unsigned char hdr[96];
 	unsigned char sha1[20];
-	unsigned long hdrlen, deltalen;
+	unsigned long hdrlen;
 	git_SHA_CTX c;
-	z_stream s;
 
 	hdrlen = sprintf((char *)hdr,"%s %lu", typename(type),
 		(unsigned long)dat->len) + 1;
@@ -1045,114 +1466,196 @@ static int store_object(
 		hashcpy(sha1out, sha1);
 
 	e = insert_object(sha1);
-	if (mark)
+	if (mark) {
 		insert_mark(mark, e);
-	if (e->offset) {
+		log_mark(mark, sha1, type);
+	}
+	if (e->offset || e->pending) {
 		duplicate_count_by_type[type]++;
-		return 1;
+		return NULL;
 	} else if (find_sha1_pack(sha1, packed_git)) {
 		e->type = type;
 		e->pack_id = MAX_PACK_ID;
 		e->offset = 1; /* just not zero! */
 		duplicate_count_by_type[type]++;
-		return 1;
+		return NULL;
 	}
 
-	if (last && last->data.buf && last->depth < max_depth) {
-		delta = diff_delta(last->data.buf, last->data.len,
-			dat->buf, dat->len,
-			&deltalen, 0);
-		if (delta && deltalen >= dat->len) {
-			free(delta);
-			delta = NULL;
-		}
-	} else
-		delta = NULL;
+	e->type = type;
+	e->pack_id = pack_id;
+	e->depth = 0;
+	e->pending = 1;
+	return e;
+}
 
-	memset(&s, 0, sizeof(s));
-	deflateInit(&s, pack_compression_level);
-	if (delta) {
-		s.next_in = delta;
-		s.avail_in = deltalen;
-	} else {
-		s.next_in = (void *)dat->buf;
-		s.avail_in = dat->len;
+static struct pending_object *new_pending_object(
+	struct object_entry *e,
+	struct object_data *data,
+	unsigned int max_bases)
+{
+	struct pending_object *po;
+	unsigned long len = data->buf.len;
+
+	po = xcalloc(1, sizeof(*po) + max_bases * sizeof(po->bases[0]));
+	po->e = e;
+	po->data = data;
+	data->refs++;
+
+	/* deflateBound() for any settings, plus headers */
+	po->max_size = len + ((len + 7) >> 3) + ((len + 63) >> 6) + 17 + 60;
+	return po;
+}
+
+static void add_delta_base(
+	struct pending_object *po,
+	struct object_entry *base,
+	struct object_data *data,
+	unsigned int depth)
+{
+	po->bases[po->nr_bases].e = base;
+	po->bases[po->nr_bases].data = data;
+	po->nr_bases++;
+	data->refs++;
+
+	/* Until the delta is chosen, assume the deepest. */
+	if (po->e->depth < depth + 1)
+		po->e->depth = depth + 1;
+}
+
+/*
+ * Queue the object, unless it may not fit in this pack.  Then it is
+ * compressed here and now, after everything before it is written,
+ * and starts a new pack if it must.
+ */
+static void store_pending_object(struct pending_object *po)
+{
+	struct object_entry *e = po->e;
+	unsigned long size = pack_size + queue_max_size + po->max_size;
+
+	if (size <= max_packsize && size >= pack_size) {
+		queue_object(po);
+		return;
 	}
-	s.avail_out = deflateBound(&s, s.avail_in);
-	s.next_out = out = xmalloc(s.avail_out);
-	while (deflate(&s, Z_FINISH) == Z_OK)
-		/* nothing */;
-	deflateEnd(&s);
+
+	flush_pending_objects();
+	compress_object(po);
 
 	/* Determine if we should auto-checkpoint. */
-	if ((pack_size + 60 + s.total_out) > max_packsize
-		|| (pack_size + 60 + s.total_out) < pack_size) {
+	if ((pack_size + 60 + po->out_len) > max_packsize
+		|| (pack_size + 60 + po->out_len) < pack_size) {
 
 		/* This new object needs to *not* have the current pack_id. */
 		e->pack_id = pack_id + 1;
 		cycle_packfile();
 
 		/* We cannot carry a delta into the new pack. */
-		if (delta) {
-			free(delta);
-			delta = NULL;
-
-			memset(&s, 0, sizeof(s));
-			deflateInit(&s, pack_compression_level);
-			s.next_in = (void *)dat->buf;
-			s.avail_in = dat->len;
-			s.avail_out = deflateBound(&s, s.avail_in);
-			s.next_out = out = xrealloc(out, s.avail_out);
-			while (deflate(&s, Z_FINISH) == Z_OK)
-				/* nothing */;
-			deflateEnd(&s);
+		if (po->base >= 0) {
+			free(po->out);
+			po->base = -1;
+			po->out = deflate_buffer(po->data->buf.buf,
+				po->data->buf.len, &po->out_len);
 		}
+		e->pack_id = pack_id;
 	}
+	write_object(po);
+}
 
-	e->type = type;
-	e->pack_id = pack_id;
-	e->offset = pack_size;
-	object_count++;
-	object_count_by_type[type]++;
-
-	if (delta) {
-		unsigned long ofs = e->offset - last->offset;
-		unsigned pos = sizeof(hdr) - 1;
+static int store_object(
+	enum object_type type,
+	struct strbuf *dat,
+	struct last_object *last,
+	unsigned char *sha1out,
+	uintmax_t mark)
+{
+	struct object_entry *e;
+	struct object_data *data;
+	struct pending_object *po;
 
-		delta_count_by_type[type]++;
-		e->depth = last->depth + 1;
+	e = record_object(type, dat, sha1out, mark);
+	if (!e)
+		return 1;
 
-		hdrlen = encode_header(OBJ_OFS_DELTA, deltalen, hdr);
-		write_or_die(pack_data->pack_fd, hdr, hdrlen);
-		pack_size += hdrlen;
+	data = new_object_data();
+	strbuf_add(&data->buf, dat->buf, dat->len);
+	po = new_pending_object(e, data, 1);
+	put_object_data(data);
 
-		hdr[pos] = ofs & 127;
-		while (ofs >>= 7)
-			hdr[--pos] = 128 | (--ofs & 127);
-		write_or_die(pack_data->pack_fd, hdr + pos, sizeof(hdr) - pos);
-		pack_size += sizeof(hdr) - pos;
-	} else {
-		e->depth = 0;
-		hdrlen = encode_header(type, dat->len, hdr);
-		write_or_die(pack_data->pack_fd, hdr, hdrlen);
-		pack_size += hdrlen;
+	if (last && last->e && last->depth < max_depth) {
+		struct object_data *base = new_object_data();
+		strbuf_add(&base->buf, last->data.buf, last->data.len);
+		add_delta_base(po, last->e, base, last->depth);
+		put_object_data(base);
 	}
 
-	write_or_die(pack_data->pack_fd, out, s.total_out);
-	pack_size += s.total_out;
+	store_pending_object(po);
+	if (last)
+		last->depth = e->depth;
+	return 0;
+}
 
-	free(out);
-	free(delta);
-	if (last) {
-		if (last->no_swap) {
-			last->data = *dat;
-		} else {
-			strbuf_swap(&last->data, dat);
+static int usable_blob_slot(struct blob_slot *slot)
+{
+	return slot->e && slot->e->pack_id == pack_id
+		&& slot->e->depth < max_depth;
+}
+
+/*
+ * Blobs are deltified against the last few blobs, starting with the
+ * earlier version of the same path when we know the path.
+ */
+static void store_blob(
+	struct strbuf *dat,
+	unsigned char *sha1out,
+	uintmax_t mark,
+	const char *path)
+{
+	struct object_entry *e;
+	struct object_data *data;
+	struct pending_object *po;
+	struct blob_slot *same = NULL, *slot;
+	unsigned int i;
+
+	e = record_object(OBJ_BLOB, dat, sha1out, mark);
+	if (!e)
+		return;
+
+	data = new_object_data();
+	strbuf_swap(&data->buf, dat);
+	po = new_pending_object(e, data, delta_window);
+
+	for (i = 0; path && i < delta_window; i++) {
+		slot = &blob_window[i];
+		if (slot->path && !strcmp(slot->path, path)) {
+			same = slot;
+			break;
 		}
-		last->offset = e->offset;
-		last->depth = e->depth;
 	}
-	return 0;
+	if (same && usable_blob_slot(same)) {
+		add_delta_base(po, same->e, same->data, same->e->depth);
+		po->same_path = 1;
+	}
+	for (i = 0; i < delta_window; i++) {
+		slot = &blob_window[i];
+		if (slot != same && usable_blob_slot(slot))
+			add_delta_base(po, slot->e, slot->data, slot->e->depth);
+	}
+
+	store_pending_object(po);
+
+	/* Take the place of the same path, or else of the oldest blob. */
+	slot = same;
+	if (!slot) {
+		slot = &blob_window[0];
+		for (i = 1; i < delta_window; i++)
+			if (blob_window[i].age < slot->age)
+				slot = &blob_window[i];
+	}
+	put_object_data(slot->data);
+	free(slot->path);
+	slot->data = data;
+	slot->e = e;
+	slot->path = path ? xstrdup(path) : NULL;
+	slot->age = ++blob_window_age;
 }
 
 /* All calls must be guarded by find_object() or find_mark() to
@@ -1178,7 +1681,11 @@ static void *gfi_unpack_entry(
 	unsigned long *sizep)
 {
 	enum object_type type;
-	struct packed_git *p = all_packs[oe->pack_id];
+	struct packed_git *p;
+
+	if (oe->pending)
+		flush_pending_objects();
+	p = all_packs[oe->pack_id];
 	if (p == pack_data && p->pack_size < (pack_size + 20)) {
 		/* The object is stored in the packfile we are writing to
 		 * and we have modified it since the last time we scanned
@@ -1314,7 +1821,7 @@ static void store_tree(struct tree_entry *root)
 {
 	struct tree_content *t = root->tree;
 	unsigned int i, j, del;
-	struct last_object lo = { STRBUF_INIT, 0, 0, /* no_swap */ 1 };
+	struct last_object lo = { STRBUF_INIT, NULL, 0 };
 	struct object_entry *le;
 
 	if (!is_null_sha1(root->versions[1].sha1))
@@ -1329,7 +1836,7 @@ static void store_tree(struct tree_entry *root)
 	if (S_ISDIR(root->versions[0].mode) && le && le->pack_id == pack_id) {
 		mktree(t, 0, &old_tree);
 		lo.data = old_tree;
-		lo.offset = le->offset;
+		lo.e = le;
 		lo.depth = t->delta_depth;
 	}
 
@@ -1592,12 +2099,179 @@ static void dump_marks_helper(FILE *f,
 	}
 }
 
+typedef void (*each_mark_fn)(uintmax_t mark,
+	const unsigned char *sha1,
+	enum object_type type,
+	void *data);
+
+struct mark_walk
+{
+	each_mark_fn fn;
+	void *data;
+	size_t next_db;
+};
+
+/* Show the marks in the database before "mark"; hide "mark" itself. */
+static void walk_db_marks(struct mark_walk *w, uintmax_t mark, int all)
+{
+	while (w->next_db < mark_db_nr) {
+		struct mark_record *r = &mark_db[w->next_db];
+		uintmax_t m = mark_record_mark(r);
+
+		if (!all && m > mark)
+			break;
+		w->next_db++;
+		if (all || m < mark)
+			w->fn(m, r->sha1, ntohl(r->type), w->data);
+	}
+}
+
+static void walk_marks(struct mark_walk *w,
+	uintmax_t base,
+	struct mark_set *m)
+{
+	uintmax_t k;
+	if (m->shift) {
+		for (k = 0; k < 1024; k++) {
+			if (m->data.sets[k])
+				walk_marks(w, (base + k) << m->shift,
+					m->data.sets[k]);
+		}
+	} else {
+		for (k = 0; k < 1024; k++) {
+			struct object_entry *e = m->data.marked[k];
+			if (!e)
+				continue;
+			walk_db_marks(w, base + k, 0);
+			w->fn(base + k, e->sha1, e->type, w->data);
+		}
+	}
+}
+
+/*
+ * Call fn for every mark in order, whether it was set in this
+ * import or is only in the mark database.
+ */
+static void for_each_mark(each_mark_fn fn, void *data)
+{
+	struct mark_walk w;
+
+	w.fn = fn;
+	w.data = data;
+	w.next_db = 0;
+	walk_marks(&w, 0, marks);
+	walk_db_marks(&w, 0, 1);
+}
+
+static void print_mark(uintmax_t mark,
+	const unsigned char *sha1,
+	enum object_type type,
+	void *data)
+{
+	fprintf(data, ":%" PRIuMAX " %s\n", mark, sha1_to_hex(sha1));
+}
+
+static void write_mark_record(uintmax_t mark,
+	const unsigned char *sha1,
+	enum object_type type,
+	void *data)
+{
+	struct mark_record r;
+
+	r.mark[0] = htonl((uint32_t)(mark >> 32));
+	r.mark[1] = htonl((uint32_t)mark);
+	hashcpy(r.sha1, sha1);
+	r.type = htonl(type);
+	fwrite(&r, sizeof(r), 1, data);
+}
+
+static void write_mark_db_log(void)
+{
+	off_t size = mark_db_log_nr * sizeof(struct mark_record);
+	int fd;
+
+	if (!mark_db_log.len)
+		return;
+
+	fd = open(mark_db_log_file, O_WRONLY | O_CREAT, 0666);
+	if (fd < 0
+	    || ftruncate(fd, size)
+	    || lseek(fd, size, SEEK_SET) != size
+	    || write_in_full(fd, mark_db_log.buf, mark_db_log.len) < 0) {
+		failure |= error("Unable to write mark log %s: %s",
+			mark_db_log_file, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return;
+	}
+	if (close(fd)) {
+		failure |= error("Unable to write mark log %s: %s",
+			mark_db_log_file, strerror(errno));
+		return;
+	}
+	mark_db_log_nr += mark_db_log.len / sizeof(struct mark_record);
+	strbuf_reset(&mark_db_log);
+}
+
+/*
+ * Rewrite the mark database with the log folded in, once reading
+ * the log at startup would cost more than an eighth of the table.
+ */
+static void write_mark_db(void)
+{
+	static struct lock_file db_lock;
+	struct mark_db_header hdr;
+	int fd;
+	FILE *f;
+
+	if (!mark_db_file)
+		return;
+	write_mark_db_log();
+	if (!mark_db_log_nr || mark_db_log_nr * 8 < mark_db_nr)
+		return;
+
+	fd = hold_lock_file_for_update(&db_lock, mark_db_file, 0);
+	if (fd < 0) {
+		failure |= error("Unable to write mark database %s: %s",
+			mark_db_file, strerror(errno));
+		return;
+	}
+	f = fdopen(fd, "w");
+	if (!f) {
+		int saved_errno = errno;
+		rollback_lock_file(&db_lock);
+		failure |= error("Unable to write mark database %s: %s",
+			mark_db_file, strerror(saved_errno));
+		return;
+	}
+	db_lock.fd = -1;
+
+	hdr.signature = htonl(MARK_DB_SIGNATURE);
+	hdr.version = htonl(MARK_DB_VERSION);
+	fwrite(&hdr, sizeof(hdr), 1, f);
+	for_each_mark(write_mark_record, f);
+	if (ferror(f) || fclose(f) || commit_lock_file(&db_lock)) {
+		int saved_errno = errno;
+		rollback_lock_file(&db_lock);
+		failure |= error("Unable to write mark database %s: %s",
+			mark_db_file, strerror(saved_errno));
+		return;
+	}
+
+	/* The table now has every mark in the log. */
+	if (unlink(mark_db_log_file) && errno != ENOENT)
+		failure |= error("Unable to remove %s: %s",
+			mark_db_log_file, strerror(errno));
+	mark_db_log_nr = 0;
+}
+
 static void dump_marks(void)
 {
 	static struct lock_file mark_lock;
 	int mark_fd;
 	FILE *f;
 
+	write_mark_db_log();
 	if (!mark_file)
 		return;
 
@@ -1624,7 +2298,7 @@ static void dump_marks(void)
 	 */
 	mark_lock.fd = -1;
 
-	dump_marks_helper(f, 0, marks);
+	for_each_mark(print_mark, f);
 	if (ferror(f) || fclose(f)) {
 		int saved_errno = errno;
 		rollback_lock_file(&mark_lock);
@@ -1806,7 +2480,7 @@ static void parse_new_blob(void)
 	read_next_command();
 	parse_mark();
 	parse_data(&buf);
-	store_object(OBJ_BLOB, &buf, &last_blob, NULL, next_mark);
+	store_blob(&buf, NULL, next_mark, NULL);
 }
 
 static void unload_one_branch(void)
@@ -1925,7 +2599,7 @@ static void file_change_m(struct branch *b)
 		}
 		read_next_command();
 		parse_data(&buf);
-		store_object(OBJ_BLOB, &buf, &last_blob, sha1, 0);
+		store_blob(&buf, sha1, 0, p);
 	} else if (oe) {
 		if (oe->type != OBJ_BLOB)
 			die("Not a blob (actually a %s): %s",
@@ -2320,6 +2994,7 @@ static void parse_reset_branch(void)
 
 static void parse_checkpoint(void)
 {
+	flush_pending_objects();
 	if (object_count) {
 		cycle_packfile();
 		dump_branches();
@@ -2368,10 +3043,61 @@ static void import_marks(const char *input_file)
 			e->offset = 1; /* just not zero! */
 		}
 		insert_mark(mark, e);
+		log_mark(mark, e->sha1, e->type);
 	}
 	fclose(f);
 }
 
+static void read_mark_db(const char *file)
+{
+	struct strbuf log = STRBUF_INIT;
+	struct mark_db_header *hdr;
+	struct stat st;
+	size_t i;
+	int fd;
+
+	mark_db_file = file;
+	mark_db_log_file = xstrdup(mkpath("%s.log", file));
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			die("cannot read %s: %s", file, strerror(errno));
+	} else {
+		if (fstat(fd, &st))
+			die("cannot stat %s: %s", file, strerror(errno));
+		if (st.st_size < sizeof(*hdr)
+		    || (st.st_size - sizeof(*hdr)) % sizeof(struct mark_record))
+			die("corrupt mark database %s", file);
+		hdr = xmmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (ntohl(hdr->signature) != MARK_DB_SIGNATURE
+		    || ntohl(hdr->version) != MARK_DB_VERSION)
+			die("%s is not a mark database", file);
+		mark_db = (struct mark_record *)(hdr + 1);
+		mark_db_nr = (st.st_size - sizeof(*hdr)) / sizeof(*mark_db);
+	}
+
+	fd = open(mark_db_log_file, O_RDONLY);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			die("cannot read %s: %s", mark_db_log_file,
+			    strerror(errno));
+		return;
+	}
+	if (strbuf_read(&log, fd, 0) < 0)
+		die("cannot read %s: %s", mark_db_log_file, strerror(errno));
+	close(fd);
+
+	/* A record cut short by a crash is dropped, and overwritten. */
+	mark_db_log_nr = log.len / sizeof(struct mark_record);
+	for (i = 0; i < mark_db_log_nr; i++) {
+		struct mark_record *r = (struct mark_record *)log.buf + i;
+		insert_mark(mark_record_mark(r), mark_record_object(r));
+	}
+	strbuf_release(&log);
+}
+
 static int git_pack_config(const char *k, const char *v, void *cb)
 {
 	if (!strcmp(k, "pack.depth")) {
@@ -2390,11 +3116,23 @@ static int git_pack_config(const char *k, const char *v, void *cb)
 		pack_compression_seen = 1;
 		return 0;
 	}
+	if (!strcmp(k, "pack.threads")) {
+		compression_threads = git_config_int(k, v);
+		if (compression_threads < 0)
+			die("invalid number of threads specified (%d)",
+			    compression_threads);
+#ifndef THREADED_DELTA_SEARCH
+		if (compression_threads != 1)
+			warning("no threads support, ignoring %s", k);
+		compression_threads = 1;
+#endif
+		return 0;
+	}
 	return git_default_config(k, v, cb);
 }
 
 static const char fast_import_usage[] =
-"git fast-import [--date-format=f] [--max-pack-size=n] [--depth=n] [--active-branches=n] [--export-marks=marks.file]";
+"git fast-import [--date-format=f] [--max-pack-size=n] [--depth=n] [--delta-window=n] [--threads=n] [--active-branches=n] [--export-marks=marks.file] [--marks-db=marks.db]";
 
 int main(int argc, const char **argv)
 {
@@ -2437,12 +3175,32 @@ int main(int argc, const char **argv)
 			if (max_depth > MAX_DEPTH)
 				die("--depth cannot exceed %u", MAX_DEPTH);
 		}
+		else if (!prefixcmp(a, "--delta-window=")) {
+			char *end;
+			delta_window = strtoul(a + 15, &end, 0);
+			if (!a[15] || *end || !delta_window)
+				die("invalid --delta-window: %s", a + 15);
+		}
+		else if (!prefixcmp(a, "--threads=")) {
+			char *end;
+			compression_threads = strtoul(a + 10, &end, 0);
+			if (!a[10] || *end || compression_threads < 0)
+				die("invalid number of threads specified (%s)",
+				    a + 10);
+#ifndef THREADED_DELTA_SEARCH
+			if (compression_threads != 1)
+				warning("no threads support, ignoring %s", a);
+			compression_threads = 1;
+#endif
+		}
 		else if (!prefixcmp(a, "--active-branches="))
 			max_active_branches = strtoul(a + 18, NULL, 0);
 		else if (!prefixcmp(a, "--import-marks="))
 			import_marks(a + 15);
 		else if (!prefixcmp(a, "--export-marks="))
 			mark_file = a + 15;
+		else if (!prefixcmp(a, "--marks-db="))
+			read_mark_db(a + 11);
 		else if (!prefixcmp(a, "--export-pack-edges=")) {
 			if (pack_edges)
 				fclose(pack_edges);
@@ -2460,6 +3218,11 @@ int main(int argc, const char **argv)
 	}
 	if (i != argc)
 		usage(fast_import_usage);
+#ifdef THREADED_DELTA_SEARCH
+	if (!compression_threads)	/* --threads=0 means autodetect */
+		compression_threads = online_cpus();
+#endif
+	blob_window = xcalloc(delta_window, sizeof(*blob_window));
 
 	rc_free = pool_alloc(cmd_save * sizeof(*rc_free));
 	for (i = 0; i < (cmd_save - 1); i++)
@@ -2468,6 +3231,7 @@ int main(int argc, const char **argv)
 
 	prepare_packed_git();
 	start_packfile();
+	start_compressors();
 	set_die_routine(die_nicely);
 	while (read_next_command() != EOF) {
 		if (!strcmp("blob", command_buf.buf))
@@ -2486,11 +3250,13 @@ int main(int argc, const char **argv)
 			die("Unsupported command: %s", command_buf.buf);
 	}
 	end_packfile();
+	stop_compressors();
 
 	dump_branches();
 	dump_tags();
 	unkeep_all_packs();
 	dump_marks();
+	write_mark_db();
 
 	if (pack_edges)
 		fclose(pack_edges);
@@ -14,6 +14,8 @@ f               pass --no-reuse-object to git-pack-objects
 n               do not run git-update-server-info
 q,quiet         be quiet
 l               pass --local to git-pack-objects
+keep-pack=      do not repack this pack (with -a or -A)
+incremental-deltas only look for deltas for objects not already packed
  Packing constraints
 window=         size of the window used for delta compression
 window-memory=  same as the above, but limit memory size instead of entries count
@@ -24,7 +26,7 @@ SUBDIRECTORY_OK='Yes'
 . git-sh-setup
 
 no_update_info= all_into_one= remove_redundant= unpack_unreachable=
-local= quiet= no_reuse= extra=
+local= quiet= no_reuse= extra= keep_pack=
 while test $# != 0
 do
 	case "$1" in
@@ -38,6 +40,11 @@ do
 	-l)	local=--local ;;
 	--max-pack-size|--window|--window-memory|--depth)
 		extra="$extra $1=$2"; shift ;;
+	--keep-pack)
+		keep_pack="$keep_pack ${2%.pack}"
+		extra="$extra --keep-pack=${2%.pack}.pack"; shift ;;
+	--incremental-deltas)
+		extra="$extra $1" ;;
 	--) shift; break;;
 	*)	usage ;;
 	esac
@@ -65,6 +72,9 @@ case ",$all_into_one," in
 		for e in `cd "$PACKDIR" && find . -type f -name '*.pack' \
 			| sed -e 's/^\.\///' -e 's/\.pack$//'`
 		do
+			case " $keep_pack " in
+			*" $e "*) continue ;;
+			esac
 			if [ -e "$PACKDIR/$e.keep" ]; then
 				: keep
 			else
@@ -179,6 +189,12 @@ then
 	git prune-packed $quiet
 fi
 
+# Keep an existing multi-pack index covering what we have now.
+if test -f "$PACKDIR/multi-pack-index"
+then
+	git multi-pack-index write
+fi
+
 case "$no_update_info" in
 t) : ;;
 *) git update-server-info ;;
@@ -9,6 +9,8 @@
 #include "progress.h"
 #include "fsck.h"
 #include "exec_cmd.h"
+#include "streaming.h"
+#include "sha1-batch.h"
 
 static const char index_pack_usage[] =
 "git index-pack [-v] [-o <index-file>] [{ ---keep | --keep=<msg> }] [--strict] { <pack-file> | --stdin [--fix-thin] [<pack-file>] }";
@@ -265,14 +267,32 @@ static void unlink_base_data(struct base_data *c)
 	free_base_data(c);
 }
 
-static void *unpack_entry_data(unsigned long offset, unsigned long size)
+/*
+ * Inflate the data of the current entry.  Blobs larger than
+ * core.bigFileThreshold are only hashed (into "sha1") and NULL is
+ * returned; their contents are read back from the pack if needed.
+ */
+static void *unpack_entry_data(unsigned long offset, unsigned long size,
+			       enum object_type type, unsigned char *sha1)
 {
 	z_stream stream;
-	void *buf = xmalloc(size);
+	git_SHA_CTX c;
+	char hdr[32];
+	int hdrlen;
+	unsigned char fixed_buf[8192];
+	void *buf;
+
+	if (type == OBJ_BLOB && size > big_file_threshold) {
+		buf = fixed_buf;
+		hdrlen = sprintf(hdr, "%s %lu", typename(type), size) + 1;
+		git_SHA1_Init(&c);
+		git_SHA1_Update(&c, hdr, hdrlen);
+	} else
+		buf = xmalloc(size);
 
 	memset(&stream, 0, sizeof(stream));
 	stream.next_out = buf;
-	stream.avail_out = size;
+	stream.avail_out = buf == fixed_buf ? sizeof(fixed_buf) : size;
 	stream.next_in = fill(1);
 	stream.avail_in = input_len;
 	git_inflate_init(&stream);
@@ -280,14 +300,24 @@ static void *unpack_entry_data(unsigned long offset, unsigned long size)
 	for (;;) {
 		int ret = git_inflate(&stream, 0);
 		use(input_len - stream.avail_in);
+		if (buf == fixed_buf) {
+			git_SHA1_Update(&c, fixed_buf,
+					stream.next_out - fixed_buf);
+			stream.next_out = fixed_buf;
+			stream.avail_out = sizeof(fixed_buf);
+		}
 		if (stream.total_out == size && ret == Z_STREAM_END)
 			break;
-		if (ret != Z_OK)
+		if (ret != Z_OK || stream.total_out > size)
 			bad_object(offset, "inflate returned %d", ret);
 		stream.next_in = fill(1);
 		stream.avail_in = input_len;
 	}
 	git_inflate_end(&stream);
+	if (buf == fixed_buf) {
+		git_SHA1_Final(sha1, &c);
+		return NULL;
+	}
 	return buf;
 }
 
@@ -351,7 +381,8 @@ static void *unpack_raw_entry(struct object_entry *obj, union delta_base *delta_
 	}
 	obj->hdr_size = consumed_bytes - obj->idx.offset;
 
-	data = unpack_entry_data(obj->idx.offset, obj->size);
+	data = unpack_entry_data(obj->idx.offset, obj->size, obj->type,
+				 obj->idx.sha1);
 	obj->idx.crc32 = input_crc32;
 	return data;
 }
@@ -432,11 +463,74 @@ static void find_delta_children(const union delta_base *base,
 	*last_index = last;
 }
 
-static void sha1_object(const void *data, unsigned long size,
-			enum object_type type, unsigned char *sha1)
+/*
+ * Compare a large blob we did not keep in core against the object we
+ * already have, by inflating it back from the pack in small pieces.
+ */
+static void compare_large_object(struct object_entry *obj)
+{
+	off_t from = obj[0].idx.offset + obj[0].hdr_size;
+	off_t len = obj[1].idx.offset - from;
+	unsigned char *sha1 = obj->idx.sha1;
+	unsigned char ibuf[4096], obuf[8192];
+	char has_buf[8192];
+	struct git_istream *st;
+	enum object_type has_type;
+	unsigned long has_size;
+	z_stream stream;
+	int status;
+
+	st = open_istream(sha1, &has_type, &has_size);
+	if (!st)
+		die("cannot read existing object %s", sha1_to_hex(sha1));
+	if (has_type != obj->type || has_size != obj->size)
+		die("SHA1 COLLISION FOUND WITH %s !", sha1_to_hex(sha1));
+
+	memset(&stream, 0, sizeof(stream));
+	git_inflate_init(&stream);
+	do {
+		ssize_t n;
+
+		if (!stream.avail_in && len) {
+			n = pread(pack_fd, ibuf,
+				  len < sizeof(ibuf) ? len : sizeof(ibuf), from);
+			if (n < 0)
+				die("cannot pread pack file: %s", strerror(errno));
+			if (!n)
+				die("premature end of pack file, %lu bytes missing",
+				    (unsigned long)len);
+			from += n;
+			len -= n;
+			stream.next_in = ibuf;
+			stream.avail_in = n;
+		}
+		stream.next_out = obuf;
+		stream.avail_out = sizeof(obuf);
+		status = git_inflate(&stream, 0);
+		n = stream.next_out - obuf;
+		if (n && (read_istream(st, has_buf, n) != n ||
+			  memcmp(obuf, has_buf, n)))
+			die("SHA1 COLLISION FOUND WITH %s !", sha1_to_hex(sha1));
+	} while (status == Z_OK);
+	git_inflate_end(&stream);
+	if (status != Z_STREAM_END || stream.total_out != obj->size)
+		die("serious inflate inconsistency");
+	close_istream(st);
+}
+
+/*
+ * Check an object whose name "sha1" has been computed by the caller.
+ * A NULL "data" means the object is a large blob that is only on disk.
+ */
+static void sha1_object(const void *data, struct object_entry *obj_entry,
+			unsigned long size, enum object_type type,
+			unsigned char *sha1)
 {
-	hash_sha1_file(data, size, typename(type), sha1);
-	if (has_sha1_file(sha1)) {
+	if (!has_sha1_file(sha1))
+		; /* a new object; nothing to compare against */
+	else if (!data)
+		compare_large_object(obj_entry);
+	else {
 		void *has_data;
 		enum object_type has_type;
 		unsigned long has_size;
@@ -485,6 +579,44 @@ static void sha1_object(const void *data, unsigned long size,
 	}
 }
 
+/*
+ * Non-delta objects of the first pass are named in batches (see
+ * sha1-batch.h); they are checked, and their data freed, when the
+ * batch is flushed.
+ */
+static struct sha1_job hash_jobs[SHA1_BATCH_JOBS];
+static struct object_entry *hash_objects[SHA1_BATCH_JOBS];
+static int nr_hash_jobs;
+static unsigned long hash_job_bytes;
+
+static void flush_hash_jobs(void)
+{
+	int i;
+
+	git_SHA1_Batch(hash_jobs, nr_hash_jobs);
+	for (i = 0; i < nr_hash_jobs; i++) {
+		struct object_entry *obj = hash_objects[i];
+		void *data = (void *)hash_jobs[i].data;
+
+		hashcpy(obj->idx.sha1, hash_jobs[i].sha1);
+		sha1_object(data, obj, obj->size, obj->type, obj->idx.sha1);
+		free(data);
+	}
+	nr_hash_jobs = 0;
+	hash_job_bytes = 0;
+}
+
+static void queue_sha1_object(void *data, struct object_entry *obj)
+{
+	sha1_job_init(&hash_jobs[nr_hash_jobs], data, obj->size,
+		      typename(obj->type));
+	hash_objects[nr_hash_jobs++] = obj;
+	hash_job_bytes += obj->size;
+	if (nr_hash_jobs == SHA1_BATCH_JOBS ||
+	    hash_job_bytes >= SHA1_BATCH_BYTES)
+		flush_hash_jobs();
+}
+
 static void *get_base_data(struct base_data *c)
 {
 	if (!c->data) {
@@ -525,8 +657,10 @@ static void resolve_delta(struct object_entry *delta_obj,
 	free(delta_data);
 	if (!result->data)
 		bad_object(delta_obj->idx.offset, "failed to apply delta");
-	sha1_object(result->data, result->size, delta_obj->real_type,
-		    delta_obj->idx.sha1);
+	hash_sha1_file(result->data, result->size,
+		       typename(delta_obj->real_type), delta_obj->idx.sha1);
+	sha1_object(result->data, delta_obj, result->size,
+		    delta_obj->real_type, delta_obj->idx.sha1);
 	nr_resolved_deltas++;
 }
 
@@ -614,11 +748,14 @@ static void parse_pack_objects(unsigned char *sha1)
 			nr_deltas++;
 			delta->obj_no = i;
 			delta++;
-		} else
-			sha1_object(data, obj->size, obj->type, obj->idx.sha1);
+		} else if (data) {
+			queue_sha1_object(data, obj);
+			data = NULL;
+		}
 		free(data);
 		display_progress(progress, i+1);
 	}
+	flush_hash_jobs();
 	objects[i].idx.offset = consumed_bytes;
 	stop_progress(&progress);
 
@@ -629,6 +766,17 @@ static void parse_pack_objects(unsigned char *sha1)
 		die("pack is corrupted (SHA1 mismatch)");
 	use(20);
 
+	/*
+	 * Large blobs were only hashed on the way in; now that the whole
+	 * pack is on disk they can be checked against what we have.
+	 */
+	for (i = 0; i < nr_objects; i++) {
+		struct object_entry *obj = &objects[i];
+		if (obj->type == OBJ_BLOB && obj->size > big_file_threshold)
+			sha1_object(NULL, obj, obj->size, obj->type,
+				    obj->idx.sha1);
+	}
+
 	/* If input_fd is a file, we should have reached its end now. */
 	if (fstat(input_fd, &st))
 		die("cannot fstat packfile: %s", strerror(errno));
@@ -45,6 +45,7 @@ struct commit *make_virtual_commit(struct tree *tree, const char *comment)
 	commit->util = (void*)comment;
 	/* avoid warnings */
 	commit->object.parsed = 1;
+	commit->index = alloc_commit_index();
 	return commit;
 }
 
@@ -156,12 +157,6 @@ static int add_cacheinfo(unsigned int mode, const unsigned char *sha1,
 	return add_cache_entry(ce, options);
 }
 
-static void init_tree_desc_from_tree(struct tree_desc *desc, struct tree *tree)
-{
-	parse_tree(tree);
-	init_tree_desc(desc, tree->buffer, tree->size);
-}
-
 static int git_merge_trees(int index_only,
 			   struct tree *common,
 			   struct tree *head,
@@ -182,6 +177,9 @@ static int git_merge_trees(int index_only,
 	opts.src_index = &the_index;
 	opts.dst_index = &the_index;
 
+	parse_tree(common);
+	parse_tree(head);
+	parse_tree(merge);
 	init_tree_desc_from_tree(t+0, common);
 	init_tree_desc_from_tree(t+1, head);
 	init_tree_desc_from_tree(t+2, merge);
@@ -211,7 +209,8 @@ struct tree *write_tree_from_memory(struct merge_options *o)
 
 	if (!cache_tree_fully_valid(active_cache_tree) &&
 	    cache_tree_update(active_cache_tree,
-			      active_cache, active_nr, 0, 0) < 0)
+			      active_cache, active_nr, o->in_memory,
+			      o->in_memory ? CACHE_TREE_PRETEND : CACHE_TREE_WRITE) < 0)
 		die("error building trees");
 
 	result = lookup_tree(active_cache_tree->sha1);
@@ -392,6 +391,19 @@ static int update_stages(const char *path, struct diff_filespec *o,
 	return 0;
 }
 
+/*
+ * An in-memory merge notes what it would have written to the work
+ * tree, or NULL for a path it would have removed.
+ */
+static void record_worktree_file(struct merge_options *o, const char *path,
+				 const unsigned char *sha, unsigned mode)
+{
+	struct string_list_item *item = string_list_insert(path, &o->worktree);
+
+	free(item->util);
+	item->util = sha ? make_cache_entry(mode, sha, path, 0, 0) : NULL;
+}
+
 static int remove_file(struct merge_options *o, int clean,
 		       const char *path, int no_wd)
 {
@@ -403,7 +415,9 @@ static int remove_file(struct merge_options *o, int clean,
 			return -1;
 	}
 	if (update_working_directory) {
-		if (remove_path(path) && errno != ENOENT)
+		if (o->in_memory)
+			record_worktree_file(o, path, NULL, 0);
+		else if (remove_path(path) && errno != ENOENT)
 			return -1;
 	}
 	return 0;
@@ -423,7 +437,7 @@ static char *unique_path(struct merge_options *o, const char *path, const char *
 			*p = '_';
 	while (string_list_has_string(&o->current_file_set, newpath) ||
 	       string_list_has_string(&o->current_directory_set, newpath) ||
-	       lstat(newpath, &st) == 0)
+	       (!o->in_memory && lstat(newpath, &st) == 0))
 		sprintf(p, "_%d", suffix++);
 
 	string_list_insert(newpath, &o->current_file_set);
@@ -514,6 +528,11 @@ static void update_file_flags(struct merge_options *o,
 	if (o->call_depth)
 		update_wd = 0;
 
+	if (update_wd && o->in_memory) {
+		record_worktree_file(o, path, sha, mode);
+		update_wd = 0;
+	}
+
 	if (update_wd) {
 		enum object_type type;
 		void *buf;
@@ -692,8 +711,11 @@ static struct merge_file_info merge_file(struct merge_options *o,
 			if ((merge_status < 0) || !result_buf.ptr)
 				die("Failed to execute internal merge");
 
-			if (write_sha1_file(result_buf.ptr, result_buf.size,
-					    blob_type, result.sha))
+			if (o->in_memory)
+				pretend_sha1_file(result_buf.ptr, result_buf.size,
+						  OBJ_BLOB, result.sha);
+			else if (write_sha1_file(result_buf.ptr, result_buf.size,
+						 blob_type, result.sha))
 				die("Unable to add %s to database",
 				    a->path);
 
@@ -1139,6 +1161,53 @@ static int process_entry(struct merge_options *o,
 	return clean_merge;
 }
 
+/*
+ * Turn what an in-memory merge left in the index into the tree the
+ * work tree would hold: what the merge wrote to or removed from the
+ * work tree wins, and an unmerged path it did not touch there keeps
+ * our side.  The unmerged paths are the conflicts.
+ */
+static struct tree *write_in_memory_result(struct merge_options *o)
+{
+	int i;
+
+	for (i = 0; i < active_nr; i++)
+		if (ce_stage(active_cache[i]))
+			string_list_insert(active_cache[i]->name, &o->conflicts);
+
+	for (i = 0; i < o->worktree.nr; i++) {
+		struct cache_entry *ce = o->worktree.items[i].util;
+
+		remove_file_from_cache(o->worktree.items[i].string);
+		if (ce && add_cache_entry(ce, ADD_CACHE_OK_TO_ADD |
+					  ADD_CACHE_OK_TO_REPLACE))
+			die("unable to add %s to the merge result", ce->name);
+	}
+	string_list_clear(&o->worktree, 0);
+
+	for (i = 0; i < active_nr; i++) {
+		struct cache_entry *ce = active_cache[i], *ours = NULL;
+		int j;
+
+		if (!ce_stage(ce))
+			continue;
+		for (j = i; j < active_nr && !strcmp(active_cache[j]->name, ce->name); j++)
+			if (ce_stage(active_cache[j]) == 2)
+				ours = active_cache[j];
+		remove_file_from_cache(ce->name);
+		if (!ours) {
+			/* the next path has moved down to "i" */
+			i--;
+			continue;
+		}
+		if (add_cacheinfo(ours->ce_mode, ours->sha1, ours->name,
+				  0, 0, ADD_CACHE_OK_TO_ADD))
+			die("unable to add %s to the merge result", ours->name);
+	}
+
+	return write_tree_from_memory(o);
+}
+
 int merge_trees(struct merge_options *o,
 		struct tree *head,
 		struct tree *merge,
@@ -1147,6 +1216,11 @@ int merge_trees(struct merge_options *o,
 {
 	int code, clean;
 
+	if (o->in_memory && !o->call_depth) {
+		string_list_clear(&o->conflicts, 0);
+		string_list_clear(&o->worktree, 1);
+	}
+
 	if (o->subtree_merge) {
 		merge = shift_tree_object(head, merge);
 		common = shift_tree_object(head, common);
@@ -1158,7 +1232,7 @@ int merge_trees(struct merge_options *o,
 		return 1;
 	}
 
-	code = git_merge_trees(o->call_depth, common, head, merge);
+	code = git_merge_trees(o->call_depth || o->in_memory, common, head, merge);
 
 	if (code != 0)
 		die("merging of trees %s and %s failed",
@@ -1195,6 +1269,8 @@ int merge_trees(struct merge_options *o,
 
 	if (o->call_depth)
 		*result = write_tree_from_memory(o);
+	else if (o->in_memory)
+		*result = write_in_memory_result(o);
 
 	return clean;
 }
@@ -1279,13 +1355,13 @@ int merge_recursive(struct merge_options *o,
 	}
 
 	discard_cache();
-	if (!o->call_depth)
+	if (!o->call_depth && !o->in_memory)
 		read_cache();
 
 	clean = merge_trees(o, h1->tree, h2->tree, merged_common_ancestors->tree,
 			    &mrtree);
 
-	if (o->call_depth) {
+	if (o->call_depth || o->in_memory) {
 		*result = make_virtual_commit(mrtree, "merged tree");
 		commit_list_insert(h1, &(*result)->parents);
 		commit_list_insert(h2, &(*result)->parents->next);
@@ -1381,4 +1457,8 @@ void init_merge_options(struct merge_options *o)
 	o->current_file_set.strdup_strings = 1;
 	memset(&o->current_directory_set, 0, sizeof(struct string_list));
 	o->current_directory_set.strdup_strings = 1;
+	memset(&o->conflicts, 0, sizeof(struct string_list));
+	o->conflicts.strdup_strings = 1;
+	memset(&o->worktree, 0, sizeof(struct string_list));
+	o->worktree.strdup_strings = 1;
 }
@@ -8,6 +8,7 @@ struct merge_options {
 	const char *branch2;
 	unsigned subtree_merge : 1;
 	unsigned buffer_output : 1;
+	unsigned in_memory : 1;
 	int verbosity;
 	int diff_rename_limit;
 	int merge_rename_limit;
@@ -15,8 +16,19 @@ struct merge_options {
 	struct strbuf obuf;
 	struct string_list current_file_set;
 	struct string_list current_directory_set;
+	struct string_list conflicts;
+	struct string_list worktree;
 };
 
+/*
+ * With "in_memory" set, the merge neither reads nor writes the index
+ * file or the work tree, and the blobs and trees it makes are only
+ * kept in memory (see pretend_sha1_file()).  merge_recursive() then
+ * returns a virtual commit for the tree the work tree would hold
+ * after the merge, conflict markers and all, and leaves the paths the
+ * merge could not resolve in "conflicts".
+ */
+
 /* merge_trees() but with recursive ancestor consolidation */
 int merge_recursive(struct merge_options *o,
 		    struct commit *h1,
@@ -0,0 +1,400 @@
+/*
+ * Multi-pack index: one sorted table of the objects in all local packs.
+ *
+ * File layout (all integers in network byte order):
+ *
+ *   - header: signature "MIDX", version, number of packs, number
+ *     of objects, number of 64-bit offsets;
+ *   - the names of the packs ("pack-<sha1>.pack"), each terminated
+ *     by a NUL, padded with NULs to a multiple of 4 bytes;
+ *   - a 256-entry fan-out table, as in a pack .idx file;
+ *   - the sorted 20-byte object names;
+ *   - for each object, the index of the pack that holds it followed
+ *     by its offset in that pack; an offset with its MSB set is an
+ *     index into the table of 64-bit offsets instead;
+ *   - the table of 64-bit offsets;
+ *   - the SHA-1 of everything above.
+ *
+ * An object that lives in more than one pack is recorded once, for
+ * the pack that comes first in packed_git order, i.e. the one that
+ * find_pack_entry() would have picked anyway.
+ */
+#include "cache.h"
+#include "csum-file.h"
+#include "midx.h"
+
+#define MIDX_HEADER_SIZE 20
+#define MIDX_LARGE_OFFSET 0x80000000
+
+static const char *midx_path(const char *object_dir)
+{
+	return mkpath("%s/pack/multi-pack-index", object_dir);
+}
+
+static const char *pack_basename(const struct packed_git *p)
+{
+	const char *base = strrchr(p->pack_name, '/');
+	return base ? base + 1 : p->pack_name;
+}
+
+struct multi_pack_index *load_multi_pack_index(const char *object_dir)
+{
+	const char *path = midx_path(object_dir);
+	struct multi_pack_index *m;
+	const unsigned char *data;
+	const uint32_t *hdr;
+	struct packed_git *p;
+	struct stat st;
+	size_t size, pos;
+	uint32_t i;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return NULL;
+	}
+	size = xsize_t(st.st_size);
+	if (size < MIDX_HEADER_SIZE + 256 * 4 + 20) {
+		close(fd);
+		error("multi-pack-index %s is too small", path);
+		return NULL;
+	}
+	data = xmmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	hdr = (const uint32_t *)data;
+	if (ntohl(hdr[0]) != MIDX_SIGNATURE ||
+	    ntohl(hdr[1]) != MIDX_VERSION) {
+		munmap((void *)data, size);
+		error("multi-pack-index %s has unknown signature or version",
+		      path);
+		return NULL;
+	}
+
+	m = xcalloc(1, sizeof(*m));
+	m->data = data;
+	m->data_len = size;
+	m->num_packs = ntohl(hdr[2]);
+	m->num_objects = ntohl(hdr[3]);
+	m->num_large_offsets = ntohl(hdr[4]);
+	m->pack_names = xcalloc(m->num_packs, sizeof(*m->pack_names));
+	m->packs = xcalloc(m->num_packs, sizeof(*m->packs));
+
+	pos = MIDX_HEADER_SIZE;
+	for (i = 0; i < m->num_packs; i++) {
+		const char *end = memchr(data + pos, 0, size - pos);
+		if (!end)
+			goto corrupt;
+		m->pack_names[i] = (const char *)data + pos;
+		pos = (const unsigned char *)end + 1 - data;
+	}
+	pos = (pos + 3) & ~3;
+
+	/* the rest has a size fixed by the header; it must add up */
+	if ((size - 20 - 256 * 4) / 28 < m->num_objects ||
+	    pos + 256 * 4 + (off_t)m->num_objects * 28 +
+	    (off_t)m->num_large_offsets * 8 + 20 != size)
+		goto corrupt;
+	m->fanout = data + pos;
+	m->oids = m->fanout + 256 * 4;
+	m->entries = m->oids + (size_t)m->num_objects * 20;
+	m->large_offsets = m->entries + (size_t)m->num_objects * 8;
+	if (ntohl(((const uint32_t *)m->fanout)[255]) != m->num_objects)
+		goto corrupt;
+
+	for (p = packed_git; p; p = p->next) {
+		if (!p->pack_local)
+			continue;
+		for (i = 0; i < m->num_packs; i++) {
+			if (!strcmp(pack_basename(p), m->pack_names[i])) {
+				m->packs[i] = p;
+				p->pack_in_midx = 1;
+				break;
+			}
+		}
+	}
+	return m;
+
+corrupt:
+	error("multi-pack-index %s is corrupt", path);
+	close_multi_pack_index(m);
+	return NULL;
+}
+
+void close_multi_pack_index(struct multi_pack_index *m)
+{
+	if (!m)
+		return;
+	munmap((void *)m->data, m->data_len);
+	free(m->pack_names);
+	free(m->packs);
+	free(m);
+}
+
+static off_t nth_midx_offset(const struct multi_pack_index *m, uint32_t n,
+			     uint32_t *pack_id)
+{
+	const uint32_t *entry = (const uint32_t *)(m->entries + 8 * n);
+	uint32_t off = ntohl(entry[1]);
+
+	*pack_id = ntohl(entry[0]);
+	if (!(off & MIDX_LARGE_OFFSET))
+		return off;
+	off &= ~MIDX_LARGE_OFFSET;
+	if (off >= m->num_large_offsets)
+		return 0;
+	entry = (const uint32_t *)(m->large_offsets + 8 * off);
+	return (((uint64_t)ntohl(entry[0])) << 32) | ntohl(entry[1]);
+}
+
+static int midx_pos(const struct multi_pack_index *m, const unsigned char *sha1)
+{
+	const uint32_t *fanout = (const uint32_t *)m->fanout;
+	unsigned lo, hi;
+
+	hi = ntohl(fanout[*sha1]);
+	lo = (*sha1 == 0x0) ? 0 : ntohl(fanout[*sha1 - 1]);
+	while (lo < hi) {
+		unsigned mi = (lo + hi) / 2;
+		int cmp = hashcmp(m->oids + 20 * mi, sha1);
+
+		if (!cmp)
+			return mi;
+		if (cmp > 0)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+	return -1;
+}
+
+/*
+ * Returns 1 and fills "e" if the object is in one of the indexed packs,
+ * 0 if none of them has it, and -1 if it was recorded for a pack that
+ * is not available anymore (the caller has to look at all packs then).
+ */
+int midx_find_entry(struct multi_pack_index *m, const unsigned char *sha1,
+		    struct pack_entry *e)
+{
+	uint32_t pack_id;
+	off_t offset;
+	int pos = midx_pos(m, sha1);
+
+	if (pos < 0)
+		return 0;
+	offset = nth_midx_offset(m, pos, &pack_id);
+	if (pack_id >= m->num_packs || !m->packs[pack_id] || !offset)
+		return -1;
+	e->p = m->packs[pack_id];
+	e->offset = offset;
+	hashcpy(e->sha1, sha1);
+	return 1;
+}
+
+void midx_forget_pack(struct multi_pack_index *m, struct packed_git *p)
+{
+	uint32_t i;
+
+	if (!m)
+		return;
+	for (i = 0; i < m->num_packs; i++)
+		if (m->packs[i] == p)
+			m->packs[i] = NULL;
+	p->pack_in_midx = 0;
+}
+
+struct midx_entry {
+	unsigned char sha1[20];
+	uint32_t pack_id;
+	off_t offset;
+};
+
+static int midx_entry_cmp(const void *a_, const void *b_)
+{
+	const struct midx_entry *a = a_;
+	const struct midx_entry *b = b_;
+	int cmp = hashcmp(a->sha1, b->sha1);
+
+	if (cmp)
+		return cmp;
+	return a->pack_id < b->pack_id ? -1 : a->pack_id > b->pack_id;
+}
+
+static void write_be32(struct sha1file *f, uint32_t v)
+{
+	v = htonl(v);
+	sha1write(f, &v, 4);
+}
+
+int write_multi_pack_index(void)
+{
+	static struct lock_file lock;
+	const char *path;
+	struct packed_git *p, **packs = NULL;
+	struct midx_entry *entries;
+	struct sha1file *f;
+	uint32_t nr_packs = 0, alloc_packs = 0, nr = 0, nr_large = 0;
+	uint32_t i, j, written;
+
+	prepare_packed_git();
+	for (p = packed_git; p; p = p->next) {
+		if (!p->pack_local || open_pack_index(p))
+			continue;
+		ALLOC_GROW(packs, nr_packs + 1, alloc_packs);
+		packs[nr_packs++] = p;
+		nr += p->num_objects;
+	}
+
+	path = xstrdup(midx_path(get_object_directory()));
+	if (!nr_packs) {
+		if (unlink(path) && errno != ENOENT)
+			return error("unable to remove %s: %s",
+				     path, strerror(errno));
+		return 0;
+	}
+
+	entries = xmalloc(sizeof(*entries) * nr);
+	nr = 0;
+	for (i = 0; i < nr_packs; i++) {
+		p = packs[i];
+		for (j = 0; j < p->num_objects; j++) {
+			struct midx_entry *e = &entries[nr++];
+			hashcpy(e->sha1, nth_packed_object_sha1(p, j));
+			e->offset = nth_packed_object_offset(p, j);
+			e->pack_id = i;
+		}
+	}
+	qsort(entries, nr, sizeof(*entries), midx_entry_cmp);
+	for (i = j = 0; i < nr; i++) {
+		if (j && !hashcmp(entries[j - 1].sha1, entries[i].sha1))
+			continue;
+		entries[j++] = entries[i];
+		if (entries[i].offset >= MIDX_LARGE_OFFSET)
+			nr_large++;
+	}
+	nr = j;
+
+	hold_lock_file_for_update(&lock, path, LOCK_DIE_ON_ERROR);
+	f = sha1fd(lock.fd, path);
+
+	write_be32(f, MIDX_SIGNATURE);
+	write_be32(f, MIDX_VERSION);
+	write_be32(f, nr_packs);
+	write_be32(f, nr);
+	write_be32(f, nr_large);
+
+	written = 0;
+	for (i = 0; i < nr_packs; i++) {
+		const char *name = pack_basename(packs[i]);
+		sha1write(f, (void *)name, strlen(name) + 1);
+		written += strlen(name) + 1;
+	}
+	if (written & 3) {
+		static char pad[4];
+		sha1write(f, pad, 4 - (written & 3));
+	}
+
+	for (i = j = 0; i < 256; i++) {
+		while (j < nr && entries[j].sha1[0] == i)
+			j++;
+		write_be32(f, j);
+	}
+
+	for (i = 0; i < nr; i++)
+		sha1write(f, entries[i].sha1, 20);
+
+	for (i = j = 0; i < nr; i++) {
+		write_be32(f, entries[i].pack_id);
+		if (entries[i].offset < MIDX_LARGE_OFFSET)
+			write_be32(f, entries[i].offset);
+		else
+			write_be32(f, MIDX_LARGE_OFFSET | j++);
+	}
+
+	for (i = 0; i < nr; i++) {
+		uint64_t offset = entries[i].offset;
+		if (offset < MIDX_LARGE_OFFSET)
+			continue;
+		write_be32(f, offset >> 32);
+		write_be32(f, offset & 0xffffffff);
+	}
+
+	sha1close(f, NULL, CSUM_FSYNC);
+	lock.fd = -1;
+	if (commit_lock_file(&lock))
+		die("unable to write %s: %s", path, strerror(errno));
+
+	free(entries);
+	free(packs);
+	free((char *)path);
+	return 0;
+}
+
+int verify_multi_pack_index(void)
+{
+	struct multi_pack_index *m;
+	const uint32_t *fanout;
+	git_SHA_CTX ctx;
+	unsigned char sha1[20];
+	uint32_t i, j, pack_id;
+	int errors = 0;
+
+	prepare_packed_git();
+	m = load_multi_pack_index(get_object_directory());
+	if (!m)
+		return access(midx_path(get_object_directory()), F_OK) ? 0 : -1;
+
+	git_SHA1_Init(&ctx);
+	git_SHA1_Update(&ctx, m->data, m->data_len - 20);
+	git_SHA1_Final(sha1, &ctx);
+	if (hashcmp(sha1, m->data + m->data_len - 20))
+		errors |= error("multi-pack-index checksum mismatch");
+
+	for (i = 0; i < m->num_packs; i++)
+		if (!m->packs[i])
+			errors |= error("multi-pack-index refers to missing pack %s",
+					m->pack_names[i]);
+
+	fanout = (const uint32_t *)m->fanout;
+	for (i = 0; i < 255; i++)
+		if (ntohl(fanout[i]) > ntohl(fanout[i + 1]))
+			errors |= error("multi-pack-index fan-out is not sorted");
+
+	for (i = 0; i < m->num_objects; i++) {
+		const unsigned char *oid = m->oids + 20 * i;
+		off_t offset = nth_midx_offset(m, i, &pack_id);
+
+		if (i && hashcmp(oid - 20, oid) >= 0)
+			errors |= error("multi-pack-index object %s is out of order",
+					sha1_to_hex(oid));
+		if (pack_id >= m->num_packs) {
+			errors |= error("multi-pack-index object %s has bad pack id %u",
+					sha1_to_hex(oid), pack_id);
+			continue;
+		}
+		if (!m->packs[pack_id])
+			continue;
+		if (find_pack_entry_one(oid, m->packs[pack_id]) != offset)
+			errors |= error("multi-pack-index has wrong offset for %s in %s",
+					sha1_to_hex(oid), m->pack_names[pack_id]);
+	}
+
+	/* every object of an indexed pack must be found through the index */
+	for (i = 0; i < m->num_packs; i++) {
+		struct packed_git *p = m->packs[i];
+		if (!p || open_pack_index(p))
+			continue;
+		for (j = 0; j < p->num_objects; j++) {
+			const unsigned char *oid = nth_packed_object_sha1(p, j);
+			if (midx_pos(m, oid) < 0)
+				errors |= error("object %s in %s is missing from multi-pack-index",
+						sha1_to_hex(oid), m->pack_names[i]);
+		}
+	}
+
+	close_multi_pack_index(m);
+	return errors;
+}
@@ -0,0 +1,37 @@
+#ifndef MIDX_H
+#define MIDX_H
+
+/*
+ * A multi-pack index ("$GIT_OBJECT_DIRECTORY/pack/multi-pack-index")
+ * lists the objects of all local packs in a single sorted table, so
+ * that an object lookup costs one binary search instead of one per
+ * pack.  Packs that appear after the file was written are simply not
+ * covered by it and are searched the old way.
+ */
+struct multi_pack_index {
+	const unsigned char *data;
+	size_t data_len;
+	uint32_t num_packs;
+	uint32_t num_objects;
+	uint32_t num_large_offsets;
+	const unsigned char *fanout;
+	const unsigned char *oids;
+	const unsigned char *entries;
+	const unsigned char *large_offsets;
+	const char **pack_names;
+	struct packed_git **packs;
+};
+
+#define MIDX_SIGNATURE 0x4d494458 /* "MIDX" */
+#define MIDX_VERSION 1
+
+extern struct multi_pack_index *load_multi_pack_index(const char *object_dir);
+extern void close_multi_pack_index(struct multi_pack_index *m);
+extern int midx_find_entry(struct multi_pack_index *m, const unsigned char *sha1, struct pack_entry *e);
+extern void midx_forget_pack(struct multi_pack_index *m, struct packed_git *p);
+
+/* These work on the local packs of the repository. */
+extern int write_multi_pack_index(void);
+extern int verify_multi_pack_index(void);
+
+#endif
@@ -4,18 +4,39 @@
 #include "tree.h"
 #include "commit.h"
 #include "tag.h"
+#include "tree-walk.h"
+
+/*
+ * The object table is an open-addressing hash table with linear
+ * probing.  Next to each object pointer a slot keeps another 32 bits
+ * of the object name, so that a probe can reject most entries that do
+ * not match without touching the object itself.
+ *
+ * When the table gets half full, a table twice as large takes over for
+ * insertions, and every insertion moves a few slots of the old table
+ * into it; until the old table is empty, lookups search both.
+ */
+struct obj_hash_slot {
+	unsigned int hash;
+	struct object *obj;
+};
+
+static struct obj_hash_slot *obj_hash, *old_obj_hash;
+static int nr_objs, obj_hash_size, old_obj_hash_size, old_obj_hash_moved;
 
-static struct object **obj_hash;
-static int nr_objs, obj_hash_size;
+#define OBJ_HASH_MOVE_STEP 8
+
+static void finish_moving_old_objects(void);
 
 unsigned int get_max_object_index(void)
 {
+	finish_moving_old_objects();
 	return obj_hash_size;
 }
 
 struct object *get_indexed_object(unsigned int idx)
 {
-	return obj_hash[idx];
+	return obj_hash[idx].obj;
 }
 
 static const char *object_type_strings[] = {
@@ -43,65 +64,91 @@ int type_from_string(const char *str)
 	die("invalid object type \"%s\"", str);
 }
 
-static unsigned int hash_obj(struct object *obj, unsigned int n)
+static inline unsigned int sha1_slot(const unsigned char *sha1)
 {
-	unsigned int hash = *(unsigned int *)obj->sha1;
-	return hash % n;
+	unsigned int i;
+	memcpy(&i, sha1, sizeof(unsigned int));
+	return i;
 }
 
-static void insert_obj_hash(struct object *obj, struct object **hash, unsigned int size)
+static inline unsigned int sha1_fingerprint(const unsigned char *sha1)
 {
-	int j = hash_obj(obj, size);
+	unsigned int i;
+	memcpy(&i, sha1 + sizeof(unsigned int), sizeof(unsigned int));
+	return i;
+}
 
-	while (hash[j]) {
-		j++;
-		if (j >= size)
-			j = 0;
-	}
-	hash[j] = obj;
+static void insert_obj_hash(struct object *obj, struct obj_hash_slot *hash, unsigned int size)
+{
+	unsigned int j = sha1_slot(obj->sha1) & (size - 1);
+
+	while (hash[j].obj)
+		j = (j + 1) & (size - 1);
+	hash[j].hash = sha1_fingerprint(obj->sha1);
+	hash[j].obj = obj;
 }
 
-static int hashtable_index(const unsigned char *sha1)
+static struct object *find_obj_hash(const unsigned char *sha1,
+				    struct obj_hash_slot *hash, unsigned int size)
 {
-	unsigned int i;
-	memcpy(&i, sha1, sizeof(unsigned int));
-	return (int)(i % obj_hash_size);
+	unsigned int i = sha1_slot(sha1) & (size - 1);
+	unsigned int fingerprint = sha1_fingerprint(sha1);
+	struct object *obj;
+
+	while ((obj = hash[i].obj) != NULL) {
+		if (hash[i].hash == fingerprint && !hashcmp(sha1, obj->sha1))
+			return obj;
+		i = (i + 1) & (size - 1);
+	}
+	return NULL;
 }
 
 struct object *lookup_object(const unsigned char *sha1)
 {
-	int i;
 	struct object *obj;
 
 	if (!obj_hash)
 		return NULL;
 
-	i = hashtable_index(sha1);
-	while ((obj = obj_hash[i]) != NULL) {
-		if (!hashcmp(sha1, obj->sha1))
-			break;
-		i++;
-		if (i == obj_hash_size)
-			i = 0;
-	}
+	obj = find_obj_hash(sha1, obj_hash, obj_hash_size);
+	if (!obj && old_obj_hash)
+		obj = find_obj_hash(sha1, old_obj_hash, old_obj_hash_size);
 	return obj;
 }
 
+/*
+ * Move up to "n" slots of the old table into the current one.  The old
+ * table is not changed, so that the probe sequences of the objects that
+ * are still to be moved stay intact.
+ */
+static void move_old_objects(int n)
+{
+	while (n-- > 0 && old_obj_hash_moved < old_obj_hash_size) {
+		struct object *obj = old_obj_hash[old_obj_hash_moved++].obj;
+		if (obj)
+			insert_obj_hash(obj, obj_hash, obj_hash_size);
+	}
+	if (old_obj_hash_moved == old_obj_hash_size) {
+		free(old_obj_hash);
+		old_obj_hash = NULL;
+	}
+}
+
+static void finish_moving_old_objects(void)
+{
+	if (old_obj_hash)
+		move_old_objects(old_obj_hash_size);
+}
+
 static void grow_object_hash(void)
 {
-	int i;
 	int new_hash_size = obj_hash_size < 32 ? 32 : 2 * obj_hash_size;
-	struct object **new_hash;
-
-	new_hash = xcalloc(new_hash_size, sizeof(struct object *));
-	for (i = 0; i < obj_hash_size; i++) {
-		struct object *obj = obj_hash[i];
-		if (!obj)
-			continue;
-		insert_obj_hash(obj, new_hash, new_hash_size);
-	}
-	free(obj_hash);
-	obj_hash = new_hash;
+
+	finish_moving_old_objects();
+	old_obj_hash = obj_hash;
+	old_obj_hash_size = obj_hash_size;
+	old_obj_hash_moved = 0;
+	obj_hash = xcalloc(new_hash_size, sizeof(*obj_hash));
 	obj_hash_size = new_hash_size;
 }
 
@@ -120,6 +167,8 @@ void *create_object(const unsigned char *sha1, int type, void *o)
 
 	insert_obj_hash(obj, obj_hash, obj_hash_size);
 	nr_objs++;
+	if (old_obj_hash)
+		move_old_objects(OBJ_HASH_MOVE_STEP);
 	return obj;
 }
 
@@ -131,6 +180,40 @@ struct object *lookup_unknown_object(const unsigned char *sha1)
 	return obj;
 }
 
+static void free_object_data(struct object *obj)
+{
+	switch (obj->type) {
+	case OBJ_COMMIT: {
+		struct commit *commit = (struct commit *)obj;
+		free(commit->buffer);
+		free_commit_list(commit->parents);
+		break;
+	}
+	case OBJ_TREE:
+		free(((struct tree *)obj)->buffer);
+		free_parsed_tree((struct tree *)obj);
+		break;
+	case OBJ_TAG:
+		free(((struct tag *)obj)->tag);
+		break;
+	}
+}
+
+void clear_parsed_objects(void)
+{
+	int i;
+
+	finish_moving_old_objects();
+	for (i = 0; i < obj_hash_size; i++)
+		if (obj_hash[i].obj)
+			free_object_data(obj_hash[i].obj);
+	free(obj_hash);
+	obj_hash = NULL;
+	obj_hash_size = 0;
+	nr_objs = 0;
+	release_object_nodes();
+}
+
 struct object *parse_object_buffer(const unsigned char *sha1, enum object_type type, unsigned long size, void *buffer, int *eaten_p)
 {
 	struct object *obj;
@@ -69,6 +69,14 @@ struct object *parse_object_buffer(const unsigned char *sha1, enum object_type t
 /** Returns the object, with potentially excess memory allocated. **/
 struct object *lookup_unknown_object(const unsigned  char *sha1);
 
+/*
+ * Forget every object we have heard of, and free them along with their
+ * buffers and parent lists.  Anything still pointing at an object
+ * (including a commit's util) is left dangling, so this is only for a
+ * program that is done with one walk and about to start another.
+ */
+extern void clear_parsed_objects(void);
+
 struct object_list *object_list_insert(struct object *item,
 				       struct object_list **list_p);
 
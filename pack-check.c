@@ -1,6 +1,7 @@
 #include "cache.h"
 #include "pack.h"
 #include "pack-revindex.h"
+#include "sha1-batch.h"
 
 struct idx_entry
 {
@@ -42,6 +43,24 @@ int check_pack_crc(struct packed_git *p, struct pack_window **w_curs,
 	return data_crc != ntohl(*index_crc);
 }
 
+/*
+ * Check the names of a batch of unpacked objects and free them.
+ */
+static int check_batch(struct packed_git *p, struct idx_entry **batch,
+		       struct sha1_job *jobs, int nr)
+{
+	int i, err = 0;
+
+	git_SHA1_Batch(jobs, nr);
+	for (i = 0; i < nr; i++) {
+		if (!err && hashcmp(jobs[i].sha1, batch[i]->sha1))
+			err = error("packed %s from %s is corrupt",
+				    sha1_to_hex(batch[i]->sha1), p->pack_name);
+		free((void *)jobs[i].data);
+	}
+	return err;
+}
+
 static int verify_packfile(struct packed_git *p,
 		struct pack_window **w_curs)
 {
@@ -53,6 +72,10 @@ static int verify_packfile(struct packed_git *p,
 	uint32_t nr_objects, i;
 	int err = 0;
 	struct idx_entry *entries;
+	struct idx_entry *batch[SHA1_BATCH_JOBS];
+	struct sha1_job jobs[SHA1_BATCH_JOBS];
+	unsigned long batch_bytes = 0;
+	int nr = 0;
 
 	/* Note that the pack header checks are actually performed by
 	 * use_pack when it first opens the pack file.  If anything
@@ -118,14 +141,21 @@ static int verify_packfile(struct packed_git *p,
 				    (uintmax_t)entries[i].offset);
 			break;
 		}
-		if (check_sha1_signature(entries[i].sha1, data, size, typename(type))) {
-			err = error("packed %s from %s is corrupt",
-				    sha1_to_hex(entries[i].sha1), p->pack_name);
-			free(data);
-			break;
+		sha1_job_init(&jobs[nr], data, size, typename(type));
+		batch[nr++] = &entries[i];
+		batch_bytes += size;
+		if (nr == SHA1_BATCH_JOBS || batch_bytes >= SHA1_BATCH_BYTES) {
+			int batch_err = check_batch(p, batch, jobs, nr);
+			nr = 0;
+			batch_bytes = 0;
+			if (batch_err) {
+				err = batch_err;
+				break;
+			}
 		}
-		free(data);
 	}
+	if (nr && check_batch(p, batch, jobs, nr))
+		err = -1;
 	free(entries);
 
 	return err;
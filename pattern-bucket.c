@@ -0,0 +1,137 @@
+#include "cache.h"
+#include "pattern-bucket.h"
+
+static unsigned hash_key(const char *key, int len)
+{
+	unsigned val = 0;
+
+	while (len--)
+		val = ((val << 7) | (val >> 22)) ^ (unsigned char)*key++;
+	return val;
+}
+
+static struct pattern_bucket *find_bucket(const struct hash_table *table,
+					  const char *key, int len)
+{
+	struct pattern_bucket *b;
+
+	for (b = lookup_hash(hash_key(key, len), table); b; b = b->next)
+		if (!strncmp(b->key, key, len) && !b->key[len])
+			return b;
+	return NULL;
+}
+
+static struct pattern_bucket *add_to_bucket(struct hash_table *table,
+					    const char *key, int i)
+{
+	int len = strlen(key);
+	struct pattern_bucket *b = find_bucket(table, key, len);
+
+	if (!b) {
+		void **pos;
+		b = xcalloc(1, sizeof(*b) + len + 1);
+		memcpy(b->key, key, len);
+		pos = insert_hash(hash_key(key, len), b, table);
+		if (pos) {
+			b->next = *pos;
+			*pos = b;
+		}
+	}
+	ALLOC_GROW(b->match, b->nr + 1, b->alloc);
+	b->match[b->nr++] = i;
+	return b;
+}
+
+struct pattern_bucket *add_basename_pattern(struct pattern_buckets *pb,
+					    const char *basename, int i)
+{
+	return add_to_bucket(&pb->basenames, basename, i);
+}
+
+struct pattern_bucket *add_extension_pattern(struct pattern_buckets *pb,
+					     const char *extension, int i)
+{
+	return add_to_bucket(&pb->extensions, extension, i);
+}
+
+void add_glob_pattern(struct pattern_buckets *pb, int i)
+{
+	ALLOC_GROW(pb->globs, pb->globs_nr + 1, pb->globs_alloc);
+	pb->globs[pb->globs_nr++] = i;
+}
+
+void drop_last_pattern(struct pattern_buckets *pb,
+		       struct pattern_bucket *bucket)
+{
+	if (bucket)
+		bucket->nr--;
+	else
+		pb->globs_nr--;
+}
+
+static int free_bucket(void *ptr)
+{
+	struct pattern_bucket *b = ptr;
+
+	while (b) {
+		struct pattern_bucket *next = b->next;
+		free(b->match);
+		free(b);
+		b = next;
+	}
+	return 0;
+}
+
+void clear_pattern_buckets(struct pattern_buckets *pb)
+{
+	for_each_hash(&pb->basenames, free_bucket);
+	free_hash(&pb->basenames);
+	for_each_hash(&pb->extensions, free_bucket);
+	free_hash(&pb->extensions);
+	free(pb->globs);
+	pb->globs = NULL;
+	pb->globs_nr = pb->globs_alloc = 0;
+}
+
+void init_pattern_candidates(struct pattern_candidates *c,
+			     const struct pattern_buckets *pb,
+			     const char *basename, int namelen)
+{
+	int dot;
+
+	for (dot = namelen - 1; 0 <= dot; dot--)
+		if (basename[dot] == '.')
+			break;
+	c->name = find_bucket(&pb->basenames, basename, namelen);
+	c->ext = NULL;
+	if (0 <= dot)
+		c->ext = find_bucket(&pb->extensions, basename + dot + 1,
+				     namelen - dot - 1);
+	c->globs = pb->globs;
+	c->n = c->name ? c->name->nr - 1 : -1;
+	c->e = c->ext ? c->ext->nr - 1 : -1;
+	c->g = pb->globs_nr - 1;
+}
+
+int next_pattern_candidate(struct pattern_candidates *c)
+{
+	int i = -1;
+
+	/* the latest of what is left in each of the three lists */
+	if (0 <= c->n)
+		i = c->name->match[c->n];
+	if (0 <= c->e && i < c->ext->match[c->e])
+		i = c->ext->match[c->e];
+	if (0 <= c->g && i < c->globs[c->g])
+		i = c->globs[c->g];
+	if (i < 0)
+		return -1;
+
+	if (0 <= c->n && i == c->name->match[c->n])
+		c->n--;
+	else if (0 <= c->e && i == c->ext->match[c->e])
+		c->e--;
+	else
+		c->g--;
+	return i;
+}
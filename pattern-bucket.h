@@ -0,0 +1,62 @@
+#ifndef PATTERN_BUCKET_H
+#define PATTERN_BUCKET_H
+
+#include "hash.h"
+
+/*
+ * To find the patterns of a list that may match a path without trying
+ * each in turn, those that are a literal basename and those that are
+ * "*" followed by a literal with a dot in it (e.g. "*.c" or "*.tar.gz")
+ * are filed in buckets, by the basename and by what follows the last
+ * dot.  Only the other patterns, the globs, are left to be tried
+ * against every path.  Patterns are known by their position in the
+ * caller's list, and must be added in the order of that list.
+ */
+struct pattern_bucket {
+	struct pattern_bucket *next;	/* another key with the same hash */
+	int nr, alloc;
+	int *match;			/* positions, in order */
+	char key[FLEX_ARRAY];		/* outlives the pattern it came from */
+};
+
+struct pattern_buckets {
+	struct hash_table basenames;
+	struct hash_table extensions;
+	int globs_nr, globs_alloc;
+	int *globs;
+};
+
+/* Each returns the bucket pattern "i" went in. */
+extern struct pattern_bucket *add_basename_pattern(struct pattern_buckets *pb,
+						   const char *basename, int i);
+extern struct pattern_bucket *add_extension_pattern(struct pattern_buckets *pb,
+						    const char *extension, int i);
+extern void add_glob_pattern(struct pattern_buckets *pb, int i);
+
+/*
+ * Forget the last pattern added; "bucket" is what adding it returned,
+ * NULL for a glob.
+ */
+extern void drop_last_pattern(struct pattern_buckets *pb,
+			      struct pattern_bucket *bucket);
+
+extern void clear_pattern_buckets(struct pattern_buckets *pb);
+
+/*
+ * The patterns that may match a basename: those in its two buckets and
+ * the globs.  next_pattern_candidate() gives their positions from the
+ * last one up, the order the whole list would be tried in, and -1 at
+ * the end.  Whether each really matches is for the caller to check.
+ */
+struct pattern_candidates {
+	const struct pattern_bucket *name, *ext;
+	const int *globs;
+	int n, e, g;
+};
+
+extern void init_pattern_candidates(struct pattern_candidates *c,
+				    const struct pattern_buckets *pb,
+				    const char *basename, int namelen);
+extern int next_pattern_candidate(struct pattern_candidates *c);
+
+#endif /* PATTERN_BUCKET_H */
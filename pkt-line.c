@@ -1,5 +1,6 @@
 #include "cache.h"
 #include "pkt-line.h"
+#include "sideband.h"
 
 /*
  * Write a packetized stream, where each line is preceded by
@@ -72,15 +73,11 @@ static void safe_read(int fd, void *buffer, unsigned size)
 		die("The remote end hung up unexpectedly");
 }
 
-int packet_read_line(int fd, char *buffer, unsigned size)
+static int packet_length(const char *linelen)
 {
 	int n;
-	unsigned len;
-	char linelen[4];
+	int len = 0;
 
-	safe_read(fd, linelen, 4);
-
-	len = 0;
 	for (n = 0; n < 4; n++) {
 		unsigned char c = linelen[n];
 		len <<= 4;
@@ -96,8 +93,21 @@ int packet_read_line(int fd, char *buffer, unsigned size)
 			len += c - 'A' + 10;
 			continue;
 		}
-		die("protocol error: bad line length character");
+		return -1;
 	}
+	return len;
+}
+
+int packet_read_line(int fd, char *buffer, unsigned size)
+{
+	int len;
+	char linelen[4];
+
+	safe_read(fd, linelen, 4);
+
+	len = packet_length(linelen);
+	if (len < 0)
+		die("protocol error: bad line length character");
 	if (!len)
 		return 0;
 	len -= 4;
@@ -107,3 +117,51 @@ int packet_read_line(int fd, char *buffer, unsigned size)
 	buffer[len] = 0;
 	return len;
 }
+
+int packet_write_gently(int fd, const char *buf, size_t size)
+{
+	static char hexchar[] = "0123456789abcdef";
+	char header[4];
+
+	while (size) {
+		unsigned n = size < LARGE_PACKET_MAX - 4 ? size : LARGE_PACKET_MAX - 4;
+		header[0] = hex((n + 4) >> 12);
+		header[1] = hex((n + 4) >> 8);
+		header[2] = hex((n + 4) >> 4);
+		header[3] = hex(n + 4);
+		if (write_in_full(fd, header, 4) < 0 ||
+		    write_in_full(fd, buf, n) < 0)
+			return -1;
+		buf += n;
+		size -= n;
+	}
+	return 0;
+}
+
+int packet_flush_gently(int fd)
+{
+	return write_in_full(fd, "0000", 4) < 0 ? -1 : 0;
+}
+
+/*
+ * Like packet_read_line(), but returns -1 on a short read or a bad
+ * packet instead of dying.
+ */
+int packet_read_gently(int fd, char *buffer, unsigned size)
+{
+	int len;
+	char linelen[4];
+
+	if (read_in_full(fd, linelen, 4) != 4)
+		return -1;
+	len = packet_length(linelen);
+	if (len < 0 || (len && len < 4))
+		return -1;
+	if (!len)
+		return 0;
+	len -= 4;
+	if (len >= size || read_in_full(fd, buffer, len) != len)
+		return -1;
+	buffer[len] = 0;
+	return len;
+}
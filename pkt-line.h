@@ -10,6 +10,15 @@ void packet_flush(int fd);
 void packet_write(int fd, const char *fmt, ...) __attribute__((format (printf, 2, 3)));
 
 int packet_read_line(int fd, char *buffer, unsigned size);
+
+/*
+ * For talking to a local helper that may go away: these return -1
+ * instead of dying.  packet_write_gently() cuts "size" bytes into as
+ * many packets as it takes.
+ */
+int packet_write_gently(int fd, const char *buf, size_t size);
+int packet_flush_gently(int fd);
+int packet_read_gently(int fd, char *buffer, unsigned size);
 ssize_t safe_write(int, const void *, ssize_t);
 
 #endif
@@ -0,0 +1,38 @@
+#ifndef PRIO_QUEUE_H
+#define PRIO_QUEUE_H
+
+/*
+ * A priority queue of pointers, kept as a binary heap.
+ *
+ * "compare" returns a negative number if its first argument should come
+ * out of the queue before the second, and a positive one if after.
+ * Things that compare equal come out in the order they were put in, so
+ * a queue of commits ordered by date gives the same order as a list
+ * kept with insert_by_date().
+ */
+typedef int (*prio_queue_compare_fn)(const void *one, const void *two, void *cb_data);
+
+struct prio_queue_entry {
+	unsigned int ctr;
+	void *data;
+};
+
+struct prio_queue {
+	prio_queue_compare_fn compare;
+	void *cb_data;
+	unsigned int insertion_ctr;
+	int nr, alloc;
+	struct prio_queue_entry *array;
+};
+
+extern void prio_queue_put(struct prio_queue *queue, void *thing);
+
+/* Remove and return the first thing, or NULL if the queue is empty. */
+extern void *prio_queue_get(struct prio_queue *queue);
+
+/* Return the first thing without removing it. */
+extern void *prio_queue_peek(struct prio_queue *queue);
+
+extern void clear_prio_queue(struct prio_queue *queue);
+
+#endif /* PRIO_QUEUE_H */
@@ -1139,7 +1139,8 @@ static int verify_hdr(struct cache_header *hdr, unsigned long size)
 
 	if (hdr->hdr_signature != htonl(CACHE_SIGNATURE))
 		return error("bad signature");
-	if (hdr->hdr_version != htonl(2) && hdr->hdr_version != htonl(3))
+	if (hdr->hdr_version != htonl(2) && hdr->hdr_version != htonl(3) &&
+	    hdr->hdr_version != htonl(4))
 		return error("bad index version");
 	git_SHA1_Init(&c);
 	git_SHA1_Update(&c, hdr, size - 20);
@@ -1171,11 +1172,12 @@ int read_index(struct index_state *istate)
 	return read_index_from(istate, get_index_file());
 }
 
-static void convert_from_disk(struct ondisk_cache_entry *ondisk, struct cache_entry *ce)
+/*
+ * Fill "ce" from the fixed-size part of "ondisk" and return where the
+ * name starts on disk; the name itself is left to the caller.
+ */
+static const char *convert_from_disk(struct ondisk_cache_entry *ondisk, struct cache_entry *ce)
 {
-	size_t len;
-	const char *name;
-
 	ce->ce_ctime.sec = ntohl(ondisk->ctime.sec);
 	ce->ce_mtime.sec = ntohl(ondisk->mtime.sec);
 	ce->ce_ctime.nsec = ntohl(ondisk->ctime.nsec);
@@ -1191,8 +1193,6 @@ static void convert_from_disk(struct ondisk_cache_entry *ondisk, struct cache_en
 
 	hashcpy(ce->sha1, ondisk->sha1);
 
-	len = ce->ce_flags & CE_NAMEMASK;
-
 	if (ce->ce_flags & CE_EXTENDED) {
 		struct ondisk_cache_entry_extended *ondisk2;
 		int extended_flags;
@@ -1202,18 +1202,88 @@ static void convert_from_disk(struct ondisk_cache_entry *ondisk, struct cache_en
 		if (extended_flags & ~CE_EXTENDED_FLAGS)
 			die("Unknown index entry format %08x", extended_flags);
 		ce->ce_flags |= extended_flags;
-		name = ondisk2->name;
+		return ondisk2->name;
 	}
-	else
-		name = ondisk->name;
+	return ondisk->name;
+}
 
-	if (len == CE_NAMEMASK)
-		len = strlen(name);
-	/*
-	 * NEEDSWORK: If the original index is crafted, this copy could
-	 * go unchecked.
-	 */
-	memcpy(ce->name, name, len + 1);
+/*
+ * Version 4 does not store each path in full: it says how many bytes
+ * to drop from the end of the previous entry's path, as a varint in
+ * the format used for OFS_DELTA offsets, and gives the NUL-terminated
+ * string to put in their place.  There is no padding after it.
+ */
+static int encode_name_prefix(unsigned char *buf, size_t value)
+{
+	unsigned char varint[16];
+	unsigned pos = sizeof(varint) - 1;
+
+	varint[pos] = value & 127;
+	while (value >>= 7)
+		varint[--pos] = 128 | (--value & 127);
+	memcpy(buf, varint + pos, sizeof(varint) - pos);
+	return sizeof(varint) - pos;
+}
+
+static size_t decode_name_prefix(const unsigned char **bufp,
+				 const char *end)
+{
+	const unsigned char *buf = *bufp;
+	unsigned char c;
+	size_t val;
+
+	if ((const char *)buf >= end)
+		die("index file corrupt");
+	c = *buf++;
+	val = c & 127;
+	while (c & 128) {
+		val += 1;
+		if (!val || (val >> (8 * sizeof(val) - 7)) ||
+		    (const char *)buf >= end)
+			die("index file corrupt");
+		c = *buf++;
+		val = (val << 7) + (c & 127);
+	}
+	*bufp = buf;
+	return val;
+}
+
+/*
+ * Walk the version 4 entries once, only to learn how long each name
+ * is, so that all of them can go into a single allocation.
+ */
+static size_t expanded_cache_size(const char *entries, const char *end,
+				  unsigned int nr)
+{
+	size_t total = 0, len = 0;
+	unsigned int i;
+
+	for (i = 0; i < nr; i++) {
+		struct ondisk_cache_entry *ondisk = (struct ondisk_cache_entry *)entries;
+		const unsigned char *name;
+		const char *nul;
+		size_t strip, suffix;
+
+		if (end - entries < offsetof(struct ondisk_cache_entry, name))
+			die("index file corrupt");
+		if (ntohs(ondisk->flags) & CE_EXTENDED) {
+			if (end - entries <
+			    offsetof(struct ondisk_cache_entry_extended, name))
+				die("index file corrupt");
+			name = (const unsigned char *)
+				((struct ondisk_cache_entry_extended *)ondisk)->name;
+		} else
+			name = (const unsigned char *)ondisk->name;
+		strip = decode_name_prefix(&name, end);
+		nul = memchr(name, '\0', end - (const char *)name);
+		if (strip > len || !nul)
+			die("index file corrupt");
+		suffix = nul - (const char *)name;
+		len = len - strip + suffix;
+		total += cache_entry_size(len);
+		entries = (const char *)name + suffix + 1;
+	}
+	return total;
 }
 
 static inline size_t estimate_cache_size(size_t ondisk_size, unsigned int entries)
@@ -1236,6 +1306,7 @@ int read_index_from(struct index_state *istate, const char *path)
 	int fd, i;
 	struct stat st;
 	unsigned long src_offset, dst_offset;
+	size_t prev_len;
 	struct cache_header *hdr;
 	void *mmap;
 	size_t mmap_size;
@@ -1271,6 +1342,7 @@ int read_index_from(struct index_state *istate, const char *path)
 	if (verify_hdr(hdr, mmap_size) < 0)
 		goto unmap;
 
+	istate->version = ntohl(hdr->hdr_version);
 	istate->cache_nr = ntohl(hdr->hdr_entries);
 	istate->cache_alloc = alloc_nr(istate->cache_nr);
 	istate->cache = xcalloc(istate->cache_alloc, sizeof(struct cache_entry *));
@@ -1279,24 +1351,61 @@ int read_index_from(struct index_state *istate, const char *path)
 	 * The disk format is actually larger than the in-memory format,
 	 * due to space for nsec etc, so even though the in-memory one
 	 * has room for a few  more flags, we can allocate using the same
-	 * index size
+	 * index size.  Version 4 names are shorter on disk than in
+	 * memory, so there we count.
 	 */
-	istate->alloc = xmalloc(estimate_cache_size(mmap_size, istate->cache_nr));
+	src_offset = sizeof(*hdr);
+	if (istate->version == 4)
+		istate->alloc = xmalloc(expanded_cache_size((char *)mmap + src_offset,
+							    (char *)mmap + mmap_size - 20,
+							    istate->cache_nr));
+	else
+		istate->alloc = xmalloc(estimate_cache_size(mmap_size, istate->cache_nr));
 	istate->initialized = 1;
 
-	src_offset = sizeof(*hdr);
 	dst_offset = 0;
+	prev_len = 0;
 	for (i = 0; i < istate->cache_nr; i++) {
 		struct ondisk_cache_entry *disk_ce;
 		struct cache_entry *ce;
+		const char *name;
+		size_t len;
 
 		disk_ce = (struct ondisk_cache_entry *)((char *)mmap + src_offset);
 		ce = (struct cache_entry *)((char *)istate->alloc + dst_offset);
-		convert_from_disk(disk_ce, ce);
+		name = convert_from_disk(disk_ce, ce);
+
+		if (istate->version == 4) {
+			const unsigned char *cp = (const unsigned char *)name;
+			size_t strip = decode_name_prefix(&cp,
+					(char *)mmap + mmap_size - 20);
+
+			size_t suffix = strlen((const char *)cp);
+
+			/* checked by expanded_cache_size() */
+			len = prev_len - strip;
+			if (len)
+				memcpy(ce->name, istate->cache[i - 1]->name, len);
+			memcpy(ce->name + len, cp, suffix + 1);
+			len += suffix;
+			if ((ce->ce_flags & CE_NAMEMASK) !=
+			    (len < CE_NAMEMASK ? len : CE_NAMEMASK))
+				goto unmap;
+			src_offset = (const char *)cp + suffix + 1 - (const char *)mmap;
+			prev_len = len;
+		} else {
+			len = ce->ce_flags & CE_NAMEMASK;
+			if (len == CE_NAMEMASK)
+				len = strlen(name);
+			/*
+			 * NEEDSWORK: If the original index is crafted, this copy could
+			 * go unchecked.
+			 */
+			memcpy(ce->name, name, len + 1);
+			src_offset += ondisk_ce_size(ce);
+		}
 		set_index_entry(istate, i, ce);
-
-		src_offset += ondisk_ce_size(ce);
-		dst_offset += ce_size(ce);
+		dst_offset += cache_entry_size(len);
 	}
 	istate->timestamp.sec = st.st_mtime;
 	istate->timestamp.nsec = ST_MTIME_NSEC(st);
@@ -1339,6 +1448,7 @@ int discard_index(struct index_state *istate)
 	istate->cache_changed = 0;
 	istate->timestamp.sec = 0;
 	istate->timestamp.nsec = 0;
+	istate->version = 0;
 	istate->name_hash_initialized = 0;
 	free_hash(&istate->name_hash);
 	cache_tree_free(&(istate->cache_tree));
@@ -1478,11 +1588,13 @@ static void ce_smudge_racily_clean_entry(struct cache_entry *ce)
 	}
 }
 
-static int ce_write_entry(git_SHA_CTX *c, int fd, struct cache_entry *ce)
+static int ce_write_entry(git_SHA_CTX *c, int fd, struct cache_entry *ce,
+			  struct strbuf *previous_name)
 {
 	int size = ondisk_ce_size(ce);
 	struct ondisk_cache_entry *ondisk = xcalloc(1, size);
 	char *name;
+	int result;
 
 	ondisk->ctime.sec = htonl(ce->ce_ctime.sec);
 	ondisk->mtime.sec = htonl(ce->ce_mtime.sec);
@@ -1504,9 +1616,27 @@ static int ce_write_entry(git_SHA_CTX *c, int fd, struct cache_entry *ce)
 	}
 	else
 		name = ondisk->name;
-	memcpy(name, ce->name, ce_namelen(ce));
 
-	return ce_write(c, fd, ondisk, size);
+	if (previous_name) {
+		size_t len = ce_namelen(ce), common = 0;
+		unsigned char prefix[16];
+		int prefix_len;
+
+		while (common < len && common < previous_name->len &&
+		       ce->name[common] == previous_name->buf[common])
+			common++;
+		prefix_len = encode_name_prefix(prefix, previous_name->len - common);
+		result = ce_write(c, fd, ondisk, name - (char *)ondisk) < 0 ||
+			ce_write(c, fd, prefix, prefix_len) < 0 ||
+			ce_write(c, fd, ce->name + common, len - common + 1) < 0;
+		strbuf_setlen(previous_name, common);
+		strbuf_add(previous_name, ce->name + common, len - common);
+	} else {
+		memcpy(name, ce->name, ce_namelen(ce));
+		result = ce_write(c, fd, ondisk, size) < 0;
+	}
+	free(ondisk);
+	return result ? -1 : 0;
 }
 
 int write_index(struct index_state *istate, int newfd)
@@ -1517,6 +1647,7 @@ int write_index(struct index_state *istate, int newfd)
 	struct cache_entry **cache = istate->cache;
 	int entries = istate->cache_nr;
 	struct stat st;
+	struct strbuf previous_name = STRBUF_INIT;
 
 	for (i = removed = extended = 0; i < entries; i++) {
 		if (cache[i]->ce_flags & CE_REMOVE)
@@ -1532,7 +1663,10 @@ int write_index(struct index_state *istate, int newfd)
 
 	hdr.hdr_signature = htonl(CACHE_SIGNATURE);
 	/* for extended format, increase version so older git won't try to read it */
-	hdr.hdr_version = htonl(extended ? 3 : 2);
+	if (istate->version == 4)
+		hdr.hdr_version = htonl(4);
+	else
+		hdr.hdr_version = htonl(extended ? 3 : 2);
 	hdr.hdr_entries = htonl(entries - removed);
 
 	git_SHA1_Init(&c);
@@ -1545,9 +1679,13 @@ int write_index(struct index_state *istate, int newfd)
 			continue;
 		if (!ce_uptodate(ce) && is_racy_timestamp(istate, ce))
 			ce_smudge_racily_clean_entry(ce);
-		if (ce_write_entry(&c, newfd, ce) < 0)
+		if (ce_write_entry(&c, newfd, ce, istate->version == 4 ?
+				   &previous_name : NULL) < 0) {
+			strbuf_release(&previous_name);
 			return -1;
+		}
 	}
+	strbuf_release(&previous_name);
 
 	/* Write extension data here */
 	if (istate->cache_tree) {
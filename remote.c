@@ -1338,8 +1338,9 @@ int ref_newer(const unsigned char *new_sha1, const unsigned char *old_sha1)
 {
 	struct object *o;
 	struct commit *old, *new;
-	struct commit_list *list, *used;
-	int found = 0;
+	struct prio_queue queue = { compare_commits_by_commit_date };
+	struct commit_list *used;
+	int found = 0, i;
 
 	/* Both new and old must be commit-ish and new is descendant of
 	 * old.  Otherwise we require --force.
@@ -1357,17 +1358,19 @@ int ref_newer(const unsigned char *new_sha1, const unsigned char *old_sha1)
 	if (parse_commit(new) < 0)
 		return 0;
 
-	used = list = NULL;
-	commit_list_insert(new, &list);
-	while (list) {
-		new = pop_most_recent_commit(&list, TMP_MARK);
+	used = NULL;
+	prio_queue_put(&queue, new);
+	while (queue.nr) {
+		new = pop_most_recent_commit(&queue, TMP_MARK);
 		commit_list_insert(new, &used);
 		if (new == old) {
 			found = 1;
 			break;
 		}
 	}
-	unmark_and_free(list, TMP_MARK);
+	for (i = 0; i < queue.nr; i++)
+		((struct commit *)queue.array[i].data)->object.flags &= ~TMP_MARK;
+	clear_prio_queue(&queue);
 	unmark_and_free(used, TMP_MARK);
 	return found;
 }
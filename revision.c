@@ -241,12 +241,12 @@ static struct commit *handle_commit(struct rev_info *revs, struct object *object
 	die("%s is unknown object", name);
 }
 
-static int everybody_uninteresting(struct commit_list *orig)
+static int everybody_uninteresting(struct prio_queue *queue)
 {
-	struct commit_list *list = orig;
-	while (list) {
-		struct commit *commit = list->item;
-		list = list->next;
+	int i;
+
+	for (i = 0; i < queue->nr; i++) {
+		struct commit *commit = queue->array[i].data;
 		if (commit->object.flags & UNINTERESTING)
 			continue;
 		return 0;
@@ -441,26 +441,11 @@ static void try_to_simplify_commit(struct rev_info *revs, struct commit *commit)
 	commit->object.flags |= TREESAME;
 }
 
-static void insert_by_date_cached(struct commit *p, struct commit_list **head,
-		    struct commit_list *cached_base, struct commit_list **cache)
-{
-	struct commit_list *new_entry;
-
-	if (cached_base && p->date < cached_base->item->date)
-		new_entry = insert_by_date(p, &cached_base->next);
-	else
-		new_entry = insert_by_date(p, head);
-
-	if (cache && (!*cache || p->date < (*cache)->item->date))
-		*cache = new_entry;
-}
-
-static int add_parents_to_list(struct rev_info *revs, struct commit *commit,
-		    struct commit_list **list, struct commit_list **cache_ptr)
+static int add_parents_to_queue(struct rev_info *revs, struct commit *commit,
+				struct prio_queue *queue)
 {
 	struct commit_list *parent = commit->parents;
 	unsigned left_flag;
-	struct commit_list *cached_base = cache_ptr ? *cache_ptr : NULL;
 
 	if (commit->object.flags & ADDED)
 		return 0;
@@ -491,7 +476,7 @@ static int add_parents_to_list(struct rev_info *revs, struct commit *commit,
 			if (p->object.flags & SEEN)
 				continue;
 			p->object.flags |= SEEN;
-			insert_by_date_cached(p, list, cached_base, cache_ptr);
+			prio_queue_put(queue, p);
 		}
 		return 0;
 	}
@@ -518,7 +503,7 @@ static int add_parents_to_list(struct rev_info *revs, struct commit *commit,
 		p->object.flags |= left_flag;
 		if (!(p->object.flags & SEEN)) {
 			p->object.flags |= SEEN;
-			insert_by_date_cached(p, list, cached_base, cache_ptr);
+			prio_queue_put(queue, p);
 		}
 		if (revs->first_parent_only)
 			break;
@@ -614,19 +599,21 @@ static void cherry_pick_list(struct commit_list *list, struct rev_info *revs)
 /* How many extra uninteresting commits we want to see.. */
 #define SLOP 5
 
-static int still_interesting(struct commit_list *src, unsigned long date, int slop)
+static int still_interesting(struct prio_queue *src, unsigned long date, int slop)
 {
+	struct commit *most_recent = prio_queue_peek(src);
+
 	/*
 	 * No source list at all? We're definitely done..
 	 */
-	if (!src)
+	if (!most_recent)
 		return 0;
 
 	/*
 	 * Does the destination list contain entries with a date
 	 * before the source list? Definitely _not_ done.
 	 */
-	if (date < src->item->date)
+	if (date < most_recent->date)
 		return SLOP;
 
 	/*
@@ -640,37 +627,44 @@ static int still_interesting(struct commit_list *src, unsigned long date, int sl
 	return slop-1;
 }
 
+static void queue_commit_list(struct prio_queue *queue,
+			      struct commit_list **list)
+{
+	while (*list)
+		prio_queue_put(queue, pop_commit(list));
+}
+
 static int limit_list(struct rev_info *revs)
 {
 	int slop = SLOP;
 	unsigned long date = ~0ul;
-	struct commit_list *list = revs->commits;
+	struct prio_queue queue = { compare_commits_by_commit_date };
 	struct commit_list *newlist = NULL;
 	struct commit_list **p = &newlist;
+	struct commit *commit;
 
-	while (list) {
-		struct commit_list *entry = list;
-		struct commit *commit = list->item;
+	queue_commit_list(&queue, &revs->commits);
+	while ((commit = prio_queue_get(&queue)) != NULL) {
 		struct object *obj = &commit->object;
 		show_early_output_fn_t show;
 
-		list = list->next;
-		free(entry);
-
 		if (revs->max_age != -1 && (commit->date < revs->max_age))
 			obj->flags |= UNINTERESTING;
-		if (add_parents_to_list(revs, commit, &list, NULL) < 0)
+		if (add_parents_to_queue(revs, commit, &queue) < 0) {
+			clear_prio_queue(&queue);
 			return -1;
+		}
 		if (obj->flags & UNINTERESTING) {
 			mark_parents_uninteresting(commit);
 			if (revs->show_all)
 				p = &commit_list_insert(commit, p)->next;
-			slop = still_interesting(list, date, slop);
+			slop = still_interesting(&queue, date, slop);
 			if (slop)
 				continue;
 			/* If showing all, add the whole pending list to the end */
 			if (revs->show_all)
-				*p = list;
+				while ((commit = prio_queue_get(&queue)) != NULL)
+					p = &commit_list_insert(commit, p)->next;
 			break;
 		}
 		if (revs->min_age != -1 && (commit->date > revs->min_age))
@@ -685,6 +679,7 @@ static int limit_list(struct rev_info *revs)
 		show(revs, newlist);
 		show_early_output = NULL;
 	}
+	clear_prio_queue(&queue);
 	if (revs->cherry_pick)
 		cherry_pick_list(newlist, revs);
 
@@ -1579,22 +1574,30 @@ int prepare_revision_walk(struct rev_info *revs)
 {
 	int nr = revs->pending.nr;
 	struct object_array_entry *e, *list;
+	struct prio_queue queue = { compare_commits_by_commit_date };
+	struct commit_list **tail;
+	struct commit *commit;
 
+	queue_commit_list(&queue, &revs->commits);
 	e = list = revs->pending.objects;
 	revs->pending.nr = 0;
 	revs->pending.alloc = 0;
 	revs->pending.objects = NULL;
 	while (--nr >= 0) {
-		struct commit *commit = handle_commit(revs, e->item, e->name);
+		commit = handle_commit(revs, e->item, e->name);
 		if (commit) {
 			if (!(commit->object.flags & SEEN)) {
 				commit->object.flags |= SEEN;
-				insert_by_date(commit, &revs->commits);
+				prio_queue_put(&queue, commit);
 			}
 		}
 		e++;
 	}
 	free(list);
+	tail = &revs->commits;
+	while ((commit = prio_queue_get(&queue)) != NULL)
+		tail = &commit_list_insert(commit, tail)->next;
+	clear_prio_queue(&queue);
 
 	if (revs->no_walk)
 		return 0;
@@ -1618,12 +1621,10 @@ enum rewrite_result {
 
 static enum rewrite_result rewrite_one(struct rev_info *revs, struct commit **pp)
 {
-	struct commit_list *cache = NULL;
-
 	for (;;) {
 		struct commit *p = *pp;
 		if (!revs->limited)
-			if (add_parents_to_list(revs, p, &revs->commits, &cache) < 0)
+			if (add_parents_to_queue(revs, p, &revs->queue) < 0)
 				return rewrite_one_error;
 		if (p->parents && p->parents->next)
 			return rewrite_one_ok;
@@ -1705,15 +1706,24 @@ enum commit_action simplify_commit(struct rev_info *revs, struct commit *commit)
 
 static struct commit *get_revision_1(struct rev_info *revs)
 {
-	if (!revs->commits)
-		return NULL;
+	/*
+	 * Without list limiting the walk happens here, with the commits
+	 * still to be looked at kept in revs->queue.
+	 */
+	if (!revs->limited) {
+		revs->queue.compare = compare_commits_by_commit_date;
+		queue_commit_list(&revs->queue, &revs->commits);
+	}
 
-	do {
-		struct commit_list *entry = revs->commits;
-		struct commit *commit = entry->item;
+	for (;;) {
+		struct commit *commit;
 
-		revs->commits = entry->next;
-		free(entry);
+		if (revs->limited)
+			commit = pop_commit(&revs->commits);
+		else
+			commit = prio_queue_get(&revs->queue);
+		if (!commit)
+			return NULL;
 
 		if (revs->reflog_info)
 			fake_reflog_parent(revs->reflog_info, commit);
@@ -1727,7 +1737,7 @@ static struct commit *get_revision_1(struct rev_info *revs)
 			if (revs->max_age != -1 &&
 			    (commit->date < revs->max_age))
 				continue;
-			if (add_parents_to_list(revs, commit, &revs->commits, NULL) < 0)
+			if (add_parents_to_queue(revs, commit, &revs->queue) < 0)
 				die("Failed to traverse parents of commit %s",
 				    sha1_to_hex(commit->object.sha1));
 		}
@@ -1741,8 +1751,7 @@ static struct commit *get_revision_1(struct rev_info *revs)
 		default:
 			return commit;
 		}
-	} while (revs->commits);
-	return NULL;
+	}
 }
 
 static void gc_boundary(struct object_array *array)
@@ -1774,15 +1783,16 @@ static void create_boundary_commit_list(struct rev_info *revs)
 	struct object_array_entry *objects = array->objects;
 
 	/*
-	 * If revs->commits is non-NULL at this point, an error occurred in
-	 * get_revision_1().  Ignore the error and continue printing the
-	 * boundary commits anyway.  (This is what the code has always
-	 * done.)
+	 * If revs->commits or revs->queue is non-empty at this point, an
+	 * error occurred in get_revision_1().  Ignore the error and
+	 * continue printing the boundary commits anyway.  (This is what
+	 * the code has always done.)
 	 */
 	if (revs->commits) {
 		free_commit_list(revs->commits);
 		revs->commits = NULL;
 	}
+	clear_prio_queue(&revs->queue);
 
 	/*
 	 * Put all of the actual boundary commits from revs->boundary_commits
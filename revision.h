@@ -3,6 +3,7 @@
 
 #include "parse-options.h"
 #include "grep.h"
+#include "prio-queue.h"
 
 #define SEEN		(1u<<0)
 #define UNINTERESTING   (1u<<1)
@@ -21,6 +22,8 @@ struct log_info;
 struct rev_info {
 	/* Starting list */
 	struct commit_list *commits;
+	/* Commits still to be walked, once get_revision() has started */
+	struct prio_queue queue;
 	struct object_array pending;
 
 	/* Parents of shown commits */
@@ -0,0 +1,268 @@
+/*
+ * Multi-buffer SHA-1.
+ *
+ * Each of the SHA1_LANES 32-bit lanes of a vector carries the state of
+ * a different message; every call to sha1_lanes_compress() runs one
+ * 64-byte block of each message through the rounds.  A lane whose
+ * message is done is handed the next job, longest jobs first so that
+ * the lanes run dry at about the same time.
+ *
+ * The vector code uses GCC vector extensions.  On x86-64 it is built
+ * twice, for AVX2 and for the baseline SSE2, and the loader picks one.
+ * A CPU with the SHA extensions hashes a single message faster than
+ * this does eight, so there we stay serial; GIT_SHA1_BATCH=lanes or
+ * GIT_SHA1_BATCH=serial overrides that choice.
+ */
+#include "cache.h"
+#include "sha1-batch.h"
+
+void sha1_job_init(struct sha1_job *job, const void *data,
+		   unsigned long len, const char *type)
+{
+	job->data = data;
+	job->len = len;
+	job->hdrlen = sprintf(job->hdr, "%s %lu", type, len) + 1;
+}
+
+static void sha1_batch_serial(struct sha1_job *jobs, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		git_SHA_CTX c;
+		git_SHA1_Init(&c);
+		git_SHA1_Update(&c, jobs[i].hdr, jobs[i].hdrlen);
+		git_SHA1_Update(&c, jobs[i].data, jobs[i].len);
+		git_SHA1_Final(jobs[i].sha1, &c);
+	}
+}
+
+#if defined(X86_CPU) && defined(__GNUC__) && defined(__x86_64__) && \
+	defined(__linux__)
+
+#include "x86/cpu.h"
+
+#define SHA1_LANES 8
+
+typedef uint32_t sha1_vec __attribute__((vector_size(4 * SHA1_LANES)));
+
+struct sha1_lane {
+	struct sha1_job *job;
+	uint64_t pos;		/* of the next block in the message */
+	uint64_t msglen;	/* header and data */
+	uint64_t padlen;	/* with padding and length, a multiple of 64 */
+	unsigned char buf[64];
+};
+
+static inline uint32_t get_be32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+#define vrol(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+__attribute__((target_clones("avx2", "default")))
+static void sha1_lanes_compress(uint32_t state[5][SHA1_LANES],
+				const unsigned char **blocks)
+{
+	sha1_vec w[16], a, b, c, d, e, a0, b0, c0, d0, e0;
+	int i, l;
+
+	for (i = 0; i < 16; i++)
+		for (l = 0; l < SHA1_LANES; l++)
+			w[i][l] = get_be32(blocks[l] + 4 * i);
+
+	memcpy(&a, state[0], sizeof(a));
+	memcpy(&b, state[1], sizeof(b));
+	memcpy(&c, state[2], sizeof(c));
+	memcpy(&d, state[3], sizeof(d));
+	memcpy(&e, state[4], sizeof(e));
+	a0 = a; b0 = b; c0 = c; d0 = d; e0 = e;
+
+#define W(n) ((n) < 16 ? w[n] : \
+	(w[(n) & 15] = vrol(w[((n) - 3) & 15] ^ w[((n) - 8) & 15] ^ \
+			    w[((n) - 14) & 15] ^ w[(n) & 15], 1)))
+#define F1(b, c, d) ((d) ^ ((b) & ((c) ^ (d))))
+#define F2(b, c, d) ((b) ^ (c) ^ (d))
+#define F3(b, c, d) (((b) & (c)) | ((d) & ((b) | (c))))
+#define ROUND(f, k, a, b, c, d, e, n) \
+	do { \
+		e += vrol(a, 5) + f(b, c, d) + (k) + W(n); \
+		b = vrol(b, 30); \
+	} while (0)
+#define ROUNDS5(f, k, n) \
+	do { \
+		ROUND(f, k, a, b, c, d, e, n); \
+		ROUND(f, k, e, a, b, c, d, n + 1); \
+		ROUND(f, k, d, e, a, b, c, n + 2); \
+		ROUND(f, k, c, d, e, a, b, n + 3); \
+		ROUND(f, k, b, c, d, e, a, n + 4); \
+	} while (0)
+
+	for (i = 0; i < 20; i += 5)
+		ROUNDS5(F1, 0x5a827999, i);
+	for (; i < 40; i += 5)
+		ROUNDS5(F2, 0x6ed9eba1, i);
+	for (; i < 60; i += 5)
+		ROUNDS5(F3, 0x8f1bbcdc, i);
+	for (; i < 80; i += 5)
+		ROUNDS5(F2, 0xca62c1d6, i);
+
+#undef ROUNDS5
+#undef ROUND
+#undef F3
+#undef F2
+#undef F1
+#undef W
+
+	a += a0; b += b0; c += c0; d += d0; e += e0;
+	memcpy(state[0], &a, sizeof(a));
+	memcpy(state[1], &b, sizeof(b));
+	memcpy(state[2], &c, sizeof(c));
+	memcpy(state[3], &d, sizeof(d));
+	memcpy(state[4], &e, sizeof(e));
+}
+
+/*
+ * Return the next 64-byte block of the lane's message: straight from
+ * the job's data if it is all there, otherwise assembled in lane->buf
+ * from the header, the data and the padding.
+ */
+static const unsigned char *next_block(struct sha1_lane *lane)
+{
+	struct sha1_job *job = lane->job;
+	uint64_t pos = lane->pos, end = pos + 64, s, e;
+	unsigned char *out = lane->buf;
+
+	if (pos >= job->hdrlen && end <= lane->msglen)
+		return (const unsigned char *)job->data + (pos - job->hdrlen);
+
+	memset(out, 0, 64);
+	if (pos < job->hdrlen) {
+		e = end < job->hdrlen ? end : job->hdrlen;
+		memcpy(out, job->hdr + pos, e - pos);
+	}
+	s = pos > job->hdrlen ? pos : job->hdrlen;
+	e = end < lane->msglen ? end : lane->msglen;
+	if (s < e)
+		memcpy(out + (s - pos),
+		       (const char *)job->data + (s - job->hdrlen), e - s);
+	if (pos <= lane->msglen && lane->msglen < end)
+		out[lane->msglen - pos] = 0x80;
+	if (end == lane->padlen) {
+		uint64_t bits = lane->msglen << 3;
+		int i;
+		for (i = 0; i < 8; i++)
+			out[56 + i] = bits >> (56 - 8 * i);
+	}
+	return out;
+}
+
+static void start_lane(struct sha1_lane *lane, uint32_t state[5][SHA1_LANES],
+		       int l, struct sha1_job *job)
+{
+	lane->job = job;
+	lane->pos = 0;
+	lane->msglen = job->hdrlen + (uint64_t)job->len;
+	lane->padlen = (lane->msglen + 8 + 64) & ~(uint64_t)63;
+	state[0][l] = 0x67452301;
+	state[1][l] = 0xefcdab89;
+	state[2][l] = 0x98badcfe;
+	state[3][l] = 0x10325476;
+	state[4][l] = 0xc3d2e1f0;
+}
+
+static int longest_first(const void *a_, const void *b_)
+{
+	const struct sha1_job *a = *(const struct sha1_job **)a_;
+	const struct sha1_job *b = *(const struct sha1_job **)b_;
+
+	if (a->len != b->len)
+		return a->len < b->len ? 1 : -1;
+	return 0;
+}
+
+static void sha1_batch_lanes(struct sha1_job *jobs, int nr)
+{
+	static const unsigned char idle_block[64];
+	struct sha1_lane lanes[SHA1_LANES];
+	uint32_t state[5][SHA1_LANES];
+	const unsigned char *blocks[SHA1_LANES];
+	struct sha1_job **order;
+	int i, l, next = 0, active = 0;
+
+	order = xmalloc(nr * sizeof(*order));
+	for (i = 0; i < nr; i++)
+		order[i] = &jobs[i];
+	qsort(order, nr, sizeof(*order), longest_first);
+
+	memset(state, 0, sizeof(state));
+	for (l = 0; l < SHA1_LANES; l++) {
+		lanes[l].job = NULL;
+		if (next < nr) {
+			start_lane(&lanes[l], state, l, order[next++]);
+			active++;
+		}
+	}
+
+	while (active) {
+		for (l = 0; l < SHA1_LANES; l++)
+			blocks[l] = lanes[l].job ? next_block(&lanes[l]) : idle_block;
+		sha1_lanes_compress(state, blocks);
+
+		for (l = 0; l < SHA1_LANES; l++) {
+			struct sha1_job *job = lanes[l].job;
+			if (!job)
+				continue;
+			lanes[l].pos += 64;
+			if (lanes[l].pos < lanes[l].padlen)
+				continue;
+			for (i = 0; i < 5; i++) {
+				uint32_t v = state[i][l];
+				job->sha1[4 * i] = v >> 24;
+				job->sha1[4 * i + 1] = v >> 16;
+				job->sha1[4 * i + 2] = v >> 8;
+				job->sha1[4 * i + 3] = v;
+			}
+			if (next < nr)
+				start_lane(&lanes[l], state, l, order[next++]);
+			else {
+				lanes[l].job = NULL;
+				active--;
+			}
+		}
+	}
+	free(order);
+}
+
+static int want_lanes(void)
+{
+	static int want = -1;
+	const char *env;
+
+	if (want >= 0)
+		return want;
+	env = getenv("GIT_SHA1_BATCH");
+	if (env && !strcmp(env, "lanes"))
+		return (want = 1);
+	if (env && !strcmp(env, "serial"))
+		return (want = 0);
+	return (want = !(x86_cpu_features() & X86_SHA));
+}
+
+void git_SHA1_Batch(struct sha1_job *jobs, int nr)
+{
+	if (nr > 1 && want_lanes())
+		sha1_batch_lanes(jobs, nr);
+	else
+		sha1_batch_serial(jobs, nr);
+}
+
+#else
+
+void git_SHA1_Batch(struct sha1_job *jobs, int nr)
+{
+	sha1_batch_serial(jobs, nr);
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef SHA1_BATCH_H
+#define SHA1_BATCH_H
+
+/*
+ * Hash many independent objects at once.  Where the compiler and CPU
+ * allow it, the jobs are spread over the lanes of SIMD registers so
+ * that several messages go through the SHA-1 rounds together;
+ * otherwise they are simply hashed one after another.
+ */
+struct sha1_job {
+	const void *data;
+	unsigned long len;
+	char hdr[32];
+	int hdrlen;
+	unsigned char sha1[20];
+};
+
+/*
+ * Callers that collect objects as they go flush them when they have this
+ * many, or this many bytes: enough to keep all the lanes busy without
+ * holding on to much memory.
+ */
+#define SHA1_BATCH_JOBS 64
+#define SHA1_BATCH_BYTES (1024 * 1024)
+
+/* Prepare "job" to compute the object name of "data" as a "type" object. */
+extern void sha1_job_init(struct sha1_job *job, const void *data,
+			  unsigned long len, const char *type);
+
+/* Fill in the sha1 member of each of the "nr" jobs. */
+extern void git_SHA1_Batch(struct sha1_job *jobs, int nr);
+
+#endif
@@ -16,6 +16,7 @@
 #include "refs.h"
 #include "pack-revindex.h"
 #include "sha1-lookup.h"
+#include "midx.h"
 
 #ifndef O_NOATIME
 #if defined(__linux__) && (defined(__i386__) || defined(__PPC__))
@@ -441,7 +442,7 @@ int has_loose_object_nonlocal(const unsigned char *sha1)
 	return 0;
 }
 
-static int has_loose_object(const unsigned char *sha1)
+int has_loose_object(const unsigned char *sha1)
 {
 	return has_loose_object_local(sha1) ||
 	       has_loose_object_nonlocal(sha1);
@@ -454,6 +455,7 @@ static unsigned int pack_open_windows;
 static size_t peak_pack_mapped;
 static size_t pack_mapped;
 struct packed_git *packed_git;
+static struct multi_pack_index *packed_midx;
 
 void pack_report(void)
 {
@@ -696,6 +698,8 @@ void free_pack_by_name(const char *pack_name)
 			if (p->index_data)
 				munmap((void *)p->index_data, p->index_size);
 			free(p->bad_object_sha1);
+			if (p->pack_in_midx)
+				midx_forget_pack(packed_midx, p);
 			*pp = p->next;
 			free(p);
 			return;
@@ -1042,12 +1046,20 @@ void prepare_packed_git(void)
 		alt->name[-1] = '/';
 	}
 	rearrange_packed_git();
+	if (!packed_midx)
+		packed_midx = load_multi_pack_index(get_object_directory());
 	prepare_packed_git_run_once = 1;
 }
 
 void reprepare_packed_git(void)
 {
+	struct packed_git *p;
+
 	discard_revindex();
+	for (p = packed_git; p; p = p->next)
+		p->pack_in_midx = 0;
+	close_multi_pack_index(packed_midx);
+	packed_midx = NULL;
 	prepare_packed_git_run_once = 0;
 	prepare_packed_git();
 }
@@ -1119,7 +1131,7 @@ static int open_sha1_file(const unsigned char *sha1)
 	return -1;
 }
 
-static void *map_sha1_file(const unsigned char *sha1, unsigned long *size)
+void *map_sha1_file(const unsigned char *sha1, unsigned long *size)
 {
 	void *map;
 	int fd;
@@ -1179,7 +1191,7 @@ unsigned long unpack_object_header_buffer(const unsigned char *buf,
 	return used;
 }
 
-static int unpack_sha1_header(z_stream *stream, unsigned char *map, unsigned long mapsize, void *buffer, unsigned long bufsiz)
+int unpack_sha1_header(z_stream *stream, unsigned char *map, unsigned long mapsize, void *buffer, unsigned long bufsiz)
 {
 	unsigned long size, used;
 	static const char valid_loose_object_type[8] = {
@@ -1277,7 +1289,7 @@ static void *unpack_sha1_rest(z_stream *stream, void *buffer, unsigned long size
  * too permissive for what we want to check. So do an anal
  * object header parse by hand.
  */
-static int parse_sha1_header(const char *hdr, unsigned long *sizep)
+int parse_sha1_header(const char *hdr, unsigned long *sizep)
 {
 	char type[10];
 	int i;
@@ -1458,10 +1470,10 @@ static int packed_delta_info(struct packed_git *p,
 	return type;
 }
 
-static int unpack_object_header(struct packed_git *p,
-				struct pack_window **w_curs,
-				off_t *curpos,
-				unsigned long *sizep)
+int unpack_object_header(struct packed_git *p,
+			 struct pack_window **w_curs,
+			 off_t *curpos,
+			 unsigned long *sizep)
 {
 	unsigned char *base;
 	unsigned int left;
@@ -1919,39 +1931,66 @@ off_t find_pack_entry_one(const unsigned char *sha1,
 	return 0;
 }
 
-static int find_pack_entry(const unsigned char *sha1, struct pack_entry *e)
+static int pack_entry_usable(struct packed_git *p, const unsigned char *sha1)
+{
+	if (p->num_bad_objects) {
+		unsigned i;
+		for (i = 0; i < p->num_bad_objects; i++)
+			if (!hashcmp(sha1, p->bad_object_sha1 + 20 * i))
+				return 0;
+	}
+
+	/*
+	 * We are about to tell the caller where they can
+	 * locate the requested object.  We better make
+	 * sure the packfile is still here and can be
+	 * accessed before supplying that answer, as
+	 * it may have been deleted since the index
+	 * was loaded!
+	 */
+	if (p->pack_fd == -1 && open_packed_git(p)) {
+		error("packfile %s cannot be accessed", p->pack_name);
+		return 0;
+	}
+	return 1;
+}
+
+int find_pack_entry(const unsigned char *sha1, struct pack_entry *e)
 {
 	static struct packed_git *last_found = (void *)1;
 	struct packed_git *p;
 	off_t offset;
+	int skip_midx_packs = 0;
 
 	prepare_packed_git();
 	if (!packed_git)
 		return 0;
+
+	/*
+	 * The multi-pack index answers for all the packs it covers at
+	 * once; only when it points at something we cannot use do we
+	 * fall back to asking each of them.
+	 */
+	if (packed_midx) {
+		switch (midx_find_entry(packed_midx, sha1, e)) {
+		case 0:
+			skip_midx_packs = 1;
+			break;
+		case 1:
+			if (pack_entry_usable(e->p, sha1))
+				return 1;
+			break;
+		}
+	}
+
 	p = (last_found == (void *)1) ? packed_git : last_found;
 
 	do {
-		if (p->num_bad_objects) {
-			unsigned i;
-			for (i = 0; i < p->num_bad_objects; i++)
-				if (!hashcmp(sha1, p->bad_object_sha1 + 20 * i))
-					goto next;
-		}
+		if (skip_midx_packs && p->pack_in_midx)
+			goto next;
 
 		offset = find_pack_entry_one(sha1, p);
-		if (offset) {
-			/*
-			 * We are about to tell the caller where they can
-			 * locate the requested object.  We better make
-			 * sure the packfile is still here and can be
-			 * accessed before supplying that answer, as
-			 * it may have been deleted since the index
-			 * was loaded!
-			 */
-			if (p->pack_fd == -1 && open_packed_git(p)) {
-				error("packfile %s cannot be accessed", p->pack_name);
-				goto next;
-			}
+		if (offset && pack_entry_usable(p, sha1)) {
 			e->offset = offset;
 			e->p = p;
 			hashcpy(e->sha1, sha1);
@@ -2077,6 +2116,15 @@ static struct cached_object empty_tree = {
 	0
 };
 
+void discard_pretend_objects(void)
+{
+	int i;
+
+	for (i = 0; i < cached_object_nr; i++)
+		free(cached_objects[i].buf);
+	cached_object_nr = 0;
+}
+
 static struct cached_object *find_cached_object(const unsigned char *sha1)
 {
 	int i;
@@ -2392,6 +2440,79 @@ static int write_loose_object(const unsigned char *sha1, char *hdr, int hdrlen,
 	return move_temp_to_file(tmpfile, filename);
 }
 
+/*
+ * Like write_loose_object(), but deflate the contents of "size" bytes
+ * read from "fd" a chunk at a time, instead of having them in core.
+ * The data read is hashed again, so that a file that changes under us
+ * is not recorded under a name that does not match its contents.
+ */
+static int write_loose_object_fd(const unsigned char *sha1, char *hdr, int hdrlen,
+				 int fd, size_t size)
+{
+	int tmpfd, ret, flush;
+	unsigned char ibuf[16384], obuf[16384], real_sha1[20];
+	git_SHA_CTX c;
+	z_stream stream;
+	char *filename;
+	static char tmpfile[PATH_MAX];
+
+	filename = sha1_file_name(sha1);
+	tmpfd = create_tmpfile(tmpfile, sizeof(tmpfile), filename);
+	if (tmpfd < 0) {
+		if (errno == EACCES)
+			return error("insufficient permission for adding an object to repository database %s\n", get_object_directory());
+		else
+			return error("unable to create temporary sha1 filename %s: %s\n", tmpfile, strerror(errno));
+	}
+
+	memset(&stream, 0, sizeof(stream));
+	deflateInit(&stream, zlib_compression_level);
+	git_SHA1_Init(&c);
+	git_SHA1_Update(&c, hdr, hdrlen);
+
+	stream.next_in = (unsigned char *)hdr;
+	stream.avail_in = hdrlen;
+	flush = 0;
+	do {
+		if (!stream.avail_in && size) {
+			ssize_t readlen = xread(fd, ibuf,
+						size < sizeof(ibuf) ? size : sizeof(ibuf));
+			if (readlen <= 0) {
+				deflateEnd(&stream);
+				close(tmpfd);
+				unlink(tmpfile);
+				return error("short read while writing object %s",
+					     sha1_to_hex(sha1));
+			}
+			git_SHA1_Update(&c, ibuf, readlen);
+			stream.next_in = ibuf;
+			stream.avail_in = readlen;
+			size -= readlen;
+		}
+		if (!size)
+			flush = Z_FINISH;
+		stream.next_out = obuf;
+		stream.avail_out = sizeof(obuf);
+		ret = deflate(&stream, flush);
+		if (write_buffer(tmpfd, obuf, stream.next_out - obuf) < 0)
+			die("unable to write sha1 file");
+	} while (ret == Z_OK || ret == Z_BUF_ERROR);
+	if (ret != Z_STREAM_END)
+		die("unable to deflate new object %s (%d)", sha1_to_hex(sha1), ret);
+	ret = deflateEnd(&stream);
+	if (ret != Z_OK)
+		die("deflateEnd on object %s failed (%d)", sha1_to_hex(sha1), ret);
+	close_sha1_file(tmpfd);
+
+	git_SHA1_Final(real_sha1, &c);
+	if (hashcmp(sha1, real_sha1)) {
+		unlink(tmpfile);
+		return error("object %s changed while it was being written",
+			     sha1_to_hex(sha1));
+	}
+	return move_temp_to_file(tmpfile, filename);
+}
+
 int write_sha1_file(void *buf, unsigned long len, const char *type, unsigned char *returnsha1)
 {
 	unsigned char sha1[20];
@@ -2490,6 +2611,39 @@ static int index_mem(unsigned char *sha1, void *buf, size_t size,
 	return ret;
 }
 
+/*
+ * Hash, and write out if asked to, a regular file that is too large
+ * to be mapped and converted in core as a whole.
+ */
+static int index_stream(unsigned char *sha1, int fd, size_t size,
+			int write_object)
+{
+	git_SHA_CTX c;
+	char buf[16384], hdr[32];
+	int hdrlen;
+	size_t left = size;
+
+	hdrlen = sprintf(hdr, "%s %lu", blob_type, (unsigned long)size) + 1;
+	git_SHA1_Init(&c);
+	git_SHA1_Update(&c, hdr, hdrlen);
+	while (left) {
+		ssize_t readlen = xread(fd, buf,
+					left < sizeof(buf) ? left : sizeof(buf));
+		if (readlen <= 0)
+			return error("short read while hashing (%s)",
+				     readlen ? strerror(errno) : "unexpected EOF");
+		git_SHA1_Update(&c, buf, readlen);
+		left -= readlen;
+	}
+	git_SHA1_Final(sha1, &c);
+
+	if (!write_object || has_sha1_file(sha1))
+		return 0;
+	if (lseek(fd, 0, SEEK_SET) < 0)
+		return error("cannot rewind: %s", strerror(errno));
+	return write_loose_object_fd(sha1, hdr, hdrlen, fd, size);
+}
+
 int index_fd(unsigned char *sha1, int fd, struct stat *st, int write_object,
 	     enum object_type type, const char *path)
 {
@@ -2504,6 +2658,10 @@ int index_fd(unsigned char *sha1, int fd, struct stat *st, int write_object,
 		else
 			ret = -1;
 		strbuf_release(&sbuf);
+	} else if (size > big_file_threshold &&
+		   (!type || type == OBJ_BLOB) &&
+		   (!path || convert_is_identity(path, 0))) {
+		ret = index_stream(sha1, fd, size, write_object);
 	} else if (size) {
 		void *buf = xmmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
 		ret = index_mem(sha1, buf, size, write_object, type, path);
@@ -638,7 +638,7 @@ static int get_sha1_1(const char *name, int len, unsigned char *sha1)
 static int handle_one_ref(const char *path,
 		const unsigned char *sha1, int flag, void *cb_data)
 {
-	struct commit_list **list = cb_data;
+	struct prio_queue *queue = cb_data;
 	struct object *object = parse_object(sha1);
 	if (!object)
 		return 0;
@@ -649,7 +649,7 @@ static int handle_one_ref(const char *path,
 	}
 	if (object->type != OBJ_COMMIT)
 		return 0;
-	insert_by_date((struct commit *)object, list);
+	prio_queue_put(queue, (struct commit *)object);
 	return 0;
 }
 
@@ -665,8 +665,9 @@ static int handle_one_ref(const char *path,
 #define ONELINE_SEEN (1u<<20)
 static int get_sha1_oneline(const char *prefix, unsigned char *sha1)
 {
-	struct commit_list *list = NULL, *backup = NULL, *l;
-	int retval = -1;
+	struct prio_queue queue = { compare_commits_by_commit_date };
+	struct commit_list *backup = NULL, *l;
+	int retval = -1, i;
 	char *temp_commit_buffer = NULL;
 
 	if (prefix[0] == '!') {
@@ -674,16 +675,16 @@ static int get_sha1_oneline(const char *prefix, unsigned char *sha1)
 			die ("Invalid search pattern: %s", prefix);
 		prefix++;
 	}
-	for_each_ref(handle_one_ref, &list);
-	for (l = list; l; l = l->next)
-		commit_list_insert(l->item, &backup);
-	while (list) {
+	for_each_ref(handle_one_ref, &queue);
+	for (i = 0; i < queue.nr; i++)
+		commit_list_insert(queue.array[i].data, &backup);
+	while (queue.nr) {
 		char *p;
 		struct commit *commit;
 		enum object_type type;
 		unsigned long size;
 
-		commit = pop_most_recent_commit(&list, ONELINE_SEEN);
+		commit = pop_most_recent_commit(&queue, ONELINE_SEEN);
 		if (!parse_object(commit->object.sha1))
 			continue;
 		free(temp_commit_buffer);
@@ -704,7 +705,7 @@ static int get_sha1_oneline(const char *prefix, unsigned char *sha1)
 		}
 	}
 	free(temp_commit_buffer);
-	free_commit_list(list);
+	clear_prio_queue(&queue);
 	for (l = backup; l; l = l->next)
 		clear_commit_marks(l->item, ONELINE_SEEN);
 	return retval;
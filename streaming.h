@@ -0,0 +1,19 @@
+#ifndef STREAMING_H
+#define STREAMING_H
+
+/*
+ * Read the contents of an object in chunks, without holding the whole
+ * (inflated) object in core.  Loose objects and non-delta objects in a
+ * pack are inflated incrementally; anything else (deltified objects,
+ * objects registered with pretend_sha1_file()) falls back to reading
+ * the whole object with read_sha1_file().
+ */
+struct git_istream;
+
+extern struct git_istream *open_istream(const unsigned char *sha1, enum object_type *type, unsigned long *size);
+extern int close_istream(struct git_istream *st);
+extern ssize_t read_istream(struct git_istream *st, char *buf, size_t sz);
+
+extern int stream_blob_to_fd(int fd, const unsigned char *sha1);
+
+#endif /* STREAMING_H */
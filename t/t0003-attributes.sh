@@ -71,6 +71,48 @@ test_expect_success 'root subdir attribute test' '
 
 '
 
+test_expect_success 'names, extensions and globs keep their order' '
+
+	mkdir e &&
+	(
+		echo "*.c test=c"
+		echo "*.tar.gz test=tgz"
+		echo "x.c test=x.c"
+		echo "*.gz test=gz"
+		echo "y* test=y"
+		echo "[ab].txt test=glob"
+		echo "*.txt test=txt"
+	) >e/.gitattributes &&
+	attr_check e/a.c c &&
+	attr_check e/.c c &&
+	attr_check e/x.c x.c &&
+	attr_check e/a.tar.gz gz &&
+	attr_check e/y.c y &&
+	attr_check e/yc y &&
+	attr_check e/a.txt txt &&
+	attr_check e/c unspecified &&
+	attr_check e/noext unspecified &&
+	attr_check e/f f
+
+'
+
+test_expect_success 'going back and forth between directories' '
+
+	cat <<EOF >expect &&
+a/b/h: test: a/b/h
+e/x.c: test: x.c
+f: test: f
+a/b/d/g: test: a/b/d/*
+e/a.c: test: c
+a/b/h: test: a/b/h
+a/g: test: a/g
+e/y.c: test: y
+EOF
+	sed -e "s/:.*//" <expect | git check-attr --stdin test >actual &&
+	test_cmp expect actual
+
+'
+
 test_expect_success 'setup bare' '
 
 	git clone --bare . bare.git &&
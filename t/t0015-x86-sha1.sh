@@ -0,0 +1,72 @@
+#!/bin/sh
+
+test_description='SHA-1 block functions for x86-64
+
+Every block function the CPU can run must give the same names as the
+plain C one, for inputs that end anywhere in a block and that span
+several blocks at a time.'
+
+. ./test-lib.sh
+
+if test -z "$X86_SHA1"
+then
+	say "Skipping x86-64 SHA-1 tests, because git was built without X86_SHA1"
+	test_done
+fi
+
+backend () {
+	GIT_X86_SHA1=$1 test-sha1 -b 0 | sed -n -e "s/^backend: //p"
+}
+
+test_expect_success 'the plain C block function knows the test vectors' '
+	GIT_X86_SHA1=generic &&
+	export GIT_X86_SHA1 &&
+	test "$(backend generic)" = generic &&
+	test "$(printf "" | test-sha1)" = \
+		da39a3ee5e6b4b0d3255bfef95601890afd80709 &&
+	test "$(printf abc | test-sha1)" = \
+		a9993e364706816aba3e25717850c26c9cd0d89d &&
+	test "$(echo abcdefghi | test-sha1)" = \
+		0707f2970043f9f7c22029482db27733deaec029 &&
+	test "$({ echo frotz &&
+		dd if=/dev/zero bs=1048576 count=1 2>/dev/null |
+		tr "\000" g; } | test-sha1 1)" = \
+		9986b45e2f4d7086372533bb6953a8652fa3644a
+'
+
+test_expect_success 'setup' '
+	GIT_X86_SHA1=generic &&
+	export GIT_X86_SHA1 &&
+	for size in 0 1 55 56 63 64 65 119 120 127 128 129 191 192 \
+		    1000 4096 65537 1048577
+	do
+		test-genrandom sha1 $size >in$size &&
+		echo "$size $(test-sha1 <in$size)" || return 1
+	done >expect
+'
+
+for name in shani avx2 ssse3
+do
+	if test "$(backend $name)" = $name
+	then
+		test_expect_success "$name block function" '
+			GIT_X86_SHA1=$name &&
+			export GIT_X86_SHA1 &&
+			while read size sha1
+			do
+				echo "$size $(test-sha1 <in$size)" || return 1
+			done <expect >actual &&
+			test_cmp expect actual &&
+			test-sha1 -B 4096 1
+		'
+	else
+		say "Skipping $name, because this CPU does not have it"
+	fi
+done
+
+test_expect_success 'an unknown block function falls back to the best one' '
+	test "$(backend nitfol)" != nitfol &&
+	test "$(backend nitfol)" = "$(backend "")"
+'
+
+test_done
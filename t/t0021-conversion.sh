@@ -88,4 +88,170 @@ test_expect_success expanded_in_repo '
 	cmp expanded-keywords expected-output
 '
 
+cat <<\EOF >rot13-filter.pl
+# A filter process that rot13s, saying what it is asked to do in the
+# log given as the first argument.  The rest name the capabilities it
+# offers.  Paths with "error", "abort" or "crash" in them make it
+# answer so, or die.
+use strict;
+my ($log, @offer) = @ARGV;
+open(my $debug, ">>", $log) or die;
+$debug->autoflush(1);
+binmode STDIN;
+binmode STDOUT;
+
+sub packet_read {
+	my $n = read(STDIN, my $len, 4);
+	exit 0 if !$n;
+	return undef if $len eq "0000";
+	$n = hex($len) - 4;
+	read(STDIN, my $buf, $n) == $n or die "short read";
+	return $buf;
+}
+sub packet_text {
+	my $line = packet_read();
+	chomp $line if defined $line;
+	return $line;
+}
+sub packet_write { print sprintf("%04x", length($_[0]) + 4), $_[0]; }
+sub packet_flush { print "0000"; STDOUT->flush(); }
+
+packet_text() eq "git-filter-client" or die;
+packet_text() eq "version=2" or die;
+!defined(packet_text()) or die;
+packet_write("git-filter-server\n");
+packet_write("version=2\n");
+packet_flush();
+my %asked;
+while (defined(my $line = packet_text())) {
+	$asked{$line} = 1;
+}
+for (@offer) {
+	packet_write("capability=$_\n") if $asked{"capability=$_"};
+}
+packet_flush();
+print $debug "start\n";
+
+while (1) {
+	my ($command, $pathname);
+	while (defined(my $line = packet_text())) {
+		$command = $1 if $line =~ /^command=(.*)/;
+		$pathname = $1 if $line =~ /^pathname=(.*)/;
+	}
+	my $content = "";
+	while (defined(my $buf = packet_read())) {
+		$content .= $buf;
+	}
+	print $debug "$command $pathname\n";
+	if ($pathname =~ /crash/) {
+		exit 1;
+	} elsif ($pathname =~ /(error|abort)/) {
+		packet_write("status=$1\n");
+		packet_flush();
+		next;
+	}
+	$content =~ tr/a-zA-Z/n-za-mN-ZA-M/;
+	packet_write("status=success\n");
+	packet_flush();
+	while (length($content)) {
+		packet_write(substr($content, 0, 65516, ""));
+	}
+	packet_flush();
+	packet_flush();
+}
+EOF
+
+filter_starts () {
+	grep -c "^start$" filter.log
+}
+
+test_expect_success PERL 'one filter process handles every file' '
+	git config filter.proc.process "perl ./rot13-filter.pl filter.log clean smudge" &&
+	echo "*.r filter=proc" >>.gitattributes &&
+	for f in a b c
+	do
+		cat test.o >$f.r || exit
+	done &&
+	rm -f filter.log &&
+	git add a.r b.r c.r &&
+	test 1 = $(filter_starts) &&
+	printf "clean a.r\nclean b.r\nclean c.r\n" >expect &&
+	grep -v "^start$" filter.log | sort >actual &&
+	test_cmp expect actual &&
+	./rot13.sh <test.o >expect &&
+	git cat-file blob :b.r >actual &&
+	test_cmp expect actual &&
+
+	rm -f a.r b.r c.r filter.log &&
+	git checkout -- a.r b.r c.r &&
+	test 1 = $(filter_starts) &&
+	test 3 = $(grep -c "^smudge " filter.log) &&
+	cmp test.o a.r &&
+	cmp test.o c.r
+'
+
+test_expect_success PERL 'large contents that are not text' '
+	for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16
+	do
+		cat test.o ../test-lib.sh || exit
+	done | tr "X" "\\000" >big.r &&
+	test $(wc -c <big.r) -gt 200000 &&
+	git add big.r &&
+	./rot13.sh <big.r >expect &&
+	git cat-file blob :big.r >actual &&
+	cmp expect actual &&
+	rm big.r &&
+	git checkout -- big.r &&
+	git cat-file blob :big.r | ./rot13.sh >expect &&
+	cmp expect big.r
+'
+
+test_expect_success PERL 'capabilities the filter does not offer are not used' '
+	git config filter.proc.process "perl ./rot13-filter.pl filter.log clean" &&
+	rm -f a.r filter.log &&
+	git checkout -- a.r &&
+	! grep "^smudge" filter.log &&
+	./rot13.sh <test.o >expect &&
+	cmp expect a.r &&
+	git config filter.proc.process "perl ./rot13-filter.pl filter.log clean smudge" &&
+	rm a.r &&
+	git checkout -- a.r
+'
+
+test_expect_success PERL 'a file the filter fails on is left alone' '
+	cat test.o >error.r &&
+	cat test.o >ok.r &&
+	rm -f filter.log &&
+	git add error.r ok.r &&
+	test 1 = $(filter_starts) &&
+	git cat-file blob :error.r >actual &&
+	cmp test.o actual &&
+	./rot13.sh <test.o >expect &&
+	git cat-file blob :ok.r >actual &&
+	cmp expect actual
+'
+
+test_expect_success PERL 'after an abort the filter is not asked again' '
+	cat test.o >abort.r &&
+	cat test.o >d.r &&
+	rm -f filter.log &&
+	git add abort.r d.r &&
+	printf "start\nclean abort.r\n" >expect &&
+	test_cmp expect filter.log &&
+	git cat-file blob :d.r >actual &&
+	cmp test.o actual
+'
+
+test_expect_success PERL 'a filter that dies is started again' '
+	cat test.o >crash.r &&
+	cat test.o >e.r &&
+	rm -f filter.log &&
+	git add crash.r e.r 2>err &&
+	grep "external filter .* failed" err &&
+	test 2 = $(filter_starts) &&
+	./rot13.sh <test.o >expect &&
+	git cat-file blob :e.r >actual &&
+	cmp expect actual
+'
+
 test_done
@@ -0,0 +1,161 @@
+#!/bin/sh
+
+test_description='CRLF conversion at word and vector boundaries
+
+The statistics and the CR removal and insertion are done a word or a
+vector at a time; check the edges of those with each set of kernels.'
+
+. ./test-lib.sh
+
+q_to_cr () {
+	tr Q '\015'
+}
+
+# "a" repeated $1 times
+a_times () {
+	printf "%$1s" "" | tr " " a
+}
+
+# lines of 0 to $1 letters, each ending in what $2 says
+lines () {
+	i=0
+	while test $i -le $1
+	do
+		a_times $i
+		printf "$2"
+		i=$(($i+1))
+	done
+}
+
+test_expect_success setup '
+	git config core.autocrlf true &&
+	echo "text crlf" >.gitattributes &&
+
+	lines 70 "\r\n" >crlf &&
+	lines 70 "\n" >lf &&
+	{ lines 20 "\n" && lines 20 "\r\n" && lines 20 "\n"; } >mixed &&
+
+	i=1 &&
+	while test $i -le 40
+	do
+		{ a_times $i && printf "\r\n"; } >tail$i &&
+		{ a_times $i && printf "\n"; } >tail$i.lf &&
+		i=$(($i+1))
+	done &&
+
+	# 32 printable bytes a line, 640 in all: with up to 4 control
+	# characters it is text; BS, HT, ESC and FF do not count
+	for n in 0 2 8
+	do
+		lines=0 &&
+		while test $lines -lt 20
+		do
+			if test $lines -lt $n
+			then
+				printf "abcdefg\177ijklmnopqrstuvwxyz01234Q\n"
+			else
+				printf "abcdefghijklmnopqrstuvwxyz012345Q\n"
+			fi
+			lines=$(($lines+1))
+		done | q_to_cr >ctl$n || return 1
+	done &&
+	tr abcdefgh "\033\033\033\010\010\014\014\011" <ctl0 >ctl-ok &&
+
+	for at in 9 17 40
+	do
+		{
+			a_times $(($at - 1)) &&
+			printf "\000" &&
+			lines 10 "\r\n"
+		} >nul$at || return 1
+	done
+'
+
+for kernels in generic sse2 avx2
+do
+	GIT_X86_CONVERT=$kernels
+	export GIT_X86_CONVERT
+
+	test_expect_success "$kernels: CRLF across word and vector boundaries" '
+		tr -d "\015" <crlf >expect &&
+		test-convert to-git guessed <crlf >actual &&
+		test_cmp expect actual &&
+		test-convert to-git text <crlf >actual &&
+		test_cmp expect actual &&
+		test-convert to-worktree guessed <lf >actual &&
+		test_cmp crlf actual &&
+		test-convert to-worktree text <lf >actual &&
+		test_cmp crlf actual
+	'
+
+	test_expect_success "$kernels: lone CRs before a boundary are kept" '
+		for i in 7 8 15 16 31 32 33
+		do
+			{ a_times $i && printf "\r" && a_times 40; } >lone &&
+			test-convert to-git text <lone >actual &&
+			cmp lone actual &&
+			test-convert to-git guessed <lone >actual &&
+			cmp lone actual || return 1
+		done
+	'
+
+	test_expect_success "$kernels: mixed line endings" '
+		test-convert to-worktree guessed <mixed >actual &&
+		{ lines 20 "\r\n" && lines 20 "\r\n" && lines 20 "\r\n"; } >expect &&
+		test_cmp expect actual &&
+		test-convert to-git text <mixed >actual &&
+		{ lines 20 "\n" && lines 20 "\n" && lines 20 "\n"; } >expect &&
+		test_cmp expect actual
+	'
+
+	test_expect_success "$kernels: tails shorter than a word or vector" '
+		i=1 &&
+		while test $i -le 40
+		do
+			test-convert to-git guessed <tail$i >actual &&
+			cmp tail$i.lf actual &&
+			test-convert to-worktree guessed <tail$i.lf >actual &&
+			cmp tail$i actual &&
+			{ cat tail$i.lf && printf "\r"; } >lone &&
+			test-convert to-git guessed <lone >actual &&
+			cmp lone actual || return 1
+			i=$(($i+1))
+		done
+	'
+
+	test_expect_success "$kernels: control characters inside words of text" '
+		tr -d "\015" <ctl2 >expect &&
+		test-convert to-git guessed <ctl2 >actual &&
+		test_cmp expect actual &&
+		test-convert to-git guessed <ctl8 >actual &&
+		cmp ctl8 actual &&
+		tr -d "\015" <ctl-ok >expect &&
+		test-convert to-git guessed <ctl-ok >actual &&
+		cmp expect actual
+	'
+
+	test_expect_success "$kernels: a NUL past the first word makes it binary" '
+		for at in 9 17 40
+		do
+			test-convert to-git guessed <nul$at >actual &&
+			cmp nul$at actual &&
+			test-convert to-git text <nul$at >actual &&
+			tr -d "\015" <nul$at >expect &&
+			cmp expect actual || return 1
+		done
+	'
+
+	test_expect_success "$kernels: git add and checkout" '
+		cp crlf text.txt &&
+		git add text.txt &&
+		tr -d "\015" <crlf >expect &&
+		git cat-file blob :text.txt >actual &&
+		test_cmp expect actual &&
+		rm text.txt &&
+		git checkout text.txt &&
+		test_cmp crlf text.txt &&
+		git rm -q --cached text.txt
+	'
+done
+
+test_done
@@ -12,4 +12,31 @@ test_expect_success 'character classes (isspace, isalpha etc.)' '
 	test-ctype
 '
 
+test_expect_success 'object table keeps every object while it grows' '
+	test-object-hash verify 50000
+'
+
+test_expect_success 'parsed objects can be released and parsed again' '
+	test_commit A &&
+	git checkout -b side &&
+	test_commit B &&
+	git checkout master &&
+	test_commit C &&
+	git merge side &&
+	test-alloc HEAD 3 >actual &&
+	echo "ok 4 commits, 4 parents" >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'walks over decoded trees see the same entries' '
+	mkdir -p dir/sub &&
+	echo one >dir/one &&
+	echo two >dir/sub/two &&
+	git add dir &&
+	git commit -m dirs &&
+	test-parsed-tree HEAD 3 >actual &&
+	echo "ok 7 entries" >expect &&
+	test_cmp expect actual
+'
+
 test_done
@@ -0,0 +1,147 @@
+#!/bin/sh
+
+test_description='adding and checking out large blobs'
+
+. ./test-lib.sh
+
+UNZIP=${UNZIP:-unzip}
+
+test_expect_success setup '
+	git config core.bigfilethreshold 200k &&
+	test-genrandom large 300000 >large1 &&
+	cp large1 large2 &&
+	test-genrandom small 1000 >small &&
+	{ cat large1 && echo trailer; } >large3
+'
+
+test_expect_success 'hash-object of a large file matches in-core hashing' '
+	expect=$(git hash-object --stdin <large1) &&
+	actual=$(git hash-object large1) &&
+	test "$expect" = "$actual"
+'
+
+test_expect_success 'add a large file or two' '
+	git add large1 large2 large3 small &&
+	git commit -q -m initial &&
+	large=$(git rev-parse HEAD:large1) &&
+	test -f .git/objects/$(echo $large | sed -e "s|^..|&/|") &&
+	test $(git cat-file -s HEAD:large1) = 300000
+'
+
+test_expect_success 'streamed object is readable and unchanged' '
+	git cat-file blob HEAD:large1 >actual &&
+	cmp large1 actual &&
+	git cat-file -p HEAD:large3 >actual &&
+	cmp large3 actual &&
+	git rev-parse HEAD:large1 | git cat-file --batch >batch &&
+	test $(wc -l <batch) -gt 1 &&
+	git fsck --full
+'
+
+test_expect_success 'checkout a large file from loose objects' '
+	rm -f large1 large3 &&
+	git checkout large1 large3 &&
+	git diff --exit-code &&
+	test-genrandom large 300000 | cmp - large1
+'
+
+test_expect_success 'checkout a large file from a pack' '
+	git repack -a -d -q &&
+	rm -f large1 large3 &&
+	git checkout large1 large3 &&
+	git diff --exit-code &&
+	git cat-file blob HEAD:large1 | cmp - large1
+'
+
+test_expect_success 'tar archive of large files' '
+	git archive --format=tar HEAD >streamed.tar &&
+	git config core.bigfilethreshold 1g &&
+	git archive --format=tar HEAD >incore.tar &&
+	git config core.bigfilethreshold 200k &&
+	cmp incore.tar streamed.tar
+'
+
+test_expect_success 'repack does not deltify large blobs' '
+	git repack -a -d -f -q &&
+	git verify-pack -v .git/objects/pack/pack-*.idx >verify &&
+	for b in $(git rev-parse HEAD:large1 HEAD:large3)
+	do
+		grep "^$b blob *[0-9]* [0-9]* [0-9]*\$" verify || return 1
+	done
+'
+
+test_expect_success 'trees over the threshold are still deltified' '
+	rm -fr trees && mkdir trees && (cd trees && git init -q &&
+	git config core.bigfilethreshold 1k &&
+	for i in 0 1 2 3 4 5 6 7 8 9
+	do
+		for j in 0 1 2 3 4 5 6 7 8 9
+		do
+			echo $i$j >file$i$j || exit 1
+		done
+	done &&
+	git add . &&
+	git commit -q -m one &&
+	echo changed >file00 &&
+	git commit -q -a -m two &&
+	test $(git cat-file -s HEAD^{tree}) -gt 1024 &&
+	git repack -a -d -f -q &&
+	git verify-pack -v .git/objects/pack/pack-*.idx >verify &&
+	grep "^[0-9a-f]* tree *[0-9]* [0-9]* [0-9]* 1 [0-9a-f]*\$" verify)
+'
+
+test_expect_success 'index-pack checks large blobs it already has' '
+	git pack-objects --stdout --revs <<-EOF >all.pack &&
+	HEAD
+	EOF
+	git index-pack --strict -o all.idx all.pack &&
+	git verify-pack all.idx
+'
+
+test_expect_success 'unpack-objects writes large blobs into a pack' '
+	large=$(git rev-parse HEAD:large1) &&
+	rm -fr dest && mkdir dest && (cd dest && git init -q &&
+	git config core.bigfilethreshold 200k &&
+	git unpack-objects -q --strict <../all.pack &&
+	! test -f .git/objects/$(echo $large | sed -e "s|^..|&/|") &&
+	test $(ls .git/objects/pack/*.pack | wc -l) = 1 &&
+	git cat-file blob $large | cmp - ../large1 &&
+	git update-ref HEAD $(cd .. && git rev-parse HEAD) &&
+	git fsck --full)
+'
+
+test_expect_success 'unpack-objects resolves deltas against large blobs' '
+	git config core.bigfilethreshold 1g &&
+	git repack -a -d -f -q &&
+	git pack-objects --stdout --revs <<-EOF >delta.pack &&
+	HEAD
+	EOF
+	git config core.bigfilethreshold 200k &&
+	git verify-pack -v .git/objects/pack/pack-*.idx >verify &&
+	grep "^$(git rev-parse HEAD:large1) blob.* 1 " verify &&
+	rm -fr dest && mkdir dest && (cd dest && git init -q &&
+	git config core.bigfilethreshold 200k &&
+	git unpack-objects -q <../delta.pack &&
+	git update-ref HEAD $(cd .. && git rev-parse HEAD) &&
+	git fsck --full &&
+	git cat-file blob HEAD:large1 | cmp - ../large1 &&
+	git cat-file blob HEAD:large3 | cmp - ../large3)
+'
+
+$UNZIP -v >/dev/null 2>&1
+if [ $? -eq 127 ]; then
+	say "Skipping ZIP tests, because unzip was not found"
+else
+	test_set_prereq UNZIP
+fi
+
+test_expect_success UNZIP 'zip archive of large files' '
+	git archive --format=zip HEAD >streamed.zip &&
+	mkdir z &&
+	(cd z && $UNZIP -q ../streamed.zip) &&
+	cmp large1 z/large1 &&
+	cmp large3 z/large3 &&
+	cmp small z/small
+'
+
+test_done
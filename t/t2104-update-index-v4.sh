@@ -0,0 +1,138 @@
+#!/bin/sh
+
+test_description='index format version 4'
+
+. ./test-lib.sh
+
+index_version () {
+	od -An -tx1 -j7 -N1 .git/index | tr -d ' '
+}
+
+test_expect_success setup '
+	for d in a a/b a/b/c a/b/c/d e e/f
+	do
+		mkdir -p $d &&
+		for f in one two three
+		do
+			echo "$d/$f" >$d/$f || exit
+		done
+	done &&
+	echo top >top &&
+	git add . &&
+	git commit -q -m initial &&
+	git ls-files -s >expect &&
+	test 02 = $(index_version)
+'
+
+test_expect_success 'switch to version 4' '
+	cp .git/index v2-index &&
+	git update-index --index-version 4 &&
+	test 04 = $(index_version) &&
+	test $(wc -c <.git/index) -lt $(wc -c <v2-index) &&
+	git ls-files -s >actual &&
+	test_cmp expect actual &&
+	git diff-files --exit-code &&
+	git diff-index --cached --exit-code HEAD
+'
+
+test_expect_success 'version 4 survives updates' '
+	echo changed >a/b/c/two &&
+	echo new >a/b/new &&
+	git add a/b/c/two a/b/new &&
+	git rm -q e/f/one &&
+	test 04 = $(index_version) &&
+	git ls-files >actual &&
+	grep "^a/b/new$" actual &&
+	! grep "^e/f/one$" actual &&
+	git commit -q -m second &&
+	test 04 = $(index_version)
+'
+
+test_expect_success 'version 4 survives switching branches' '
+	git checkout -q -b side HEAD^ &&
+	test 04 = $(index_version) &&
+	git ls-files -s >actual &&
+	test_cmp expect actual &&
+	git diff-files --exit-code &&
+	git checkout -q master &&
+	test 04 = $(index_version)
+'
+
+test_expect_success 'extended flags and long names' '
+	long=$(printf "%0600d" 0) &&
+	long="$long/$long/$long/$long/$long/$long/$long/$long" &&
+	git update-index --add --cacheinfo 100644 \
+		$(git rev-parse HEAD:top) "a/$long/x" &&
+	git update-index --add --cacheinfo 100644 \
+		$(git rev-parse HEAD:top) "d/$long/y" &&
+	echo later >later &&
+	git add -N later &&
+	test 04 = $(index_version) &&
+	git ls-files >actual &&
+	grep "^a/$long/x$" actual &&
+	grep "^d/$long/y$" actual &&
+	git diff --name-only -- later >actual &&
+	grep "^later$" actual &&
+	git rm -q --cached "a/$long/x" "d/$long/y" later
+'
+
+test_expect_success 'switch back to version 2' '
+	git ls-files -s >expect &&
+	git update-index --index-version 2 &&
+	test 02 = $(index_version) &&
+	git ls-files -s >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'unknown versions are refused' '
+	test_must_fail git update-index --index-version 5 &&
+	test_must_fail git update-index --index-version 1 &&
+	test 02 = $(index_version)
+'
+
+# Make .git/index the first $1 bytes of v4-index followed by the bytes
+# given in octal as the rest of the arguments, and its checksum.
+crafted_index () {
+	n=$1 &&
+	shift &&
+	{
+		dd if=v4-index bs=1 count=$n 2>/dev/null &&
+		for b
+		do
+			printf "\\$b" || return 1
+		done
+	} >crafted.body &&
+	sum=$(test-sha1 <crafted.body) &&
+	{
+		cat crafted.body &&
+		for hex in $(echo $sum | sed -e "s/../& /g")
+		do
+			printf "\\$(printf %o 0x$hex)" || return 1
+		done
+	} >.git/index
+}
+
+test_expect_success 'truncated version 4 entries are refused' '
+	mkdir crafted &&
+	(
+		cd crafted &&
+		git init -q &&
+		echo x >intent &&
+		git add -N intent &&
+		git update-index --index-version 4 &&
+		test 04 = $(index_version) &&
+		cp .git/index v4-index &&
+
+		# the fixed part of a plain entry, cut short
+		crafted_index 52 &&
+		test_must_fail git ls-files 2>err &&
+		grep "index file corrupt" err &&
+
+		# an extended entry with a name prefix that runs off the end
+		crafted_index 76 200 200 &&
+		test_must_fail git ls-files 2>err &&
+		grep "index file corrupt" err
+	)
+'
+
+test_done
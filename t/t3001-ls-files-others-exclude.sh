@@ -153,4 +153,65 @@ test_expect_success 'negated exclude matches can override previous ones' '
 	grep "^a.1" output
 '
 
+test_expect_success 'names, extensions and globs keep their order' '
+
+	mkdir ord &&
+	(
+		cd ord &&
+		for f in a.c x.c y.c .c a.tar.gz b.gz a.txt b.txt c noext
+		do
+			>$f
+		done &&
+		mkdir d.dir &&
+		>d.dir/f &&
+		cat >.gitignore <<-\EOF &&
+		*.c
+		*.tar.gz
+		!x.c
+		!*.gz
+		!y*
+		[ab].txt
+		!*.txt
+		c
+		noext
+		!c
+		*.dir/
+		EOF
+		cat >../expect <<-\EOF &&
+		.gitignore
+		a.tar.gz
+		a.txt
+		b.gz
+		b.txt
+		c
+		x.c
+		y.c
+		EOF
+		git ls-files --others --exclude-per-directory=.gitignore >../actual
+	) &&
+	test_cmp expect actual
+'
+
+test_expect_success 'patterns of a directory are forgotten when leaving it' '
+
+	mkdir -p fg/one fg/two &&
+	(
+		cd fg &&
+		echo "*.o" >one/.gitignore &&
+		echo "keep.o" >two/.gitignore &&
+		for d in one two
+		do
+			>$d/a.o &&
+			>$d/keep.o || exit
+		done &&
+		cat >../expect <<-\EOF &&
+		one/.gitignore
+		two/.gitignore
+		two/a.o
+		EOF
+		git ls-files --others --exclude-per-directory=.gitignore >../actual
+	) &&
+	test_cmp expect actual
+'
+
 test_done
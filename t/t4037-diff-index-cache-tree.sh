@@ -0,0 +1,65 @@
+#!/bin/sh
+
+test_description='diff-index --cached skips directories the cache-tree knows'
+
+. ./test-lib.sh
+
+test_expect_success setup '
+	for d in a b b/c d
+	do
+		mkdir -p $d &&
+		echo $d/one >$d/one &&
+		echo $d/two >$d/two || break
+	done &&
+	echo top >top &&
+	git add . &&
+	git commit -m initial &&
+	git read-tree HEAD
+'
+
+check_cached_diff () {
+	tree=$(git write-tree) &&
+	git diff-tree -r HEAD $tree >expect &&
+	git diff-index --cached HEAD >actual &&
+	test_cmp expect actual
+}
+
+test_expect_success 'no changes' '
+	git diff-index --cached HEAD >actual &&
+	test_cmp /dev/null actual
+'
+
+test_expect_success 'change deep in an otherwise unchanged tree' '
+	echo changed >b/c/two &&
+	git add b/c/two &&
+	git write-tree &&
+	check_cached_diff
+'
+
+test_expect_success 'additions and removals around unchanged directories' '
+	echo new >b/new &&
+	echo new >e &&
+	git add b/new e &&
+	git rm -q --cached d/one &&
+	check_cached_diff
+'
+
+test_expect_success 'a directory replaced by a file' '
+	git rm -q --cached a/one a/two &&
+	rm -rf a &&
+	echo file >a &&
+	git add a &&
+	check_cached_diff
+'
+
+test_expect_success 'unmerged entries are still reported' '
+	git read-tree HEAD &&
+	sha1=$(git rev-parse HEAD:b/one) &&
+	git update-index --force-remove b/one &&
+	printf "100644 $sha1 1\tb/one\n100644 $sha1 2\tb/one\n" |
+	git update-index --index-info &&
+	git diff-index --cached HEAD >actual &&
+	grep "U	b/one" actual
+'
+
+test_done
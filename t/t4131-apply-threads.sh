@@ -0,0 +1,73 @@
+#!/bin/sh
+
+test_description='git apply on several threads'
+
+. ./test-lib.sh
+
+modify () {
+	sed -e "$1" < "$2" > "$2".x &&
+	mv "$2".x "$2"
+}
+
+test_expect_success setup '
+	for f in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16
+	do
+		for i in a b c d e f g h i j k l m n o p q r s t
+		do
+			echo "$f $i"
+		done >file$f || exit
+	done &&
+	cp file1 moved &&
+	git add file* moved &&
+	git commit -q -m initial &&
+
+	for f in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16
+	do
+		modify "s/^$f c$/$f changed c/" file$f || exit
+	done &&
+	git mv moved renamed &&
+	modify "s/^1 q$/1 renamed q/" renamed &&
+	git diff -M HEAD >patch &&
+	git add -u &&
+	modify "s/^1 r$/1 changed r/" file1 &&
+	modify "s/^1 s$/1 renamed s/" renamed &&
+	git diff >>patch &&
+	git add -u &&
+	git write-tree >expect &&
+	git reset -q --hard
+'
+
+test_expect_success 'threads give the same result' '
+	git apply --index --threads=1 patch &&
+	git write-tree >actual &&
+	test_cmp expect actual &&
+	git diff --exit-code &&
+	git reset -q --hard &&
+	git apply --index --threads=4 patch &&
+	git write-tree >actual &&
+	test_cmp expect actual &&
+	git diff --exit-code &&
+	git reset -q --hard
+'
+
+test_expect_success 'apply.threads is used' '
+	git config apply.threads 4 &&
+	git apply --index patch &&
+	git write-tree >actual &&
+	test_cmp expect actual &&
+	git config --unset apply.threads &&
+	git reset -q --hard
+'
+
+test_expect_success 'errors come out in the order of the patches' '
+	modify "s/^3 c$/3 local c/" file3 &&
+	modify "s/^9 c$/9 local c/" file9 &&
+	test_must_fail git apply --threads=1 patch 2>expect.err &&
+	test_must_fail git apply --threads=4 patch 2>actual.err &&
+	test_cmp expect.err actual.err &&
+	git diff --name-only >actual &&
+	printf "file3\nfile9\n" >expect.files &&
+	test_cmp expect.files actual
+'
+
+test_done
@@ -0,0 +1,100 @@
+#!/bin/sh
+
+test_description='git apply finding hunks away from where the patch says'
+
+. ./test-lib.sh
+
+filler () {
+	i=0
+	while test $i -lt $1
+	do
+		echo f
+		i=$(($i+1))
+	done
+}
+
+block () {
+	printf "a\nb\nc\n"
+}
+
+test_expect_success setup '
+	i=1 &&
+	while test $i -le 400
+	do
+		echo "line $i"
+		i=$(($i+1))
+	done >orig &&
+	sed -e "s/^line \([0-9]*0\)$/changed \1/" orig >new &&
+	diff -u orig new |
+	sed -e "1s|.*|--- a/orig|" -e "2s|.*|+++ b/orig|" >many.patch &&
+
+	{ filler 46 && block && filler 48; } >one &&
+	sed -e "s/^b$/B/" one >one.new &&
+	diff -u one one.new |
+	sed -e "1s|.*|--- a/one|" -e "2s|.*|+++ b/one|" >one.patch
+'
+
+test_expect_success 'hunks far from where the patch says' '
+	{
+		i=0 &&
+		while test $i -lt 5000
+		do
+			echo "extra $i"
+			i=$(($i+1))
+		done &&
+		cat orig
+	} >one-drift &&
+	sed -e "s/^line \([0-9]*0\)$/changed \1/" one-drift >expect &&
+	cp one-drift orig &&
+	git apply many.patch &&
+	test_cmp expect orig
+'
+
+test_expect_success 'drift that grows from hunk to hunk' '
+	awk "{ print } NR % 10 == 5 { for (i = 0; i < NR / 10; i++) print \"drift\" }" \
+		new | sed -e "s/^changed \([0-9]*\)$/line \1/" >orig &&
+	sed -e "s/^line \([0-9]*0\)$/changed \1/" orig >expect &&
+	git apply many.patch &&
+	test_cmp expect orig
+'
+
+test_expect_success 'the nearest of several matches is taken' '
+	{ filler 40 && block && filler 5 && block && filler 40; } >one &&
+	{ filler 40 && block && filler 5 && printf "a\nB\nc\n" && filler 40; } >expect &&
+	git apply one.patch &&
+	test_cmp expect one
+'
+
+test_expect_success 'forwards wins over backwards at the same distance' '
+	{ filler 41 && block && filler 7 && block && filler 40; } >one &&
+	{ filler 41 && block && filler 7 && printf "a\nB\nc\n" && filler 40; } >expect &&
+	git apply one.patch &&
+	test_cmp expect one
+'
+
+test_expect_success 'a hunk can match what an earlier one brought in' '
+	cat >two.patch <<-\EOF &&
+	--- a/two
+	+++ b/two
+	@@ -9,5 +9,7 @@
+	 f
+	 f
+	-x
+	+a
+	+b
+	+c
+	 f
+	 f
+	@@ -60,3 +62,3 @@
+	 a
+	-b
+	+B
+	 c
+	EOF
+	{ filler 20 | sed -e s/f/g/ && filler 10 && echo x && filler 90; } >two &&
+	{ filler 20 | sed -e s/f/g/ && filler 10 && printf "a\nB\nc\n" && filler 90; } >expect &&
+	git apply two.patch &&
+	test_cmp expect two
+'
+
+test_done
@@ -129,6 +129,98 @@ test_expect_success 'compare delta flavors' '
 	'\'' test-2-$packname_2.pack test-3-$packname_3.pack
 '
 
+test_expect_success 'tolerate absurdly small pack.maxMemory' '
+	git config pack.maxMemory 1 &&
+	packname_10=$(git pack-objects test-10 <obj-list) &&
+	git config --unset pack.maxMemory &&
+	git verify-pack test-10-$packname_10.pack
+'
+
+test_expect_success 'pack.maxMemory changes only which objects are deltas' '
+	rm -fr budget && mkdir budget && (cd budget && git init -q &&
+	git config pack.threads 1 &&
+	test-genrandom a 32768 >../a &&
+	test-genrandom b 32768 >../b &&
+	# two families of 32k blobs that sort alternately into the window,
+	# so a window that holds a single object finds no delta
+	for i in 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29
+	do
+		mkdir d$i &&
+		case $i in
+		*[02468]) cat ../a ;;
+		*) cat ../b ;;
+		esac >d$i/common-file-name &&
+		test-genrandom $i $i >>d$i/common-file-name || exit 1
+	done &&
+	git add . &&
+	git commit -q -m budget &&
+	git rev-list --objects --all >objects &&
+	for budget in none 1g 64k
+	do
+		if test $budget != none
+		then
+			git config pack.maxMemory $budget
+		fi &&
+		name=$(git pack-objects --no-reuse-delta $budget <objects) &&
+		git verify-pack -v $budget-$name.pack >verify &&
+		grep "^[0-9a-f]\{40\} " verify >$budget.objects || exit 1
+	done &&
+	test_cmp none.objects 1g.objects &&
+	cut -d" " -f1-3 none.objects >expect &&
+	cut -d" " -f1-3 64k.objects >actual &&
+	test_cmp expect actual &&
+	deltas=$(grep -c " [0-9a-f]\{40\}\$" none.objects) &&
+	test $deltas -gt 10 &&
+	test $(grep -c " [0-9a-f]\{40\}\$" 64k.objects) -lt $deltas)
+'
+
+git pack-objects --threads=2 --stdout </dev/null >/dev/null 2>threads.err
+if grep "no threads support" threads.err >/dev/null
+then
+	say "Skipping work stealing test, because threads are not supported"
+else
+	test_set_prereq THREADS
+fi
+
+test_expect_success THREADS 'threads that run dry steal work from the others' '
+	rm -fr skewed && mkdir skewed && (cd skewed && git init -q &&
+	test-genrandom big 262144 >../big-base &&
+	mkdir big &&
+	i=10 &&
+	while test $i -lt 30
+	do
+		{ cat ../big-base && test-genrandom $i 100; } >big/blob$i &&
+		i=$(($i+1))
+	done &&
+	i=100 &&
+	while test $i -lt 400
+	do
+		test-genrandom $i 100 >small$i &&
+		i=$(($i+1))
+	done &&
+	git add . &&
+	git commit -q -m skewed &&
+	git rev-list --objects --all >objects &&
+	name=$(git pack-objects --threads=1 --no-reuse-delta one <objects) &&
+	git verify-pack -v one-$name.pack >verify &&
+	grep "^[0-9a-f]\{40\} " verify | cut -c1-40 | sort >expect &&
+	name=$(GIT_TRACE=2 git pack-objects --threads=4 --no-reuse-delta \
+		four <objects 2>trace) &&
+	git verify-pack -v four-$name.pack >verify &&
+	grep "^[0-9a-f]\{40\} " verify | cut -c1-40 | sort >actual &&
+	test_cmp expect actual &&
+	# every object went through the delta search exactly once
+	sed -n "s/^trace: delta search thread [0-9]*: \([0-9]*\) .*/\1/p" \
+		trace >counts &&
+	test $(wc -l <counts) = 4 &&
+	sum=0 &&
+	while read n
+	do
+		sum=$(($sum + $n))
+	done <counts &&
+	test $sum = $(wc -l <expect))
+'
+
 rm -fr .git2
 mkdir .git2
 
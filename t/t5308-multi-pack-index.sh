@@ -0,0 +1,94 @@
+#!/bin/sh
+
+test_description='multi-pack index'
+. ./test-lib.sh
+
+midx=.git/objects/pack/multi-pack-index
+
+midx_packs () {
+	tr '\000' '\012' <$midx | grep "^pack-[0-9a-f]*\.pack\$"
+}
+
+test_expect_success setup '
+	for i in 1 2 3
+	do
+		echo $i >file$i &&
+		git add file$i &&
+		test_tick &&
+		git commit -q -m $i &&
+		git repack -q || return 1
+	done &&
+	test $(ls .git/objects/pack/*.pack | wc -l) = 3 &&
+	git rev-list --objects --all | cut -c1-40 >objects &&
+	git cat-file --batch-check <objects >expect
+'
+
+test_expect_success 'write and verify' '
+	git multi-pack-index write &&
+	test -f $midx &&
+	test $(midx_packs | wc -l) = 3 &&
+	git multi-pack-index verify
+'
+
+test_expect_success 'objects are found through the index' '
+	git cat-file --batch-check <objects >actual &&
+	test_cmp expect actual &&
+	git fsck --full
+'
+
+test_expect_success 'objects in a pack written later are found' '
+	echo 4 >file4 &&
+	git add file4 &&
+	test_tick &&
+	git commit -q -m 4 &&
+	git rev-list --objects HEAD^..HEAD |
+	git pack-objects -q .git/objects/pack/pack &&
+	git prune-packed &&
+	git rev-list --objects --all | cut -c1-40 >objects &&
+	git cat-file --batch-check <objects >expect &&
+	test $(midx_packs | wc -l) = 3 &&
+	git multi-pack-index verify &&
+	git cat-file --batch-check <objects >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'a pack that went away is not trusted' '
+	git multi-pack-index write &&
+	test $(midx_packs | wc -l) = 4 &&
+	git rev-list --objects --all |
+	git pack-objects -q .git/objects/pack/pack &&
+	rm -f .git/objects/pack/$(midx_packs | sed -n 1p) &&
+	rm -f .git/objects/pack/$(midx_packs | sed -n 1p | sed -e "s/pack\$/idx/") &&
+	git cat-file --batch-check <objects >actual &&
+	test_cmp expect actual &&
+	git fsck --full &&
+	test_must_fail git multi-pack-index verify
+'
+
+test_expect_success 'a corrupt index is ignored' '
+	cp $midx midx.orig &&
+	chmod +w $midx &&
+	echo garbage | dd of=$midx bs=1 seek=0 conv=notrunc 2>/dev/null &&
+	git cat-file --batch-check <objects >actual 2>err &&
+	test_cmp expect actual &&
+	grep "unknown signature" err &&
+	test_must_fail git multi-pack-index verify &&
+	mv -f midx.orig $midx
+'
+
+test_expect_success 'repack rewrites the index' '
+	git repack -a -d -q &&
+	test $(ls .git/objects/pack/*.pack | wc -l) = 1 &&
+	test $(midx_packs | wc -l) = 1 &&
+	git multi-pack-index verify &&
+	git cat-file --batch-check <objects >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'the index goes away with the last pack' '
+	rm -f .git/objects/pack/pack-* &&
+	git multi-pack-index write &&
+	! test -f $midx
+'
+
+test_done
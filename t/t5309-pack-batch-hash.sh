@@ -0,0 +1,68 @@
+#!/bin/sh
+
+test_description='index-pack and verify-pack hashing objects in batches'
+. ./test-lib.sh
+
+test_expect_success setup '
+	i=0 &&
+	while test $i -lt 90
+	do
+		# sizes around the 55/56- and 64-byte padding edges, and larger
+		test-genrandom "$i" $(($i * 7 % 130 + $i * $i)) >blob$i &&
+		i=$(($i+1))
+	done &&
+	: >empty &&
+	git add . &&
+	test_tick &&
+	git commit -q -m base &&
+	git rev-list --objects --all | cut -c1-40 |
+	git pack-objects --no-reuse-object test >/dev/null &&
+	pack=$(ls test-*.pack) &&
+	idx=$(ls test-*.idx) &&
+	GIT_SHA1_BATCH=serial git verify-pack -v $pack |
+	grep "^[0-9a-f]\{40\} " | cut -c1-40 | sort >expect &&
+	git rev-list --objects --all | cut -c1-40 | sort >objects &&
+	test_cmp objects expect
+'
+
+for mode in lanes serial default
+do
+	test_expect_success "index-pack with GIT_SHA1_BATCH=$mode" '
+		if test $mode = default
+		then
+			unset GIT_SHA1_BATCH
+		else
+			GIT_SHA1_BATCH=$mode && export GIT_SHA1_BATCH
+		fi &&
+		rm -f $mode.idx &&
+		git index-pack -o $mode.idx $pack >name &&
+		echo $pack | sed -e "s/^test-\(.*\)\.pack$/\1/" >expect.name &&
+		test_cmp expect.name name &&
+		cmp $idx $mode.idx
+	'
+
+	test_expect_success "verify-pack with GIT_SHA1_BATCH=$mode" '
+		if test $mode = default
+		then
+			unset GIT_SHA1_BATCH
+		else
+			GIT_SHA1_BATCH=$mode && export GIT_SHA1_BATCH
+		fi &&
+		git verify-pack -v $pack |
+		grep "^[0-9a-f]\{40\} " | cut -c1-40 | sort >actual &&
+		test_cmp expect actual
+	'
+
+	test_expect_success "test-sha1 -B with GIT_SHA1_BATCH=$mode" '
+		if test $mode = default
+		then
+			unset GIT_SHA1_BATCH
+		else
+			GIT_SHA1_BATCH=$mode && export GIT_SHA1_BATCH
+		fi &&
+		test-sha1 -B 57 1 &&
+		test-sha1 -B 4096 1
+	'
+done
+
+test_done
@@ -0,0 +1,113 @@
+#!/bin/sh
+
+test_description='merge-check: merging in memory only'
+
+. ./test-lib.sh
+
+test_expect_success setup '
+	printf "1\n2\n3\n4\n5\n6\n7\n8\n9\n" >a &&
+	echo b >b &&
+	mkdir d &&
+	echo moved >d/f &&
+	git add a b d/f &&
+	test_tick &&
+	git commit -q -m base &&
+
+	git checkout -q -b side &&
+	sed -e "s/^1$/one/" a >a.new && mv a.new a &&
+	git mv d/f e &&
+	echo c >c &&
+	git add a c &&
+	test_tick &&
+	git commit -q -m side &&
+
+	git checkout -q -b conflict master &&
+	sed -e "s/^1$/uno/" a >a.new && mv a.new a &&
+	git add a &&
+	test_tick &&
+	git commit -q -m conflict &&
+
+	git checkout -q master &&
+	sed -e "s/^9$/nine/" a >a.new && mv a.new a &&
+	echo changed >d/f &&
+	git add a d/f &&
+	test_tick &&
+	git commit -q -m master
+'
+
+test_expect_success 'clean merge gives the tree git merge makes' '
+	cp .git/index index.before &&
+	git count-objects >objects.before &&
+	git merge-check master side >actual &&
+	test_cmp index.before .git/index &&
+	git count-objects >objects.after &&
+	test_cmp objects.before objects.after &&
+	git diff --exit-code &&
+
+	git checkout -q -b trial master &&
+	git merge -q side &&
+	git rev-parse HEAD^{tree} >expect &&
+	test_cmp expect actual &&
+	git checkout -q master
+'
+
+test_expect_success 'conflicts are listed and marked' '
+	cp .git/index index.before &&
+	test_must_fail git merge-check side conflict >actual &&
+	test_cmp index.before .git/index &&
+	test 2 = $(wc -l <actual) &&
+	echo a >expect &&
+	sed -n 2p actual >paths &&
+	test_cmp expect paths &&
+	git diff --exit-code
+'
+
+test_expect_success 'conflicted tree matches the work tree of a failed merge' '
+	git checkout -q -b trial2 side &&
+	test_must_fail git merge -q conflict &&
+	git add -u &&
+	git write-tree >expect &&
+	git reset -q --hard &&
+	test_must_fail git merge-check HEAD conflict >actual &&
+	sed -n 1p actual >tree &&
+	test_cmp expect tree &&
+	git checkout -q master
+'
+
+test_expect_success 'works in a bare repository' '
+	cp -R .git bare.git &&
+	rm bare.git/index &&
+	git --git-dir=bare.git config core.bare true &&
+	(
+		GIT_DIR=bare.git &&
+		export GIT_DIR &&
+		git merge-check master side >bare-actual &&
+		test_must_fail git merge-check side conflict
+	) &&
+	git merge-check master side >expect &&
+	test_cmp expect bare-actual
+'
+
+test_expect_success 'batch mode answers each pair' '
+	git merge-check master side >clean &&
+	test_must_fail git merge-check side conflict >conflicted &&
+	{
+		echo "clean $(cat clean)" &&
+		echo &&
+		echo "conflict $(sed -n 1p conflicted)" &&
+		sed -n "2,\$p" conflicted &&
+		echo &&
+		echo "error master nosuch" &&
+		echo &&
+		echo "error garbage" &&
+		echo &&
+		echo "clean $(cat clean)" &&
+		echo
+	} >expect &&
+	printf "%s\n" "master side" "side conflict" "master nosuch" garbage \
+		"master side" |
+	git merge-check --stdin >actual &&
+	test_cmp expect actual
+'
+
+test_done
@@ -0,0 +1,92 @@
+#!/bin/sh
+
+test_description='incremental repack keeping existing packs and deltas'
+
+. ./test-lib.sh
+
+pack_count () {
+	ls .git/objects/pack/*.pack | wc -l
+}
+
+test_expect_success setup '
+	for i in 1 2 3 4 5 6 7 8 9 10
+	do
+		echo "line $i of some text that is long enough to delta"
+	done >file &&
+	cp file base &&
+	git add file &&
+	git commit -q -m one &&
+	echo more >>file &&
+	git commit -q -a -m two &&
+	git repack -a -d -q --window=0 &&
+	test $(pack_count) = 1
+'
+
+test_expect_success '--incremental-deltas does not deltify packed objects' '
+	cat base >file &&
+	echo even more >>file &&
+	git commit -q -a -m three &&
+	git repack -a -d -q --incremental-deltas &&
+	test $(pack_count) = 1 &&
+	git verify-pack -v .git/objects/pack/pack-*.idx >verify &&
+	one=$(git rev-parse HEAD~2:file) &&
+	two=$(git rev-parse HEAD~1:file) &&
+	three=$(git rev-parse HEAD:file) &&
+	grep "^$one blob *[0-9]* [0-9]* [0-9]*\$" verify &&
+	grep "^$two blob *[0-9]* [0-9]* [0-9]*\$" verify &&
+	grep "^$three blob.* 1 [0-9a-f]*\$" verify
+'
+
+test_expect_success '--keep-pack leaves the named pack alone' '
+	keep=$(basename .git/objects/pack/pack-*.pack) &&
+	echo four >>file &&
+	git commit -q -a -m four &&
+	git repack -d -q &&
+	echo five >>file &&
+	git commit -q -a -m five &&
+	git repack -d -q &&
+	test $(pack_count) = 3 &&
+	git repack -a -d -q --keep-pack=$keep &&
+	test $(pack_count) = 2 &&
+	test -f .git/objects/pack/$keep &&
+	git fsck --full
+'
+
+test_expect_success 'gc with gc.geometricFactor rolls up only small packs' '
+	test-genrandom big 100000 >big &&
+	git add big &&
+	git commit -q -m big &&
+	git repack -a -d -q &&
+	big=$(basename .git/objects/pack/pack-*.pack) &&
+	for i in 1 2 3
+	do
+		echo $i >small &&
+		git add small &&
+		git commit -q -m small-$i &&
+		git repack -d -q || return 1
+	done &&
+	test $(pack_count) = 4 &&
+	git config gc.geometricFactor 2 &&
+	git gc -q &&
+	test $(pack_count) = 2 &&
+	test -f .git/objects/pack/$big &&
+	git fsck --full
+'
+
+test_expect_success 'gc --auto with gc.geometricFactor' '
+	git config gc.auto 1 &&
+	git gc --auto -q &&
+	test $(pack_count) = 2 &&
+	echo 4 >small &&
+	git commit -q -a -m small-4 &&
+	git repack -d -q &&
+	echo 5 >small &&
+	git commit -q -a -m small-5 &&
+	git repack -d -q &&
+	test $(pack_count) = 4 &&
+	git gc --auto -q &&
+	test $(pack_count) = 2 &&
+	test -f .git/objects/pack/$big
+'
+
+test_done
@@ -1088,4 +1088,177 @@ INPUT_END
 test_expect_success 'P: fail on blob mark in gitlink' '
     test_must_fail git fast-import <input'
 
+###
+### series Q (threaded compression, delta window)
+###
+
+test_tick
+for i in 1 2 3 4 5 6
+do
+	cat <<INPUT_END
+commit refs/heads/Q
+committer $GIT_COMMITTER_NAME <$GIT_COMMITTER_EMAIL> $GIT_COMMITTER_DATE
+data <<COMMIT
+revision $i
+COMMIT
+
+INPUT_END
+	for f in "a:of a, which is long enough to deltify" \
+		 "b:the quick brown fox jumps over the lazy dog"
+	do
+		echo "M 644 inline ${f%%:*}" &&
+		echo "data <<DATA" &&
+		for l in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20
+		do
+			echo "$l ${f#*:}"
+		done &&
+		echo "revision $i" &&
+		echo DATA || exit
+	done
+	echo
+done >input
+
+count_blob_deltas () {
+	git --git-dir=$1/.git verify-pack -v $1/.git/objects/pack/*.pack |
+	awk '$2 == "blob" && NF == 7' |
+	wc -l
+}
+
+test_expect_success \
+	'Q: import with one thread and a window of one' \
+	'mkdir Q1 && (cd Q1 && git init &&
+	  git fast-import --threads=1 --delta-window=1 <../input) &&
+	 test 0 = $(count_blob_deltas Q1)'
+test_expect_success \
+	'Q: a wider window finds the same path' \
+	'mkdir Q2 && (cd Q2 && git init &&
+	  git fast-import --threads=1 --delta-window=2 <../input) &&
+	 test 10 = $(count_blob_deltas Q2) &&
+	 test $(git --git-dir=Q1/.git rev-parse Q) = \
+	      $(git --git-dir=Q2/.git rev-parse Q)'
+test_expect_success \
+	'Q: threads give the same objects' \
+	'mkdir Q3 && (cd Q3 && git init &&
+	  git fast-import --threads=4 --delta-window=2 <../input &&
+	  git fsck --full) &&
+	 test $(git --git-dir=Q1/.git rev-parse Q) = \
+	      $(git --git-dir=Q3/.git rev-parse Q) &&
+	 git --git-dir=Q3/.git verify-pack Q3/.git/objects/pack/*.pack'
+test_expect_success \
+	'Q: threads with small packs' \
+	'mkdir Q4 && (cd Q4 && git init &&
+	  git fast-import --threads=4 --delta-window=2 --max-pack-size=0 \
+		<../input &&
+	  git fsck --full) &&
+	 test $(git --git-dir=Q1/.git rev-parse Q) = \
+	      $(git --git-dir=Q4/.git rev-parse Q)'
+
+###
+### series R (mark database)
+###
+
+test_tick
+for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16
+do
+	cat <<INPUT_END
+blob
+mark :$i
+data <<DATA
+blob $i
+DATA
+
+INPUT_END
+done >input
+cat >>input <<INPUT_END
+commit refs/heads/R
+mark :100
+committer $GIT_COMMITTER_NAME <$GIT_COMMITTER_EMAIL> $GIT_COMMITTER_DATE
+data <<COMMIT
+first
+COMMIT
+M 644 :1 one
+M 644 :16 sixteen
+
+INPUT_END
+
+test_expect_success \
+	'R: marks are kept in a mark database' \
+	'mkdir R && (cd R && git init &&
+	  git fast-import --marks-db=marks.db <../input &&
+	  test -f marks.db &&
+	  ! test -f marks.db.log &&
+	  test FIMK = "$(dd if=marks.db bs=4 count=1 2>/dev/null)" &&
+	  git fast-import --marks-db=marks.db --export-marks=marks.txt \
+		</dev/null &&
+	  test 17 = $(wc -l <marks.txt) &&
+	  grep "^:100 $(git rev-parse R)$" marks.txt)'
+
+cat >input <<INPUT_END
+blob
+mark :17
+data <<DATA
+blob 17
+DATA
+
+commit refs/heads/R
+mark :101
+committer $GIT_COMMITTER_NAME <$GIT_COMMITTER_EMAIL> $GIT_COMMITTER_DATE
+data <<COMMIT
+second
+COMMIT
+from :100
+M 644 :2 two
+M 644 :17 seventeen
+
+INPUT_END
+
+test_expect_success \
+	'R: later imports use the database and log new marks' \
+	'(cd R &&
+	  cp marks.db marks.before &&
+	  git fast-import --marks-db=marks.db <../input &&
+	  cmp marks.before marks.db &&
+	  test $(wc -c <marks.db.log) = 64 &&
+	  test "$(git rev-parse R^)" = "$(git rev-parse R~1)" &&
+	  test blob = $(git cat-file -t R:two) &&
+	  test "blob 17" = "$(git cat-file blob R:seventeen)" &&
+	  git fast-import --marks-db=marks.db --export-marks=marks.txt \
+		</dev/null &&
+	  test 19 = $(wc -l <marks.txt) &&
+	  grep "^:101 $(git rev-parse R)$" marks.txt &&
+	  grep "^:17 $(git rev-parse R:seventeen)$" marks.txt)'
+
+cat >input <<INPUT_END
+commit refs/heads/R2
+mark :102
+committer $GIT_COMMITTER_NAME <$GIT_COMMITTER_EMAIL> $GIT_COMMITTER_DATE
+data <<COMMIT
+third
+COMMIT
+from :101
+M 644 :3 three
+
+checkpoint
+
+bogus
+INPUT_END
+
+test_expect_success \
+	'R: marks are logged at a checkpoint' \
+	'(cd R &&
+	  test_must_fail git fast-import --marks-db=marks.db <../input &&
+	  test $(wc -c <marks.db.log) = 96 &&
+	  git fast-import --marks-db=marks.db --export-marks=marks.txt \
+		</dev/null &&
+	  grep "^:102 $(git rev-parse R2)$" marks.txt)'
+
+test_expect_success \
+	'R: text marks can be imported into a database' \
+	'(cd R &&
+	  git fast-import --marks-db=new.db --import-marks=marks.txt \
+		</dev/null &&
+	  git fast-import --marks-db=new.db --export-marks=new.txt \
+		</dev/null &&
+	  test_cmp marks.txt new.txt)'
+
 test_done
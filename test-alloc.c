@@ -0,0 +1,85 @@
+#include "cache.h"
+#include "commit.h"
+#include "tree.h"
+
+static const char usage_str[] = "test-alloc [-v] <commit> [<rounds>]";
+
+/* Parse every commit and root tree reachable from "sha1". */
+static unsigned int walk(const unsigned char *sha1, unsigned int *parents)
+{
+	struct commit_list *list = NULL;
+	struct commit *commit = lookup_commit_reference(sha1);
+	unsigned int nr = 0;
+
+	if (!commit)
+		die("not a commit: %s", sha1_to_hex(sha1));
+	*parents = 0;
+	commit->object.flags |= 1;
+	commit_list_insert(commit, &list);
+	while (list) {
+		struct commit_list *p, *top = list;
+
+		commit = top->item;
+		list = top->next;
+		free(top);
+		if (parse_commit(commit) || parse_tree(commit->tree))
+			die("cannot parse %s", sha1_to_hex(commit->object.sha1));
+		nr++;
+		for (p = commit->parents; p; p = p->next) {
+			if (!is_alloc_commit_list_node(p))
+				die("parent of %s allocated elsewhere",
+				    sha1_to_hex(commit->object.sha1));
+			(*parents)++;
+			if (p->item->object.flags & 1)
+				continue;
+			p->item->object.flags |= 1;
+			commit_list_insert(p->item, &list);
+		}
+	}
+	return nr;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned char sha1[20];
+	unsigned int round, rounds = 3, nr, parents, first_nr = 0, first_parents = 0;
+	size_t reserved = 0;
+	int verbose = 0;
+
+	if (argc > 1 && !strcmp(argv[1], "-v")) {
+		verbose = 1;
+		argc--;
+		argv++;
+	}
+	if (argc < 2 || argc > 3)
+		usage(usage_str);
+	if (argc == 3)
+		rounds = strtoul(argv[2], NULL, 10);
+
+	setup_git_directory();
+	if (get_sha1(argv[1], sha1))
+		die("not a valid object name: %s", argv[1]);
+
+	for (round = 0; round < rounds; round++) {
+		nr = walk(sha1, &parents);
+		if (verbose)
+			alloc_report();
+		if (!round) {
+			first_nr = nr;
+			first_parents = parents;
+			reserved = alloc_bytes_reserved();
+		} else if (nr != first_nr || parents != first_parents)
+			die("round %u saw %u commits and %u parents, not %u and %u",
+			    round, nr, parents, first_nr, first_parents);
+		else if (alloc_bytes_reserved() != reserved)
+			die("round %u reserved %lu bytes, not %lu", round,
+			    (unsigned long)alloc_bytes_reserved(),
+			    (unsigned long)reserved);
+		clear_parsed_objects();
+		if (alloc_bytes_reserved())
+			die("%lu bytes still reserved after clearing",
+			    (unsigned long)alloc_bytes_reserved());
+	}
+	printf("ok %u commits, %u parents\n", first_nr, first_parents);
+	return 0;
+}
@@ -0,0 +1,113 @@
+#include "cache.h"
+
+/*
+ * Fill "buf" with "size" bytes of made-up text: lines of up to 80
+ * letters, spaces and tabs, each ending in "eol".
+ */
+static void make_text(char *buf, size_t size, const char *eol)
+{
+	static const char chars[] = "etaoin shrdlu\tcmfwyp vbgkqjxz";
+	size_t eollen = strlen(eol), i = 0;
+	unsigned next = 1;
+
+	while (i < size) {
+		unsigned line;
+		next = next * 1103515245 + 12345;
+		line = (next >> 16) % 80;
+		while (line-- && i < size) {
+			next = next * 1103515245 + 12345;
+			buf[i++] = chars[(next >> 16) % (sizeof(chars) - 1)];
+		}
+		if (i + eollen <= size) {
+			memcpy(buf + i, eol, eollen);
+			i += eollen;
+		} else
+			buf[i++] = 'x';
+	}
+}
+
+static double elapsed(struct timeval *t0)
+{
+	struct timeval t1;
+	gettimeofday(&t1, NULL);
+	return (t1.tv_sec - t0->tv_sec) + (t1.tv_usec - t0->tv_usec) / 1e6;
+}
+
+/*
+ * Run text with LF and with CRLF line endings, and binary data, through
+ * the conversions core.autocrlf asks for, "mb" megabytes each way, and
+ * report the throughput of the kernels we picked.
+ */
+static int bench(unsigned mb)
+{
+	static const char *kinds[] = { "LF text", "CRLF text", "binary" };
+	size_t size = 1024 * 1024, total = (size_t)mb * size;
+	char *input = xmalloc(size);
+	struct strbuf out = STRBUF_INIT;
+	int kind, to_worktree;
+
+	auto_crlf = 1;
+	printf("backend: %s\n", convert_text_backend());
+	for (kind = 0; kind < ARRAY_SIZE(kinds); kind++) {
+		if (kind < 2)
+			make_text(input, size, kind ? "\r\n" : "\n");
+		else {
+			unsigned next = 1;
+			size_t i;
+			for (i = 0; i < size; i++) {
+				next = next * 1103515245 + 12345;
+				input[i] = (next >> 16) % 255 + 1;
+			}
+		}
+		for (to_worktree = 0; to_worktree < 2; to_worktree++) {
+			struct timeval t0;
+			size_t done;
+			double secs;
+
+			gettimeofday(&t0, NULL);
+			for (done = 0; done < total; done += size) {
+				strbuf_reset(&out);
+				if (to_worktree)
+					convert_to_working_tree("bench", input, size, &out);
+				else
+					convert_to_git("bench", input, size, &out, 0);
+			}
+			secs = elapsed(&t0);
+			printf("%-9s %-14s %8.1f MB/s\n", kinds[kind],
+			       to_worktree ? "to work tree:" : "to git:",
+			       secs > 0 ? done / secs / size : 0);
+		}
+	}
+	strbuf_release(&out);
+	free(input);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct strbuf in = STRBUF_INIT, out = STRBUF_INIT;
+	int nongit, converted;
+
+	if (argc >= 2 && !strcmp(argv[1], "-b"))
+		return bench(argc == 3 ? strtoul(argv[2], NULL, 10) : 64);
+	if (argc != 3 ||
+	    (strcmp(argv[1], "to-git") && strcmp(argv[1], "to-worktree")))
+		die("usage: test-convert (to-git|to-worktree) <path> <input >output\n"
+		    "       test-convert -b [<MB>]");
+
+	setup_git_directory_gently(&nongit);
+	git_config(git_default_config, NULL);
+	if (strbuf_read(&in, 0, 0) < 0)
+		die("cannot read input: %s", strerror(errno));
+	if (!strcmp(argv[1], "to-git"))
+		converted = convert_to_git(argv[2], in.buf, in.len, &out,
+					   safe_crlf);
+	else
+		converted = convert_to_working_tree(argv[2], in.buf, in.len,
+						    &out);
+	if (converted)
+		fwrite(out.buf, 1, out.len, stdout);
+	else
+		fwrite(in.buf, 1, in.len, stdout);
+	return 0;
+}
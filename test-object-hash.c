@@ -0,0 +1,107 @@
+#include "cache.h"
+#include "object.h"
+
+static const char usage_str[] =
+"test-object-hash (verify | bench) [<count>]";
+
+/* distinct, well-spread object names */
+static unsigned char *make_names(unsigned int nr, unsigned int salt)
+{
+	unsigned char *names = xmalloc((size_t)nr * 20);
+	unsigned int i, buf[2];
+
+	for (i = 0; i < nr; i++) {
+		git_SHA_CTX c;
+		buf[0] = i;
+		buf[1] = salt;
+		git_SHA1_Init(&c);
+		git_SHA1_Update(&c, buf, sizeof(buf));
+		git_SHA1_Final(names + (size_t)i * 20, &c);
+	}
+	return names;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int verify(unsigned int nr)
+{
+	unsigned char *names = make_names(nr, 0);
+	unsigned char *missing = make_names(nr, 1);
+	struct object **objs = xmalloc(nr * sizeof(*objs));
+	unsigned int i, j, max, seen = 0;
+
+	for (i = 0; i < nr; i++) {
+		objs[i] = lookup_unknown_object(names + (size_t)i * 20);
+		if (lookup_unknown_object(names + (size_t)i * 20) != objs[i])
+			die("object %u created twice", i);
+		/* look back at a few earlier ones while the table grows */
+		for (j = i; j; j /= 2)
+			if (lookup_object(names + (size_t)j * 20) != objs[j])
+				die("object %u lost after inserting %u", j, i);
+		if (lookup_object(missing + (size_t)i * 20))
+			die("found an object that was never created");
+	}
+	for (i = 0; i < nr; i++)
+		if (lookup_object(names + (size_t)i * 20) != objs[i])
+			die("object %u lost", i);
+
+	max = get_max_object_index();
+	for (i = 0; i < max; i++) {
+		struct object *obj = get_indexed_object(i);
+		if (!obj)
+			continue;
+		if (obj->flags)
+			die("object %s listed twice", sha1_to_hex(obj->sha1));
+		obj->flags = 1;
+		seen++;
+	}
+	if (seen != nr)
+		die("listed %u objects instead of %u", seen, nr);
+	printf("ok %u\n", nr);
+	return 0;
+}
+
+static int bench(unsigned int nr)
+{
+	unsigned char *names = make_names(nr, 0);
+	unsigned char *missing = make_names(nr, 1);
+	unsigned int i, found = 0;
+	double t;
+
+	t = now();
+	for (i = 0; i < nr; i++)
+		lookup_unknown_object(names + (size_t)i * 20);
+	printf("insert: %6.1f ns/object\n", (now() - t) * 1e9 / nr);
+
+	t = now();
+	for (i = 0; i < nr; i++)
+		found += !!lookup_object(names + (size_t)((i * 2654435761U) % nr) * 20);
+	printf("hit:    %6.1f ns/lookup\n", (now() - t) * 1e9 / nr);
+
+	t = now();
+	for (i = 0; i < nr; i++)
+		found += !!lookup_object(missing + (size_t)i * 20);
+	printf("miss:   %6.1f ns/lookup\n", (now() - t) * 1e9 / nr);
+
+	return found > nr;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int nr = 1000000;
+
+	if (argc < 2 || argc > 3)
+		usage(usage_str);
+	if (argc == 3)
+		nr = strtoul(argv[2], NULL, 10);
+	if (!strcmp(argv[1], "verify"))
+		return verify(nr);
+	if (!strcmp(argv[1], "bench"))
+		return bench(nr);
+	usage(usage_str);
+}
@@ -0,0 +1,70 @@
+#include "cache.h"
+#include "tree.h"
+#include "tree-walk.h"
+
+static const char usage_str[] = "test-parsed-tree <tree-ish> [<rounds>]";
+
+static unsigned int entries, sum;
+
+/* cheap enough not to hide the cost of the walk itself */
+static int show_entry(const unsigned char *sha1, const char *base, int baselen,
+		      const char *path, unsigned int mode, int stage, void *context)
+{
+	sum = sum * 31 + mode + sha1[0] + sha1[19] + path[0] + baselen;
+	entries++;
+	return READ_TREE_RECURSIVE;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Walk "tree" "rounds" times and return a checksum of what was seen. */
+static unsigned int walk(struct tree *tree, int rounds, const char *what)
+{
+	double t = now();
+	int i;
+
+	for (i = 0; i < rounds; i++) {
+		sum = entries = 0;
+		if (read_tree_recursive(tree, "", 0, 0, NULL, show_entry, NULL))
+			die("cannot walk %s", sha1_to_hex(tree->object.sha1));
+	}
+	fprintf(stderr, "%s: %.1f us/walk\n", what, (now() - t) * 1e6 / rounds);
+	return sum;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned char sha1[20];
+	unsigned int raw, parsed;
+	struct tree *tree;
+	unsigned long budget = parsed_tree_budget;
+	int rounds = 1;
+
+	if (argc < 2 || argc > 3)
+		usage(usage_str);
+	if (argc == 3)
+		rounds = atoi(argv[2]);
+	setup_git_directory();
+	if (get_sha1(argv[1], sha1))
+		die("not a valid object name: %s", argv[1]);
+	tree = parse_tree_indirect(sha1);
+	if (!tree)
+		die("not a tree: %s", argv[1]);
+
+	/* the first walk reads the trees, the next ones do not */
+	parsed_tree_budget = 0;
+	walk(tree, 1, "read");
+	raw = walk(tree, rounds, "raw");
+	parsed_tree_budget = budget;
+	walk(tree, 1, "decode");
+	parsed = walk(tree, rounds, "parsed");
+	if (raw != parsed)
+		die("walks over raw and parsed trees differ");
+	printf("ok %u entries\n", entries);
+	return 0;
+}
@@ -1,4 +1,88 @@
 #include "cache.h"
+#include "sha1-batch.h"
+
+/*
+ * Hash "mb" megabytes held in core, in chunks of various sizes, and
+ * report the throughput of the SHA-1 implementation we were built with.
+ */
+static int bench(unsigned mb)
+{
+	static const unsigned chunks[] = { 64, 1024, 8192, 1024 * 1024 };
+	size_t total = (size_t)mb * 1024 * 1024;
+	unsigned char *buffer = xmalloc(total);
+	unsigned char sha1[20];
+	size_t i;
+	int c;
+
+	for (i = 0; i < total; i++)
+		buffer[i] = i * 2654435761U >> 24;
+#ifdef GIT_SHA1_BACKEND
+	printf("backend: %s\n", GIT_SHA1_BACKEND);
+#endif
+	for (c = 0; c < ARRAY_SIZE(chunks); c++) {
+		git_SHA_CTX ctx;
+		struct timeval t0, t1;
+		double secs;
+
+		gettimeofday(&t0, NULL);
+		git_SHA1_Init(&ctx);
+		for (i = 0; i + chunks[c] <= total; i += chunks[c])
+			git_SHA1_Update(&ctx, buffer + i, chunks[c]);
+		git_SHA1_Final(sha1, &ctx);
+		gettimeofday(&t1, NULL);
+		secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1e6;
+		printf("%8u-byte updates: %8.1f MB/s\n",
+		       chunks[c], secs > 0 ? i / secs / (1024 * 1024) : 0);
+	}
+	free(buffer);
+	return 0;
+}
+
+/*
+ * Hash "mb" megabytes as objects of "objsize" bytes, one at a time and
+ * in batches of 64, and check that both give the same names.
+ */
+static int bench_batch(unsigned objsize, unsigned mb)
+{
+	size_t total = (size_t)mb * 1024 * 1024;
+	unsigned nr = total / objsize, batch = 64, i, j, pass;
+	unsigned char *buffer = xmalloc(total);
+	struct sha1_job *jobs = xmalloc(batch * sizeof(*jobs));
+	unsigned char *names = xmalloc(nr * 20);
+
+	for (i = 0; i < total; i++)
+		buffer[i] = i * 2654435761U >> 24;
+	for (pass = 0; pass < 2; pass++) {
+		struct timeval t0, t1;
+		double secs;
+
+		gettimeofday(&t0, NULL);
+		for (i = 0; i < nr; i += batch) {
+			unsigned n = nr - i < batch ? nr - i : batch;
+			for (j = 0; j < n; j++)
+				sha1_job_init(&jobs[j], buffer + (size_t)(i + j) * objsize,
+					      objsize - j % 7, "blob");
+			if (pass)
+				git_SHA1_Batch(jobs, n);
+			for (j = 0; j < n; j++) {
+				if (!pass)
+					hash_sha1_file(jobs[j].data, jobs[j].len,
+						       "blob", names + 20 * (i + j));
+				else if (hashcmp(jobs[j].sha1, names + 20 * (i + j)))
+					die("batch hash of object %u differs", i + j);
+			}
+		}
+		gettimeofday(&t1, NULL);
+		secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1e6;
+		printf("%8u-byte objects, %s: %8.1f MB/s\n", objsize,
+		       pass ? "batched" : "one by one",
+		       secs > 0 ? total / secs / (1024 * 1024) : 0);
+	}
+	free(names);
+	free(jobs);
+	free(buffer);
+	return 0;
+}
 
 int main(int ac, char **av)
 {
@@ -7,6 +91,12 @@ int main(int ac, char **av)
 	unsigned bufsz = 8192;
 	char *buffer;
 
+	if (ac >= 2 && !strcmp(av[1], "-b"))
+		return bench(ac == 3 ? strtoul(av[2], NULL, 10) : 256);
+	if (ac >= 2 && !strcmp(av[1], "-B"))
+		return bench_batch(ac >= 3 ? strtoul(av[2], NULL, 10) : 256,
+				   ac == 4 ? strtoul(av[3], NULL, 10) : 64);
+
 	if (ac == 2)
 		bufsz = strtoul(av[1], NULL, 10) * 1024 * 1024;
 
@@ -24,6 +24,14 @@ static void decode_tree_entry(struct tree_desc *desc, const char *buf, unsigned
 	const char *path;
 	unsigned int mode, len;
 
+	if (desc->parsed) {
+		path = buf + desc->parsed->path;
+		desc->entry.path = path;
+		desc->entry.mode = desc->parsed->mode;
+		desc->entry.sha1 = (const unsigned char *)(path + desc->parsed->pathlen + 1);
+		return;
+	}
+
 	if (size < 24 || buf[size - 21])
 		die("corrupt tree file");
 
@@ -42,10 +50,87 @@ void init_tree_desc(struct tree_desc *desc, const void *buffer, unsigned long si
 {
 	desc->buffer = buffer;
 	desc->size = size;
+	desc->parsed = NULL;
 	if (size)
 		decode_tree_entry(desc, buffer, size);
 }
 
+unsigned long parsed_tree_budget = 32 * 1024 * 1024;
+static unsigned long parsed_tree_bytes;
+
+/*
+ * Decode all entries of a tree buffer, or return NULL if it is corrupt
+ * (so that the ordinary walk can complain about it) or out of budget.
+ */
+static struct parsed_tree *parse_tree_entries(const char *buf, unsigned long size)
+{
+	struct parsed_tree *parsed;
+	unsigned long bytes;
+	unsigned int nr = 0;
+
+	/* no entry is shorter than "0 a\0" and the object name */
+	bytes = sizeof(*parsed) + (size / 24) * sizeof(parsed->entry[0]);
+	if (parsed_tree_bytes + bytes > parsed_tree_budget)
+		return NULL;
+	parsed = xmalloc(bytes);
+
+	while (size) {
+		struct parsed_tree_entry *e = &parsed->entry[nr];
+		const char *path;
+		unsigned long len;
+
+		if (size < 24 || buf[size - 21])
+			goto corrupt;
+		path = get_mode(buf, &e->mode);
+		if (!path || !*path || path - buf > 0xff)
+			goto corrupt;
+		len = strlen(path);
+		if (len > 0xffff)
+			goto corrupt;
+		e->pathlen = len;
+		e->path = path - buf;
+		len = path + len + 21 - buf;
+		if (size < len)
+			goto corrupt;
+		buf += len;
+		size -= len;
+		nr++;
+	}
+	parsed->nr = nr;
+	bytes = sizeof(*parsed) + nr * sizeof(parsed->entry[0]);
+	parsed = xrealloc(parsed, bytes);
+	parsed_tree_bytes += bytes;
+	return parsed;
+
+corrupt:
+	free(parsed);
+	return NULL;
+}
+
+void init_tree_desc_from_tree(struct tree_desc *desc, struct tree *tree)
+{
+	if (tree->buffer && !tree->parsed) {
+		if (tree->walked)
+			tree->parsed = parse_tree_entries(tree->buffer, tree->size);
+		tree->walked = 1;
+	}
+	desc->buffer = tree->buffer;
+	desc->size = tree->size;
+	desc->parsed = tree->buffer && tree->parsed ? tree->parsed->entry : NULL;
+	if (desc->size)
+		decode_tree_entry(desc, desc->buffer, desc->size);
+}
+
+void free_parsed_tree(struct tree *tree)
+{
+	if (!tree->parsed)
+		return;
+	parsed_tree_bytes -= sizeof(*tree->parsed) +
+		tree->parsed->nr * sizeof(tree->parsed->entry[0]);
+	free(tree->parsed);
+	tree->parsed = NULL;
+}
+
 void *fill_tree_descriptor(struct tree_desc *desc, const unsigned char *sha1)
 {
 	unsigned long size = 0;
@@ -90,6 +175,8 @@ void update_tree_entry(struct tree_desc *desc)
 	size -= len;
 	desc->buffer = buf;
 	desc->size = size;
+	if (desc->parsed)
+		desc->parsed++;
 	if (size)
 		decode_tree_entry(desc, buf, size);
 }
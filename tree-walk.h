@@ -7,10 +7,27 @@ struct name_entry {
 	unsigned int mode;
 };
 
+/*
+ * A tree entry decoded ahead of time: the mode, where the name starts
+ * relative to the start of the entry, and how long the name is.  The
+ * object name follows the NUL after the name.
+ */
+struct parsed_tree_entry {
+	unsigned int mode;
+	unsigned short pathlen;
+	unsigned char path;
+};
+
+struct parsed_tree {
+	unsigned int nr;
+	struct parsed_tree_entry entry[FLEX_ARRAY];
+};
+
 struct tree_desc {
 	const void *buffer;
 	struct name_entry entry;
 	unsigned int size;
+	const struct parsed_tree_entry *parsed;	/* current entry, if any */
 };
 
 static inline const unsigned char *tree_entry_extract(struct tree_desc *desc, const char **pathp, unsigned int *modep)
@@ -28,6 +45,17 @@ static inline int tree_entry_len(const char *name, const unsigned char *sha1)
 void update_tree_entry(struct tree_desc *);
 void init_tree_desc(struct tree_desc *desc, const void *buf, unsigned long size);
 
+/*
+ * Like init_tree_desc() on the buffer of a parsed tree.  A tree that is
+ * walked this way more than once keeps its entries decoded, so that
+ * later walks do not have to parse them again, as long as all such
+ * trees together stay within parsed_tree_budget bytes.
+ */
+struct tree;
+extern unsigned long parsed_tree_budget;
+void init_tree_desc_from_tree(struct tree_desc *desc, struct tree *tree);
+void free_parsed_tree(struct tree *tree);
+
 /* Helper function that does both of the above and returns true for success */
 int tree_entry(struct tree_desc *, struct name_entry *);
 
@@ -9,6 +9,8 @@ struct tree {
 	struct object object;
 	void *buffer;
 	unsigned long size;
+	struct parsed_tree *parsed;	/* see init_tree_desc_from_tree() */
+	unsigned walked:1;
 };
 
 struct tree *lookup_tree(const unsigned char *sha1);
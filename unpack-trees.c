@@ -159,8 +159,17 @@ int traverse_trees_recursive(int n, unsigned long dirmask, unsigned long df_conf
 
 	for (i = 0; i < n; i++, dirmask >>= 1) {
 		const unsigned char *sha1 = NULL;
-		if (dirmask & 1)
+		struct tree *tree;
+		if (dirmask & 1) {
 			sha1 = names[i].sha1;
+			/* walk a tree that is already in memory from there */
+			tree = (struct tree *)lookup_object(sha1);
+			if (tree && tree->object.type == OBJ_TREE &&
+			    tree->buffer) {
+				init_tree_desc_from_tree(t+i, tree);
+				continue;
+			}
+		}
 		fill_tree_descriptor(t+i, sha1);
 	}
 	return traverse_trees(n, t, &newinfo);
@@ -277,6 +286,61 @@ static int unpack_nondirectories(int n, unsigned long mask,
 	return 0;
 }
 
+static int ce_in_directory(const struct cache_entry *ce, const char *path, int len)
+{
+	return ce_namelen(ce) > len && ce->name[len] == '/' &&
+		!memcmp(ce->name, path, len);
+}
+
+/*
+ * "diff-index --cached" has nothing to say about index entries that
+ * are the same as in the tree.  When the cache-tree says a directory
+ * of the index is unchanged from the directory we are about to
+ * descend into, skip the index entries under it instead.
+ */
+static int skip_unchanged_directory(int n, unsigned long mask,
+				    unsigned long dirmask,
+				    struct cache_entry **src,
+				    const struct name_entry *names,
+				    const struct traverse_info *info)
+{
+	struct unpack_trees_options *o = info->data;
+	struct index_state *index = o->src_index;
+	struct cache_tree *it;
+	int len, end, i, ret = 0;
+	char *path;
+
+	if (n != 1 || mask != 1 || dirmask != 1 || src[0] || info->conflicts)
+		return 0;
+	if (!index->cache_tree || o->pos >= index->cache_nr)
+		return 0;
+
+	len = traverse_path_len(info, names);
+	path = xmalloc(len + 1);
+	make_traverse_path(path, info, names);
+	it = cache_tree_find(index->cache_tree, path);
+	if (!it || it->entry_count <= 0 || hashcmp(it->sha1, names->sha1))
+		goto out;
+
+	/* The index entries for the directory must start right here */
+	end = o->pos + it->entry_count;
+	if (end > index->cache_nr ||
+	    !ce_in_directory(index->cache[o->pos], path, len) ||
+	    !ce_in_directory(index->cache[end - 1], path, len) ||
+	    (end < index->cache_nr &&
+	     ce_in_directory(index->cache[end], path, len)))
+		goto out;
+	/* Unmerged entries must be reported even if the tree is unchanged */
+	for (i = o->pos; i < end; i++)
+		if (ce_stage(index->cache[i]))
+			goto out;
+	o->pos = end;
+	ret = 1;
+out:
+	free(path);
+	return ret;
+}
+
 static int unpack_callback(int n, unsigned long mask, unsigned long dirmask, struct name_entry *names, struct traverse_info *info)
 {
 	struct cache_entry *src[MAX_UNPACK_TREES + 1] = { NULL, };
@@ -313,6 +377,9 @@ static int unpack_callback(int n, unsigned long mask, unsigned long dirmask, str
 			}
 			break;
 		}
+		if (o->diff_index_cached &&
+		    skip_unchanged_directory(n, mask, dirmask, src, names, info))
+			return mask;
 	}
 
 	if (unpack_nondirectories(n, mask, dirmask, src, names, info) < 0)
@@ -368,6 +435,7 @@ int unpack_trees(unsigned len, struct tree_desc *t, struct unpack_trees_options
 	if (o->src_index) {
 		o->result.timestamp.sec = o->src_index->timestamp.sec;
 		o->result.timestamp.nsec = o->src_index->timestamp.nsec;
+		o->result.version = o->src_index->version;
 	}
 	o->merge_size = len;
 
@@ -0,0 +1,334 @@
+/*
+ * Text statistics and CRLF conversion kernels for x86-64, see
+ * convert-kernels.h.  "avx2" works 32 bytes at a time and moves the
+ * bytes around a CR with byte shuffles, "sse2" works 16 bytes at a time
+ * and leaves a vector that has a CR to take out or put in to a byte
+ * loop.  The choice is made on first use from what CPUID reports, or by
+ * GIT_X86_CONVERT=<name> (one of those or "generic") as long as the CPU
+ * supports it; that is meant for testing and for comparing them with
+ * "test-convert -b".
+ */
+#include "../git-compat-util.h"
+#include "../convert-kernels.h"
+#include "cpu.h"
+
+#if defined(__GNUC__) && defined(__x86_64__) && \
+	(defined(__clang__) || __GNUC__ > 4 || \
+	 (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+
+#include <immintrin.h>
+
+/* for each mask of bytes to drop from 8, where the others go */
+static unsigned char drop_cr_shuffle[256][8];
+/* for each mask of LFs in 8 bytes, where they and the CRs (8) go */
+static unsigned char add_cr_shuffle[256][16];
+
+static void init_shuffles(void)
+{
+	int m, b, k;
+
+	for (m = 0; m < 256; m++) {
+		for (b = k = 0; b < 8; b++)
+			if (!(m & (1 << b)))
+				drop_cr_shuffle[m][k++] = b;
+		while (k < 8)
+			drop_cr_shuffle[m][k++] = 0x80;
+		for (b = k = 0; b < 8; b++) {
+			if (m & (1 << b))
+				add_cr_shuffle[m][k++] = 8;
+			add_cr_shuffle[m][k++] = b;
+		}
+		while (k < 16)
+			add_cr_shuffle[m][k++] = 0x80;
+	}
+}
+
+static size_t drop_marked(char *dst, const char *src, int n, unsigned mask)
+{
+	size_t out = 0;
+	int k;
+
+	for (k = 0; k < n; k++)
+		if (!(mask & (1u << k)))
+			dst[out++] = src[k];
+	return out;
+}
+
+static size_t add_cr_marked(char *dst, const char *src, int n, unsigned mask)
+{
+	size_t out = 0;
+	int k;
+
+	for (k = 0; k < n; k++) {
+		if (mask & (1u << k))
+			dst[out++] = '\r';
+		dst[out++] = src[k];
+	}
+	return out;
+}
+
+static inline uint64_t sum_bytes_sse2(__m128i v)
+{
+	v = _mm_sad_epu8(v, _mm_setzero_si128());
+	return _mm_cvtsi128_si64(v) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(v, v));
+}
+
+static unsigned long stats_sse2(const char *buf, unsigned long size,
+				struct text_stat *stats)
+{
+	const __m128i lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+	const __m128i zero = _mm_setzero_si128();
+	unsigned long i = 0;
+
+	while (i + 16 < size) {
+		__m128i n_lf = zero, n_cr = zero, n_crlf = zero;
+		__m128i n_nul = zero, n_np = zero;
+		unsigned long start = i, lfs, crs, nps;
+		int round;
+
+		/* the byte counters must not wrap */
+		for (round = 0; round < 255 && i + 16 < size; round++, i += 16) {
+			__m128i c = _mm_loadu_si128((const __m128i *)(buf + i));
+			__m128i next = _mm_loadu_si128((const __m128i *)(buf + i + 1));
+			__m128i is_lf = _mm_cmpeq_epi8(c, lf);
+			__m128i is_cr = _mm_cmpeq_epi8(c, cr);
+			__m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(c, _mm_set1_epi8(31)), c);
+			__m128i ok = _mm_or_si128(_mm_or_si128(is_lf, is_cr),
+				     _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('\b')),
+							       _mm_cmpeq_epi8(c, _mm_set1_epi8('\t'))),
+						  _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('\033')),
+							       _mm_cmpeq_epi8(c, _mm_set1_epi8('\014')))));
+
+			n_lf = _mm_sub_epi8(n_lf, is_lf);
+			n_cr = _mm_sub_epi8(n_cr, is_cr);
+			n_crlf = _mm_sub_epi8(n_crlf, _mm_and_si128(is_cr, _mm_cmpeq_epi8(next, lf)));
+			n_nul = _mm_sub_epi8(n_nul, _mm_cmpeq_epi8(c, zero));
+			n_np = _mm_sub_epi8(n_np, _mm_or_si128(_mm_andnot_si128(ok, ctl),
+							       _mm_cmpeq_epi8(c, _mm_set1_epi8(127))));
+		}
+		lfs = sum_bytes_sse2(n_lf);
+		crs = sum_bytes_sse2(n_cr);
+		nps = sum_bytes_sse2(n_np);
+		stats->lf += lfs;
+		stats->cr += crs;
+		stats->crlf += sum_bytes_sse2(n_crlf);
+		stats->nul += sum_bytes_sse2(n_nul);
+		stats->nonprintable += nps;
+		stats->printable += i - start - lfs - crs - nps;
+	}
+	return i;
+}
+
+static size_t drop_cr_sse2(char *dst, const char *src, size_t len, int all,
+			   size_t *out)
+{
+	const __m128i lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+	size_t i, o = 0;
+
+	for (i = 0; i + 16 < len; i += 16) {
+		__m128i c = _mm_loadu_si128((const __m128i *)(src + i));
+		unsigned drop = _mm_movemask_epi8(_mm_cmpeq_epi8(c, cr));
+
+		if (drop && !all)
+			drop &= (_mm_movemask_epi8(_mm_cmpeq_epi8(c, lf)) >> 1) |
+				(src[i + 16] == '\n') << 15;
+		if (!drop) {
+			/* not past src + i, even in place */
+			_mm_storeu_si128((__m128i *)(dst + o), c);
+			o += 16;
+		} else
+			o += drop_marked(dst + o, src + i, 16, drop);
+	}
+	*out = o;
+	return i;
+}
+
+static size_t add_cr_sse2(char *dst, const char *src, size_t len, size_t *out)
+{
+	const __m128i lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+	unsigned carry = 0;
+	size_t i, o = 0;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i c = _mm_loadu_si128((const __m128i *)(src + i));
+		unsigned crs = _mm_movemask_epi8(_mm_cmpeq_epi8(c, cr));
+		unsigned bare = _mm_movemask_epi8(_mm_cmpeq_epi8(c, lf)) &
+			~((crs << 1) | carry);
+
+		carry = crs >> 15;
+		if (!bare) {
+			_mm_storeu_si128((__m128i *)(dst + o), c);
+			o += 16;
+		} else
+			o += add_cr_marked(dst + o, src + i, 16, bare);
+	}
+	*out = o;
+	return i;
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t sum_bytes_avx2(__m256i v)
+{
+	v = _mm256_sad_epu8(v, _mm256_setzero_si256());
+	return _mm256_extract_epi64(v, 0) + _mm256_extract_epi64(v, 1) +
+		_mm256_extract_epi64(v, 2) + _mm256_extract_epi64(v, 3);
+}
+
+__attribute__((target("avx2")))
+static unsigned long stats_avx2(const char *buf, unsigned long size,
+				struct text_stat *stats)
+{
+	const __m256i lf = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+	const __m256i zero = _mm256_setzero_si256();
+	unsigned long i = 0;
+
+	while (i + 32 < size) {
+		__m256i n_lf = zero, n_cr = zero, n_crlf = zero;
+		__m256i n_nul = zero, n_np = zero;
+		unsigned long start = i, lfs, crs, nps;
+		int round;
+
+		/* the byte counters must not wrap */
+		for (round = 0; round < 255 && i + 32 < size; round++, i += 32) {
+			__m256i c = _mm256_loadu_si256((const __m256i *)(buf + i));
+			__m256i next = _mm256_loadu_si256((const __m256i *)(buf + i + 1));
+			__m256i is_lf = _mm256_cmpeq_epi8(c, lf);
+			__m256i is_cr = _mm256_cmpeq_epi8(c, cr);
+			__m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(c, _mm256_set1_epi8(31)), c);
+			__m256i ok = _mm256_or_si256(_mm256_or_si256(is_lf, is_cr),
+				     _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\b')),
+								     _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\t'))),
+						     _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\033')),
+								     _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\014')))));
+
+			n_lf = _mm256_sub_epi8(n_lf, is_lf);
+			n_cr = _mm256_sub_epi8(n_cr, is_cr);
+			n_crlf = _mm256_sub_epi8(n_crlf, _mm256_and_si256(is_cr, _mm256_cmpeq_epi8(next, lf)));
+			n_nul = _mm256_sub_epi8(n_nul, _mm256_cmpeq_epi8(c, zero));
+			n_np = _mm256_sub_epi8(n_np, _mm256_or_si256(_mm256_andnot_si256(ok, ctl),
+								     _mm256_cmpeq_epi8(c, _mm256_set1_epi8(127))));
+		}
+		lfs = sum_bytes_avx2(n_lf);
+		crs = sum_bytes_avx2(n_cr);
+		nps = sum_bytes_avx2(n_np);
+		stats->lf += lfs;
+		stats->cr += crs;
+		stats->crlf += sum_bytes_avx2(n_crlf);
+		stats->nul += sum_bytes_avx2(n_nul);
+		stats->nonprintable += nps;
+		stats->printable += i - start - lfs - crs - nps;
+	}
+	return i;
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t drop_cr_avx2(char *dst, const char *src, size_t len, int all,
+			   size_t *out)
+{
+	const __m256i lf = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+	size_t i, o = 0;
+
+	for (i = 0; i + 32 < len; i += 32) {
+		__m256i c = _mm256_loadu_si256((const __m256i *)(src + i));
+		unsigned drop = _mm256_movemask_epi8(_mm256_cmpeq_epi8(c, cr));
+		int g;
+
+		if (drop && !all)
+			drop &= ((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, lf)) >> 1) |
+				(unsigned)(src[i + 32] == '\n') << 31;
+		if (!drop) {
+			/* not past src + i, even in place */
+			_mm256_storeu_si256((__m256i *)(dst + o), c);
+			o += 32;
+			continue;
+		}
+		/* eight bytes at a time, never storing past what was read */
+		for (g = 0; g < 32; g += 8) {
+			unsigned m = (drop >> g) & 0xff;
+			__m128i v = _mm_loadl_epi64((const __m128i *)(src + i + g));
+
+			if (m)
+				v = _mm_shuffle_epi8(v, _mm_loadl_epi64((const __m128i *)drop_cr_shuffle[m]));
+			_mm_storel_epi64((__m128i *)(dst + o), v);
+			o += 8 - __builtin_popcount(m);
+		}
+	}
+	*out = o;
+	return i;
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t add_cr_avx2(char *dst, const char *src, size_t len, size_t *out)
+{
+	const __m256i lf = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+	const __m128i crs8 = _mm_set1_epi8('\r');
+	unsigned carry = 0;
+	size_t i, o = 0;
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		__m256i c = _mm256_loadu_si256((const __m256i *)(src + i));
+		unsigned crs = _mm256_movemask_epi8(_mm256_cmpeq_epi8(c, cr));
+		unsigned bare = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, lf)) &
+			~((crs << 1) | carry);
+		int g;
+
+		carry = crs >> 31;
+		if (!bare) {
+			_mm256_storeu_si256((__m256i *)(dst + o), c);
+			o += 32;
+			continue;
+		}
+		for (g = 0; g < 32; g += 8) {
+			unsigned m = (bare >> g) & 0xff;
+			__m128i v = _mm_loadl_epi64((const __m128i *)(src + i + g));
+
+			if (!m) {
+				_mm_storel_epi64((__m128i *)(dst + o), v);
+				o += 8;
+				continue;
+			}
+			v = _mm_shuffle_epi8(_mm_unpacklo_epi64(v, crs8),
+					     _mm_loadu_si128((const __m128i *)add_cr_shuffle[m]));
+			_mm_storeu_si128((__m128i *)(dst + o), v);
+			o += 8 + __builtin_popcount(m);
+		}
+	}
+	*out = o;
+	return i;
+}
+
+static const struct x86_kernels {
+	struct text_kernels k;
+	unsigned needs;		/* X86_* features */
+} backends[] = {
+	{ { "avx2", stats_avx2, drop_cr_avx2, add_cr_avx2 }, X86_AVX2 | X86_POPCNT },
+	{ { "sse2", stats_sse2, drop_cr_sse2, add_cr_sse2 }, 0 },
+	{ { "generic" }, 0 },
+};
+
+const struct text_kernels *x86_text_kernels(void)
+{
+	const char *want = getenv("GIT_X86_CONVERT");
+	unsigned features = x86_cpu_features();
+	int i, n = ARRAY_SIZE(backends);
+
+	init_shuffles();
+	if (want)
+		for (i = 0; i < n; i++)
+			if (!strcmp(want, backends[i].k.name) &&
+			    (features & backends[i].needs) == backends[i].needs)
+				return &backends[i].k;
+	for (i = 0; i < n; i++)
+		if ((features & backends[i].needs) == backends[i].needs)
+			return &backends[i].k;
+	return &backends[n - 1].k;
+}
+
+#else
+
+const struct text_kernels *x86_text_kernels(void)
+{
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,61 @@
+#include "cpu.h"
+
+#ifdef __GNUC__
+
+#include <stddef.h>
+#include <cpuid.h>
+
+#ifndef bit_AVX2
+#define bit_AVX2 (1 << 5)
+#endif
+#ifndef bit_SHA
+#define bit_SHA (1 << 29)
+#endif
+
+static unsigned ask_cpuid(void)
+{
+	unsigned int eax, ebx, ecx, edx, ebx7 = 0, lo, hi;
+	unsigned features = 0;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	if (__get_cpuid_max(0, NULL) >= 7) {
+		unsigned int a, c, d;
+		__cpuid_count(7, 0, a, ebx7, c, d);
+	}
+
+	if (ecx & bit_SSSE3)
+		features |= X86_SSSE3;
+	if (ecx & bit_SSE4_1)
+		features |= X86_SSE4_1;
+	if (ecx & bit_POPCNT)
+		features |= X86_POPCNT;
+	if (ebx7 & bit_SHA)
+		features |= X86_SHA;
+	/* AVX2 also needs the OS to save the upper halves of the registers */
+	if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX) && (ebx7 & bit_AVX2)) {
+		__asm__("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+		if ((lo & 6) == 6)
+			features |= X86_AVX2;
+	}
+	return features;
+}
+
+#else
+
+static unsigned ask_cpuid(void)
+{
+	return 0;
+}
+
+#endif
+
+unsigned x86_cpu_features(void)
+{
+	/* threads racing here all store the same answer */
+	static int features = -1;
+
+	if (features < 0)
+		features = ask_cpuid();
+	return features;
+}
@@ -0,0 +1,18 @@
+#ifndef X86_CPU_H
+#define X86_CPU_H
+
+/*
+ * What the CPU has, and the OS lets us use, among the instruction set
+ * extensions that code picked at run time may need.  SSE2 is always
+ * there on x86-64, so it has no bit.
+ */
+#define X86_SSSE3	(1u << 0)
+#define X86_SSE4_1	(1u << 1)
+#define X86_POPCNT	(1u << 2)
+#define X86_AVX2	(1u << 3)
+#define X86_SHA		(1u << 4)
+
+/* Asks CPUID on the first call only. */
+unsigned x86_cpu_features(void);
+
+#endif /* X86_CPU_H */
@@ -0,0 +1,358 @@
+/*
+ * SHA-1 for x86-64.
+ *
+ * The block function is chosen on first use from what CPUID reports:
+ *
+ *  - "shani":   the SHA extensions (sha1rnds4 and friends) do whole
+ *               rounds in hardware;
+ *  - "avx2":    the message schedule of two blocks is computed at once
+ *               in 256-bit registers, the rounds are scalar;
+ *  - "ssse3":   the message schedule of one block is computed four
+ *               words at a time, the rounds are scalar;
+ *  - "generic": plain C.
+ *
+ * GIT_X86_SHA1=<name> in the environment asks for a particular one, as
+ * long as the CPU supports it; this is meant for testing and for
+ * comparing them with "test-sha1 -b".
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+#include "cpu.h"
+#include "sha1.h"
+
+typedef void (*sha1_blocks_fn)(uint32_t *hash, const unsigned char *data,
+			       unsigned long blocks);
+
+#define K1 0x5a827999
+#define K2 0x6ed9eba1
+#define K3 0x8f1bbcdc
+#define K4 0xca62c1d6
+
+#define rol(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+/*
+ * 80 rounds over a message schedule that already has the round
+ * constants added in.
+ */
+static inline void sha1_rounds(uint32_t *hash, const uint32_t *wk)
+{
+	uint32_t a = hash[0], b = hash[1], c = hash[2], d = hash[3], e = hash[4];
+	int i;
+
+#define F1(b, c, d) ((d) ^ ((b) & ((c) ^ (d))))
+#define F2(b, c, d) ((b) ^ (c) ^ (d))
+#define F3(b, c, d) (((b) & (c)) | ((d) & ((b) | (c))))
+#define ROUND(f, a, b, c, d, e, n) \
+	do { \
+		e += rol(a, 5) + f(b, c, d) + wk[n]; \
+		b = rol(b, 30); \
+	} while (0)
+#define ROUNDS5(f, i) \
+	do { \
+		ROUND(f, a, b, c, d, e, i); \
+		ROUND(f, e, a, b, c, d, i + 1); \
+		ROUND(f, d, e, a, b, c, i + 2); \
+		ROUND(f, c, d, e, a, b, i + 3); \
+		ROUND(f, b, c, d, e, a, i + 4); \
+	} while (0)
+
+	for (i = 0; i < 20; i += 5)
+		ROUNDS5(F1, i);
+	for (; i < 40; i += 5)
+		ROUNDS5(F2, i);
+	for (; i < 60; i += 5)
+		ROUNDS5(F3, i);
+	for (; i < 80; i += 5)
+		ROUNDS5(F2, i);
+
+#undef ROUNDS5
+#undef ROUND
+#undef F3
+#undef F2
+#undef F1
+
+	hash[0] += a;
+	hash[1] += b;
+	hash[2] += c;
+	hash[3] += d;
+	hash[4] += e;
+}
+
+static void sha1_blocks_generic(uint32_t *hash, const unsigned char *data,
+				unsigned long blocks)
+{
+	uint32_t w[80];
+	int i;
+
+	while (blocks--) {
+		for (i = 0; i < 16; i++, data += 4)
+			w[i] = ((uint32_t)data[0] << 24) | (data[1] << 16) |
+			       (data[2] << 8) | data[3];
+		for (; i < 80; i++)
+			w[i] = rol(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+		for (i = 0; i < 20; i++)
+			w[i] += K1;
+		for (; i < 40; i++)
+			w[i] += K2;
+		for (; i < 60; i++)
+			w[i] += K3;
+		for (; i < 80; i++)
+			w[i] += K4;
+		sha1_rounds(hash, w);
+	}
+}
+
+/*
+ * The message schedule, four words per vector.  For w[16..31] the
+ * last word of each vector depends on the first one, which is fixed
+ * up afterwards; from w[32] on we use the equivalent recurrence
+ *
+ *	w[i] = rol(w[i-6] ^ w[i-16] ^ w[i-28] ^ w[i-32], 2)
+ *
+ * whose inputs are all at least six words back.
+ */
+#define vrol(x, n) _mm_or_si128(_mm_slli_epi32((x), (n)), _mm_srli_epi32((x), 32 - (n)))
+
+__attribute__((target("ssse3")))
+static void sha1_blocks_ssse3(uint32_t *hash, const unsigned char *data,
+			      unsigned long blocks)
+{
+	const __m128i bswap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+					   4, 5, 6, 7, 0, 1, 2, 3);
+	uint32_t wk[80];
+	__m128i w[20], k, t;
+	int i;
+
+	while (blocks--) {
+		for (i = 0; i < 4; i++)
+			w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data + i), bswap);
+		for (; i < 8; i++) {
+			t = _mm_xor_si128(_mm_srli_si128(w[i-1], 4), w[i-2]);
+			t = _mm_xor_si128(t, _mm_alignr_epi8(w[i-3], w[i-4], 8));
+			t = _mm_xor_si128(t, w[i-4]);
+			t = vrol(t, 1);
+			w[i] = _mm_xor_si128(t, vrol(_mm_slli_si128(t, 12), 1));
+		}
+		for (; i < 20; i++) {
+			t = _mm_xor_si128(_mm_alignr_epi8(w[i-1], w[i-2], 8), w[i-4]);
+			t = _mm_xor_si128(t, _mm_xor_si128(w[i-7], w[i-8]));
+			w[i] = vrol(t, 2);
+		}
+		for (i = 0; i < 20; i++) {
+			k = _mm_set1_epi32(i < 5 ? K1 : i < 10 ? K2 : i < 15 ? K3 : K4);
+			_mm_storeu_si128((__m128i *)wk + i, _mm_add_epi32(w[i], k));
+		}
+		sha1_rounds(hash, wk);
+		data += 64;
+	}
+}
+
+#define vrol256(x, n) _mm256_or_si256(_mm256_slli_epi32((x), (n)), _mm256_srli_epi32((x), 32 - (n)))
+
+/* Same as above, with the second block in the upper half of each register. */
+__attribute__((target("avx2")))
+static void sha1_blocks_avx2(uint32_t *hash, const unsigned char *data,
+			     unsigned long blocks)
+{
+	const __m256i bswap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+					      4, 5, 6, 7, 0, 1, 2, 3,
+					      12, 13, 14, 15, 8, 9, 10, 11,
+					      4, 5, 6, 7, 0, 1, 2, 3);
+	uint32_t wk[2][80];
+	__m256i w[20], k, t;
+	int i;
+
+	for (; blocks >= 2; blocks -= 2) {
+		for (i = 0; i < 4; i++) {
+			t = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)data + i));
+			t = _mm256_inserti128_si256(t, _mm_loadu_si128((const __m128i *)(data + 64) + i), 1);
+			w[i] = _mm256_shuffle_epi8(t, bswap);
+		}
+		for (; i < 8; i++) {
+			t = _mm256_xor_si256(_mm256_srli_si256(w[i-1], 4), w[i-2]);
+			t = _mm256_xor_si256(t, _mm256_alignr_epi8(w[i-3], w[i-4], 8));
+			t = _mm256_xor_si256(t, w[i-4]);
+			t = vrol256(t, 1);
+			w[i] = _mm256_xor_si256(t, vrol256(_mm256_slli_si256(t, 12), 1));
+		}
+		for (; i < 20; i++) {
+			t = _mm256_xor_si256(_mm256_alignr_epi8(w[i-1], w[i-2], 8), w[i-4]);
+			t = _mm256_xor_si256(t, _mm256_xor_si256(w[i-7], w[i-8]));
+			w[i] = vrol256(t, 2);
+		}
+		for (i = 0; i < 20; i++) {
+			k = _mm256_set1_epi32(i < 5 ? K1 : i < 10 ? K2 : i < 15 ? K3 : K4);
+			t = _mm256_add_epi32(w[i], k);
+			_mm_storeu_si128((__m128i *)wk[0] + i, _mm256_castsi256_si128(t));
+			_mm_storeu_si128((__m128i *)wk[1] + i, _mm256_extracti128_si256(t, 1));
+		}
+		sha1_rounds(hash, wk[0]);
+		sha1_rounds(hash, wk[1]);
+		data += 128;
+	}
+	if (blocks)
+		sha1_blocks_ssse3(hash, data, blocks);
+}
+
+/*
+ * Four rounds with the SHA extensions.  msg[] holds the message words
+ * for the next four groups of four rounds; e[] alternates between the
+ * E value (plus message) for this group and the saved ABCD from which
+ * the next group derives its E.
+ */
+#define SHANI_ROUNDS(g) \
+	do { \
+		if ((g) < 4) \
+			msg[(g) & 3] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data + ((g) & 3)), bswap); \
+		if (g) \
+			e[(g) & 1] = _mm_sha1nexte_epu32(e[(g) & 1], msg[(g) & 3]); \
+		else \
+			e[0] = _mm_add_epi32(e[0], msg[0]); \
+		e[((g) + 1) & 1] = abcd; \
+		if ((g) >= 3 && (g) <= 18) \
+			msg[((g) + 1) & 3] = _mm_sha1msg2_epu32(msg[((g) + 1) & 3], msg[(g) & 3]); \
+		abcd = _mm_sha1rnds4_epu32(abcd, e[(g) & 1], (g) / 5); \
+		if ((g) >= 1 && (g) <= 16) \
+			msg[((g) + 3) & 3] = _mm_sha1msg1_epu32(msg[((g) + 3) & 3], msg[(g) & 3]); \
+		if ((g) >= 2 && (g) <= 17) \
+			msg[((g) + 2) & 3] = _mm_xor_si128(msg[((g) + 2) & 3], msg[(g) & 3]); \
+	} while (0)
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha1_blocks_shani(uint32_t *hash, const unsigned char *data,
+			      unsigned long blocks)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0001020304050607ULL,
+					     0x08090a0b0c0d0e0fULL);
+	__m128i abcd, abcd_save, e0, e_save, e[2], msg[4];
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)hash), 0x1b);
+	e0 = _mm_set_epi32(hash[4], 0, 0, 0);
+
+	while (blocks--) {
+		abcd_save = abcd;
+		e_save = e0;
+		e[0] = e0;
+
+		SHANI_ROUNDS(0);  SHANI_ROUNDS(1);  SHANI_ROUNDS(2);  SHANI_ROUNDS(3);
+		SHANI_ROUNDS(4);  SHANI_ROUNDS(5);  SHANI_ROUNDS(6);  SHANI_ROUNDS(7);
+		SHANI_ROUNDS(8);  SHANI_ROUNDS(9);  SHANI_ROUNDS(10); SHANI_ROUNDS(11);
+		SHANI_ROUNDS(12); SHANI_ROUNDS(13); SHANI_ROUNDS(14); SHANI_ROUNDS(15);
+		SHANI_ROUNDS(16); SHANI_ROUNDS(17); SHANI_ROUNDS(18); SHANI_ROUNDS(19);
+
+		e0 = _mm_sha1nexte_epu32(e[0], e_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+		data += 64;
+	}
+
+	_mm_storeu_si128((__m128i *)hash, _mm_shuffle_epi32(abcd, 0x1b));
+	hash[4] = _mm_extract_epi32(e0, 3);
+}
+
+static const struct sha1_backend {
+	const char *name;
+	sha1_blocks_fn fn;
+	unsigned needs;		/* X86_* features */
+} backends[] = {
+	{ "shani", sha1_blocks_shani, X86_SSSE3 | X86_SSE4_1 | X86_SHA },
+	{ "avx2", sha1_blocks_avx2, X86_AVX2 },
+	{ "ssse3", sha1_blocks_ssse3, X86_SSSE3 },
+	{ "generic", sha1_blocks_generic, 0 },
+};
+
+static const struct sha1_backend *backend;
+
+static const struct sha1_backend *choose_backend(void)
+{
+	const char *want = getenv("GIT_X86_SHA1");
+	unsigned features = x86_cpu_features();
+	int i, n = sizeof(backends) / sizeof(backends[0]);
+
+	if (want)
+		for (i = 0; i < n; i++)
+			if (!strcmp(want, backends[i].name) &&
+			    (features & backends[i].needs) == backends[i].needs)
+				return &backends[i];
+	for (i = 0; i < n; i++)
+		if ((features & backends[i].needs) == backends[i].needs)
+			return &backends[i];
+	return &backends[n - 1];
+}
+
+static inline void sha1_blocks(uint32_t *hash, const unsigned char *data,
+			       unsigned long blocks)
+{
+	if (!backend)
+		backend = choose_backend();
+	backend->fn(hash, data, blocks);
+}
+
+const char *x86_SHA1_Backend(void)
+{
+	if (!backend)
+		backend = choose_backend();
+	return backend->name;
+}
+
+void x86_SHA1_Init(x86_SHA_CTX *c)
+{
+	c->len = 0;
+	c->hash[0] = 0x67452301;
+	c->hash[1] = 0xefcdab89;
+	c->hash[2] = 0x98badcfe;
+	c->hash[3] = 0x10325476;
+	c->hash[4] = 0xc3d2e1f0;
+}
+
+void x86_SHA1_Update(x86_SHA_CTX *c, const void *p, unsigned long n)
+{
+	const unsigned char *data = p;
+	unsigned int partial = c->len & 0x3f;
+
+	c->len += n;
+	if (partial) {
+		unsigned int fill = 64 - partial;
+		if (n < fill) {
+			memcpy(c->buffer + partial, data, n);
+			return;
+		}
+		memcpy(c->buffer + partial, data, fill);
+		sha1_blocks(c->hash, c->buffer, 1);
+		data += fill;
+		n -= fill;
+	}
+	if (n >= 64) {
+		sha1_blocks(c->hash, data, n / 64);
+		data += n & ~0x3fUL;
+		n &= 0x3f;
+	}
+	if (n)
+		memcpy(c->buffer, data, n);
+}
+
+void x86_SHA1_Final(unsigned char *hash, x86_SHA_CTX *c)
+{
+	static const unsigned char padding[64] = { 0x80, };
+	uint64_t bitlen = c->len << 3;
+	unsigned int i, offset, padlen;
+	unsigned char bits[8];
+
+	offset = c->len & 0x3f;
+	padlen = ((offset < 56) ? 56 : (64 + 56)) - offset;
+	x86_SHA1_Update(c, padding, padlen);
+
+	for (i = 0; i < 8; i++)
+		bits[i] = bitlen >> (56 - 8 * i);
+	x86_SHA1_Update(c, bits, 8);
+
+	for (i = 0; i < 5; i++) {
+		uint32_t v = c->hash[i];
+		hash[0] = v >> 24;
+		hash[1] = v >> 16;
+		hash[2] = v >> 8;
+		hash[3] = v;
+		hash += 4;
+	}
+}
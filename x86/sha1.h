@@ -0,0 +1,25 @@
+/*
+ * SHA-1 for x86-64 with the block function picked at run time
+ * (SHA extensions, AVX2, SSSE3 or plain C).
+ */
+
+#include <stdint.h>
+
+typedef struct {
+	uint64_t len;
+	uint32_t hash[5];
+	unsigned char buffer[64];
+} x86_SHA_CTX;
+
+void x86_SHA1_Init(x86_SHA_CTX *c);
+void x86_SHA1_Update(x86_SHA_CTX *c, const void *p, unsigned long n);
+void x86_SHA1_Final(unsigned char *hash, x86_SHA_CTX *c);
+
+/* name of the block function in use, for test-sha1 */
+const char *x86_SHA1_Backend(void);
+#define GIT_SHA1_BACKEND x86_SHA1_Backend()
+
+#define git_SHA_CTX	x86_SHA_CTX
+#define git_SHA1_Init	x86_SHA1_Init
+#define git_SHA1_Update	x86_SHA1_Update
+#define git_SHA1_Final	x86_SHA1_Final